@@ -65,14 +65,23 @@ void MainWindow::udpServerReceiveData()
             qDebug()<<"frame size : "<<frameSize<<endl;
 
             datagram.resize(frameSize);
+            recvCount = 0;
+            recvBytes = 0;
         }
         else {
-            memcpy( &datagram.data()[recvCount * 50000], recvBuff.data(), recvBuff.size() );
+            // 分片按收到的顺序接在已收数据之后, 不依赖发送端的分片长度
+            if( recvBytes + recvBuff.size() > datagram.size() ){
+                qDebug()<<"Discard piece beyond frame size : "<<recvBuff.size()<<endl;
+                continue;
+            }
+            memcpy( &datagram.data()[recvBytes], recvBuff.data(), recvBuff.size() );
+            recvBytes += recvBuff.size();
             recvCount ++;
             qDebug()<<"recvCount : "<<recvCount<<endl;
 
-            if( recvCount == frameSize / 50000 + 1 ){
+            if( recvBytes == frameSize ){
                 recvCount = 0;
+                recvBytes = 0;
                 getImageFromArray(datagram.data());
                 ui->image_label->setPixmap(QPixmap::fromImage(this->image).scaled(ui->image_label->size()));
             }
@@ -49,6 +49,7 @@ private:
     QByteArray datagram;
     int frameSize = 0;
     int recvCount = 0;
+    int recvBytes = 0;
 
     QImage image;
 
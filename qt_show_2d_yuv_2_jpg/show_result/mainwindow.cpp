@@ -18,10 +18,45 @@ MainWindow::MainWindow(QWidget *parent)
     // --------- Init Information -------------//
     ui->log->setText("Program Begins ...");
 
+    // --------- Init the frame reassembler ----//
+    reassembler.setFrameCallback( MainWindow::onFrameDemux, this );
+    reassembler.setNackCallback( MainWindow::onNackRequest, this );
+    recvClock.start();
+
+    // --------- 按通道分发图像和检测结果 ----//
+    // Linux 下图像在接收线程中收完, 拷贝后交给界面线程; 其它平台在界面线程中直接显示
+#ifdef Q_OS_LINUX
+    demux.setFrameConsumer( displayChannel, MainWindow::onFrameReceived, this );
+#else
+    demux.setFrameConsumer( displayChannel, MainWindow::onFrameReassembled, this );
+#endif
+    demux.setConsumer( displayChannel, pcs::MSG_FRAME_TIMING, MainWindow::onFrameTimingMessage, this );
+    demux.setConsumer( displayChannel, pcs::MSG_OBJECT_RESULT, MainWindow::onObjectResult, this );
+    demux.setConsumer( displayChannel, pcs::MSG_LANE_POINTS, MainWindow::onLanePoints, this );
+
+    reassemblyTimer.setInterval( NACK_DELAY_MS / 2 );
+    connect(&reassemblyTimer, SIGNAL(timeout()), this, SLOT(checkReassembler()));
+
+    statsTimer.setInterval( 1000 );
+    connect(&statsTimer, SIGNAL(timeout()), this, SLOT(showTransportStats()));
+
+    reportTimer.setInterval( BWE_REPORT_INTERVAL_MS );
+    connect(&reportTimer, SIGNAL(timeout()), this, SLOT(sendReceiverReport()));
+
+    // --------- Init the jitter buffer ----//
+    jitter.setDelay( PLAYOUT_MIN_DELAY_MS, PLAYOUT_MAX_DELAY_MS );
+    jitter.setReleaseCallback( MainWindow::onFramePlayout, this );
+    playoutTimer.setSingleShot( true );
+    playoutTimer.setTimerType( Qt::PreciseTimer );
+    connect(&playoutTimer, SIGNAL(timeout()), this, SLOT(playoutFrames()));
+
 }
 
 MainWindow::~MainWindow()
 {
+#ifdef Q_OS_LINUX
+    delete frameReceiver;
+#endif
     delete ui;
 }
 
@@ -31,111 +66,196 @@ MainWindow::~MainWindow()
 */
 bool MainWindow::udpInit()
 {
-    quint16 local_port = 2333;
+    quint16 local_port = FRAME_DATA_PORT;
+
+#ifdef Q_OS_LINUX
+    // 已经在接收时再次点击开始不重复创建, 否则两个接收线程会各收到一部分分片
+    if( frameReceiver != nullptr ){
+        return true;
+    }
+
+    // 在独立线程中用 recvmmsg 批量收包, 收完一帧再交给界面线程显示
+    frameReceiver = new pcs::FrameReceiver();
+    // 绑定任意地址, 单播和组播的图像数据都能收到
+    if( !frameReceiver->init( nullptr, local_port ) ){
+        ui->log->setText("Can not bind the IP address ...");
+        ui->connection_status->setText("Bind Error");
+        delete frameReceiver;
+        frameReceiver = nullptr;
+
+        return false;
+    }
+    frameReceiver->joinGroup( FRAME_MULTICAST_GROUP );
+    frameReceiver->setGro( true );
+    // 内核支持时改用 io_uring 收包, 否则继续用 recvmmsg
+    if( frameReceiver->setUring( true ) ){
+        qDebug()<<"receive frames with io_uring"<<endl;
+    }
+    frameReceiver->setFrameCallback( MainWindow::onFrameDemux, this );
+    frameReceiver->setMessageCallback( MainWindow::onMessageReceived, this );
+    frameReceiver->start();
+
+    ui->log->setText("Bind the IP Address successfully And Connected to the Udp Server ...");
+    ui->connection_status->setText("Connected");
+
+    return true;
+#endif
+
+    if( udp_server != nullptr ){
+        return true;
+    }
     udp_server = new QUdpSocket(this);
 
     //int ret = udp_server->bind( local_port, QUdpSocket::ShareAddress );
-    int ret = udp_server->bind( QHostAddress("192.168.22.69"), local_port );
-    if( ret < 0 ){
+    int ret = udp_server->bind( QHostAddress::AnyIPv4, local_port, QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint );
+    if( ret <= 0 ){
         ui->log->setText("Can not bind the IP address ...");
         ui->connection_status->setText("Bind Error: " + QString::number(ret));
+        udp_server->deleteLater();
+        udp_server = nullptr;
 
         return false;
     }
 
+    // 设备开启组播时一帧只发一次, 多个显示端/录像端都加入同一组播组
+    if( !udp_server->joinMulticastGroup( QHostAddress(FRAME_MULTICAST_GROUP) ) ){
+        qDebug()<<"Can not join the multicast group ..."<<endl;
+    }
+
+    // 分片按 MTU 切分后每帧约一千个数据报, 加大接收缓存以容纳突发
+    udp_server->setSocketOption( QAbstractSocket::ReceiveBufferSizeSocketOption, 8 * 1024 * 1024 );
+
     ui->log->setText("Bind the IP Address successfully And Connected to the Udp Server ...");
     connect(udp_server, SIGNAL(readyRead()), this, SLOT(udpServerReceiveData()));
+    reassemblyTimer.start();
     ui->connection_status->setText("Connected: " + QString::number(ret));
 
     return true;
 }
 
 /*
-@   初始化接收检测结果的UDP
+@   初始化接收图像数据的TCP, 与 UDP 使用同一端口号
 @
 */
-bool MainWindow::resultsUDPInit()
+bool MainWindow::tcpInit()
 {
-    quint16 local_port = 2334;
-    udp_server2 = new QUdpSocket(this);
-
-    //int ret = udp_server->bind( local_port, QUdpSocket::ShareAddress );
-    int ret = udp_server2->bind( QHostAddress("192.168.22.69"), local_port );
-    if( ret < 0 ){
-        qDebug()<<"Can not init the results udp ..."<<endl;
+    quint16 local_port = FRAME_DATA_PORT;
+    if( tcp_server != nullptr ){
+        return true;
+    }
+    tcp_server = new QTcpServer(this);
+    if( !tcp_server->listen( QHostAddress::AnyIPv4, local_port ) ){
+        qDebug()<<"Can not listen the tcp port ..."<<endl;
+        tcp_server->deleteLater();
+        tcp_server = nullptr;
         return false;
     }
 
-    ui->log->insertPlainText("Init the UDP Results ...  ");
-    connect(udp_server2, SIGNAL(readyRead()), this, SLOT(udpReceiveResults()));
-
+    connect(tcp_server, SIGNAL(newConnection()), this, SLOT(tcpNewConnection()));
     return true;
 }
 
 /*
-@   接收检测结果数据
+@   接受设备的TCP连接, 只保留最新的一个
 @
 */
-void MainWindow::udpReceiveResults()
+void MainWindow::tcpNewConnection()
 {
-    QByteArray recvBuff;
-    while( udp_server2->hasPendingDatagrams() ){
-        qDebug()<<"received length: "<<udp_server2->pendingDatagramSize()<<endl;
+    QTcpSocket *socket = tcp_server->nextPendingConnection();
+    if( socket == nullptr ){
+        return;
+    }
 
-        // Allocate the memory for the coming image
-        recvBuff.resize( udp_server2->pendingDatagramSize() );
+    if( tcp_client != nullptr ){
+        tcp_client->deleteLater();
+    }
+    tcp_client = socket;
+    tcpBuffer.clear();
 
-        // Received the Data sent from the client
-        udp_server2->readDatagram(recvBuff.data(), recvBuff.size(), &client_address2, &client_port2);
+    tcp_client->setSocketOption( QAbstractSocket::ReceiveBufferSizeSocketOption, 4 * 1024 * 1024 );
+    connect(tcp_client, SIGNAL(readyRead()), this, SLOT(tcpReceiveData()));
+    ui->connection_status->setText("Connected: TCP");
+}
 
-        // 1. 收到了 ObjectTrackEventResult 信息 ---- 障碍物信息，包括交通标志和车辆行人
-        if( recvBuff[0] == 'a' && recvBuff[1] == 'a' && recvBuff[2] == 'a' && recvBuff[3] == 'a' ){
-            qDebug()<<"Objects Track Event Result: "<<endl;
-            ObjectTrackEventResult objectsResults;
-            memcpy( &objectsResults, &recvBuff.data()[4], sizeof( ObjectTrackEventResult ) );
+/*
+@   接收TCP字节流, 按 4 字节长度拆出分片交给 reassembler
+@
+*/
+void MainWindow::tcpReceiveData()
+{
+    tcpBuffer.append( tcp_client->readAll() );
+
+    const unsigned char *data = (const unsigned char *)tcpBuffer.constData();
+    int consumed = 0;
+    while( tcpBuffer.size() - consumed >= 4 ){
+        int len = pcs::getU32( data + consumed );
+        if( len < 0 || len > pcs::MAX_DATAGRAM_SIZE ){
+            qDebug()<<"Invalid tcp message length : "<<len<<endl;
+            tcp_client->abort();
+            tcpBuffer.clear();
+            return;
+        }
+        if( tcpBuffer.size() - consumed - 4 < len ){
+            break;
+        }
+        int type = pcs::peekMessageType( data + consumed + 4, len );
+        if( type >= 0 && type != pcs::MSG_FRAGMENT ){
+            handleMessage( QByteArray( (const char *)data + consumed + 4, len ), localTimeUs() );
+        }
+        else {
+            reassembler.pushFragment( data + consumed + 4, len, recvClock.elapsed() );
+        }
+        consumed += 4 + len;
+    }
+    tcpBuffer.remove( 0, consumed );
+}
 
-            objectRects.clear();
-            objectsTypes.clear();
-            objectsTypesPoses.clear();
+/*
+@   显示通道的检测结果 ---- 障碍物信息，包括交通标志和车辆行人, 直接在数据报上读取, 不再拷贝整个结构体
+@
+*/
+void MainWindow::showObjectResult( const pcs::ObjectResultView &objectsResults )
+{
+    qDebug()<<"Objects Track Event Result: "<<endl;
 
-            for( int i = 0; i < objectsResults.nObjectNumber; i ++ ){
-                cv::Rect rect( objectsResults.objInfo[i].nLeft, objectsResults.objInfo[i].nTop,
-                               objectsResults.objInfo[i].nRight - objectsResults.objInfo[i].nLeft, objectsResults.objInfo[i].nBottom - objectsResults.objInfo[i].nTop);
+    objectRects.clear();
+    objectsTypes.clear();
+    objectsTypesPoses.clear();
 
-                ui->log->setText("Object Type: " + QString::number(objectsResults.objInfo[i].nDetectType) + "\r\n"
-                                 "\tnLeft:   " + QString::number(objectsResults.objInfo[i].nLeft) +
-                                 "\tnTop:    " + QString::number(objectsResults.objInfo[i].nTop)+
-                                 "\tnRight:  " + QString::number(objectsResults.objInfo[i].nRight) +
-                                 "\tnBottom: " + QString::number(objectsResults.objInfo[i].nBottom));
+    for( int i = 0; i < objectsResults.objectNumber(); i ++ ){
+        pcs::ResultObject obj = objectsResults.object( i );
+        cv::Rect rect( obj.left, obj.top, obj.right - obj.left, obj.bottom - obj.top );
 
-                objectRects.push_back(rect);
-                objectsTypes.push_back( objectsResults.objInfo[i].nDetectType );
+        ui->log->setText("Object Type: " + QString::number(obj.type) + "\r\n"
+                         "\tnLeft:   " + QString::number(obj.left) +
+                         "\tnTop:    " + QString::number(obj.top)+
+                         "\tnRight:  " + QString::number(obj.right) +
+                         "\tnBottom: " + QString::number(obj.bottom));
 
-                cv::Point infoPose( objectsResults.objInfo[i].nLeft, objectsResults.objInfo[i].nTop - 10 );
-                objectsTypesPoses.push_back(infoPose);
-            }
-        }
-        // 2. 收到了 DrawPointInfo 信息 ---- 车道线信息
-        else if( recvBuff[0] == 'b' && recvBuff[1] == 'b' && recvBuff[2] == 'b' && recvBuff[3] == 'b' ){
-            qDebug()<<"Lanes Points Info: "<<endl;
-            DrawPointInfo pointsInfo;
-            memcpy( &pointsInfo, &recvBuff.data()[4], sizeof( DrawPointInfo ) );
-
-            linePoints.clear();
-
-            for( uchar i = 0; i < 4; i ++ ){ // 一共 4 条车道线
-                std::vector<cv::Point2f> points;
-                for( unsigned int j = 0; j < pointsInfo.nPointCounters[i]; j ++ ){ // 遍历每个车道上的点
-                    points.push_back( cv::Point2f( pointsInfo.pSrcPointX[i][j], pointsInfo.pSrcPointY[i][j] ) );
-                }
-                linePoints.push_back(points);
-            }
-        }
-        // 3. Other
-        else {
-            qDebug()<<"UnKnow Info: "<<endl;
+        objectRects.push_back(rect);
+        objectsTypes.push_back( (ObjectDetectType)obj.type );
+
+        cv::Point infoPose( obj.left, obj.top - 10 );
+        objectsTypesPoses.push_back(infoPose);
+    }
+}
 
+/*
+@   显示通道的车道线信息
+@
+*/
+void MainWindow::showLanePoints()
+{
+    qDebug()<<"Lanes Points Info: "<<endl;
+
+    linePoints.clear();
+
+    for( int i = 0; i < lanePoints.laneNum; i ++ ){ // 一共 4 条车道线
+        std::vector<cv::Point2f> points;
+        for( int j = 0; j < lanePoints.pointNum[i]; j ++ ){ // 遍历每个车道上的点
+            points.push_back( cv::Point2f( lanePoints.points[i][j].x, lanePoints.points[i][j].y ) );
         }
+        linePoints.push_back(points);
     }
 }
 
@@ -148,32 +268,426 @@ void MainWindow::udpServerReceiveData()
 {
     QByteArray recvBuff;
     while( udp_server->hasPendingDatagrams() ){
-        qDebug()<<"received length: "<<udp_server->pendingDatagramSize()<<endl;
-
         // Allocate the memory for the coming image
         recvBuff.resize( udp_server->pendingDatagramSize() );
 
         // Received the Data sent from the client
         udp_server->readDatagram(recvBuff.data(), recvBuff.size(), &client_address, &client_port);
+        recvDatagrams ++;
+        recvTotalBytes += recvBuff.size();
+
+        // 帧时间戳, 对时应答等不是分片的消息单独处理
+        int type = pcs::peekMessageType( (const unsigned char *)recvBuff.constData(), recvBuff.size() );
+        if( type >= 0 && type != pcs::MSG_FRAGMENT ){
+            handleMessage( recvBuff, localTimeUs() );
+            continue;
+        }
+
+        // 分片可以乱序到达, 由 reassembler 按帧号重组, 收全后回调 onFrameReassembled
+        if( !reassembler.pushFragment( (const unsigned char *)recvBuff.constData(), recvBuff.size(), recvClock.elapsed() ) ){
+            qDebug()<<"Discard datagram, size : "<<recvBuff.size()<<endl;
+        }
+    }
+}
+
+/*
+@   reassembler 收全一帧后的回调, 在界面线程中直接放进抖动缓冲
+@
+*/
+void MainWindow::onFrameReassembled( const pcs::ReceivedFrame *pFrame, void *pPrivData )
+{
+    MainWindow *window = (MainWindow *)pPrivData;
+    window->bufferFrame( QByteArray::fromRawData( (const char *)pFrame->data, pFrame->size ), pFrame->streamId, pFrame->frameId, window->localTimeUs() );
+
+    const pcs::ReassemblyStats &stats = window->reassembler.getStats();
+    qDebug()<<"frame id : "<<pFrame->frameId<<" completed : "<<stats.completed<<" dropped : "<<stats.dropped
+            <<" late : "<<stats.late<<" nacked : "<<stats.nacked<<" retransmitted : "<<stats.retransmitted<<endl;
+}
+
+/*
+@   收完一帧后按通道号交给该通道的消费者, 不显示的通道直接丢弃
+@
+*/
+void MainWindow::onFrameDemux( const pcs::ReceivedFrame *pFrame, void *pPrivData )
+{
+    MainWindow *window = (MainWindow *)pPrivData;
+    QMutexLocker locker( &window->demuxMutex );
+    window->demux.dispatchFrame( pFrame );
+}
 
-        if( recvBuff[0] == 'L' && recvBuff[1] == 'E' && recvBuff[2] == 'N' && recvBuff[3] == 'G' ){
-            memcpy( &frameSize, &recvBuff.data()[4], 4 );
-            qDebug()<<"frame size : "<<frameSize<<endl;
+/*
+@   显示通道的帧时间戳, 等该帧显示后记入延时统计
+@
+*/
+void MainWindow::onFrameTimingMessage( const unsigned char *msg, int len, void *pPrivData )
+{
+    MainWindow *window = (MainWindow *)pPrivData;
+    pcs::FrameTiming timing;
+    if( pcs::decodeFrameTiming( msg, len, timing ) ){
+        window->latency.onFrameTiming( timing );
+    }
+}
 
-            datagram.resize(frameSize);
+void MainWindow::onObjectResult( const unsigned char *msg, int len, void *pPrivData )
+{
+    MainWindow *window = (MainWindow *)pPrivData;
+    pcs::ObjectResultView objectsResults;
+    if( objectsResults.parse( msg, len ) ){
+        window->showObjectResult( objectsResults );
+    }
+}
+
+void MainWindow::onLanePoints( const unsigned char *msg, int len, void *pPrivData )
+{
+    MainWindow *window = (MainWindow *)pPrivData;
+    if( pcs::decodeLanePoints( msg, len, window->lanePoints ) ){
+        window->showLanePoints();
+    }
+}
+
+/*
+@   定时丢弃超时的帧, 并对停滞的帧请求重传
+@
+*/
+void MainWindow::checkReassembler()
+{
+    qint64 now = recvClock.elapsed();
+    reassembler.evictExpired( now );
+    reassembler.checkNacks( now );
+}
+
+/*
+@   reassembler 的重传请求回调, 发回给图像数据的来源地址
+@
+*/
+void MainWindow::onNackRequest( uint16_t streamId, uint32_t frameId, const uint16_t *indices, int count, void *pPrivData )
+{
+    MainWindow *window = (MainWindow *)pPrivData;
+    if( window->udp_server == nullptr || window->client_port == 0 ){
+        return;
+    }
+
+    QByteArray nack( pcs::NACK_HEADER_SIZE + 2 * count, 0 );
+    int len = pcs::encodeNack( streamId, frameId, indices, count, (unsigned char *)nack.data() );
+    window->udp_server->writeDatagram( nack.constData(), len, window->client_address, window->client_port );
+}
+
+/*
+@   在状态栏显示收包, 内核丢包, 接收队列积压, 重组和端到端延时统计, 顺带向设备对时
+@
+*/
+void MainWindow::showTransportStats()
+{
+#ifdef Q_OS_LINUX
+    if( frameReceiver == nullptr ){
+        return;
+    }
+    pcs::SocketStats sockStats;
+    frameReceiver->getSocketStats( sockStats );
+    pcs::ReassemblyStats stats;
+    frameReceiver->getStats( stats );
+    QString text = "rx " + QString::number( sockStats.rxDatagrams ) + " pkts / " + QString::number( sockStats.rxBytes / 1024 ) + " KB"
+                 + "  kernel drop " + QString::number( sockStats.rxDropped )
+                 + "  inq " + QString::number( sockStats.rxQueued ) + " B";
+#else
+    const pcs::ReassemblyStats &stats = reassembler.getStats();
+    QString text = "rx " + QString::number( recvDatagrams ) + " pkts / " + QString::number( recvTotalBytes / 1024 ) + " KB";
+#endif
+    demuxMutex.lock();
+    pcs::DemuxStats demuxStats = demux.getStats();
+    demuxMutex.unlock();
+    text += "  channel " + QString::number( displayChannel ) + " frames " + QString::number( demuxStats.frames[displayChannel] )
+          + "  unhandled " + QString::number( demuxStats.unhandledFrames + demuxStats.unhandledMessages );
+    text += "  frames " + QString::number( stats.completed ) + "  dropped " + QString::number( stats.dropped )
+          + "  late " + QString::number( stats.late ) + "  nacked " + QString::number( stats.nacked )
+          + "  retransmitted " + QString::number( stats.retransmitted );
+
+    const pcs::JitterStats &jitterStats = jitter.getStats();
+    text += "  playout delay " + QString::number( jitterStats.delayUs / 1000.0, 'f', 1 ) + " ms"
+          + "  jitter " + QString::number( jitterStats.jitterUs / 1000.0, 'f', 1 ) + " ms"
+          + "  late frames " + QString::number( jitterStats.late ) + "  underruns " + QString::number( jitterStats.underruns );
+
+    text += "  capacity " + QString::number( bandwidth.getCapacityKbps() / 1000.0, 'f', 1 ) + " Mbps"
+          + "  " + QString::number( recvImgWidth ) + "x" + QString::number( recvImgHeight );
+
+    const pcs::LatencyHistogram &total = latency.getHistogram( pcs::LATENCY_TOTAL );
+    if( total.getCount() > 0 ){
+        text += "  e2e p50 " + QString::number( total.percentileUs( 50 ) / 1000.0, 'f', 1 ) + " ms"
+              + "  p99 " + QString::number( total.percentileUs( 99 ) / 1000.0, 'f', 1 ) + " ms";
+    }
+    ui->statusbar->showMessage( text );
+
+    sendTimeRequest();
+    if( !streamNegotiated ){
+        sendStreamRequest();
+    }
+    if( ++ statsTicks % 10 == 0 ){
+        printLatency();
+    }
+}
+
+#ifdef Q_OS_LINUX
+/*
+@   接收线程收完一帧后的回调, 拷贝一份交给界面线程
+@
+*/
+void MainWindow::onFrameReceived( const pcs::ReceivedFrame *pFrame, void *pPrivData )
+{
+    MainWindow *window = (MainWindow *)pPrivData;
+    QByteArray frame( (const char *)pFrame->data, pFrame->size );
+    window->pendingFrames.ref();
+    QMetaObject::invokeMethod( window, "bufferFrame", Qt::QueuedConnection, Q_ARG( QByteArray, frame ),
+                               Q_ARG( quint16, pFrame->streamId ), Q_ARG( quint32, pFrame->frameId ), Q_ARG( qint64, window->localTimeUs() ) );
+}
+
+/*
+@   接收线程收到分片以外的消息, 记下收到的时刻后交给界面线程
+@
+*/
+void MainWindow::onMessageReceived( const unsigned char *msg, int len, const struct sockaddr_in *from, void *pPrivData )
+{
+    MainWindow *window = (MainWindow *)pPrivData;
+    QByteArray data( (const char *)msg, len );
+    QMetaObject::invokeMethod( window, "handleMessage", Qt::QueuedConnection, Q_ARG( QByteArray, data ), Q_ARG( qint64, window->localTimeUs() ) );
+}
+#endif
+
+/*
+@   收完的一帧放进抖动缓冲; 帧时间戳在该帧之前发出, 已经由 handleMessage 记下, 没有时按到达时刻排定播放
+@
+*/
+void MainWindow::bufferFrame( const QByteArray &frame, quint16 streamId, quint32 frameId, qint64 recvUs )
+{
+#ifdef Q_OS_LINUX
+    pendingFrames.deref();
+#endif
+    pcs::FrameTiming timing;
+    qint64 senderUs = latency.findTiming( streamId, frameId, timing ) ? timing.captureUs : -1;
+    jitter.push( streamId, frameId, (const unsigned char *)frame.constData(), frame.size(), senderUs, recvUs );
+    schedulePlayout();
+}
+
+/*
+@   交出到了播放时刻的帧, 然后等到下一帧的播放时刻
+@
+*/
+void MainWindow::playoutFrames()
+{
+    jitter.poll( localTimeUs() );
+    schedulePlayout();
+}
+
+void MainWindow::schedulePlayout()
+{
+    qint64 next = jitter.nextPlayoutUs();
+    int waitMs = PLAYOUT_IDLE_MS;
+    if( next >= 0 ){
+        waitMs = (int)std::max( (qint64)0, ( next - localTimeUs() + 999 ) / 1000 );
+    }
+    playoutTimer.start( waitMs );
+}
+
+void MainWindow::onFramePlayout( const pcs::JitterFrame *pFrame, void *pPrivData )
+{
+    MainWindow *window = (MainWindow *)pPrivData;
+    window->showFrame( QByteArray::fromRawData( (const char *)pFrame->data, pFrame->size ), pFrame->streamId, pFrame->frameId, pFrame->arrivalUs );
+}
+
+/*
+@   显示收完的一帧图像, 然后把显示进度告诉设备
+@
+*/
+void MainWindow::showFrame( const QByteArray &frame, quint16 streamId, quint32 frameId, qint64 recvUs )
+{
+    QElapsedTimer showTimer;
+    showTimer.start();
+    if( getImageFromArray(frame) ){
+        ui->image_label->setPixmap(QPixmap::fromImage(this->image).scaled(ui->image_label->size()));
+        latency.onFrameShown( streamId, frameId, recvUs, localTimeUs() );
+    }
+
+    qint64 costUs = showTimer.nsecsElapsed() / 1000;
+    showCostUs = ( showCostUs == 0 ) ? costUs : ( showCostUs * 7 + costUs ) / 8;
+    lastShownFrameId = frameId;
+    frameShown = true;
+    sendBackpressure();
+}
+
+/*
+@   向设备报告显示进度: 最近显示的帧号, 界面线程积压的帧数和每帧显示耗时
+@
+*/
+void MainWindow::sendBackpressure()
+{
+    if( !frameShown ){
+        return;
+    }
+
+    pcs::BackpressureMessage msg;
+    msg.streamId = displayChannel;
+    msg.shownFrameId = lastShownFrameId;
+    int depth = pendingFrames.load() + jitter.overdueFrames( localTimeUs() );
+    msg.queueDepth = (quint16)std::min( depth, 0xffff );
+    msg.showCostUs = (quint32)showCostUs;
+
+    unsigned char buf[pcs::BACKPRESSURE_SIZE];
+    int len = pcs::encodeBackpressure( msg, buf );
+    sendToDevice( buf, len );
+}
+
+/*
+@   处理设备发来的对时应答和流描述, 其它消息(帧时间戳, 检测结果, 车道线)按通道分发; recvUs 为收到消息的本地时刻
+@
+*/
+void MainWindow::handleMessage( const QByteArray &msg, qint64 recvUs )
+{
+    const unsigned char *data = (const unsigned char *)msg.constData();
+    int type = pcs::peekMessageType( data, msg.size() );
+    if( type == pcs::MSG_TIME_RESP ){
+        pcs::TimeSyncMessage sync;
+        if( pcs::decodeTimeSync( data, msg.size(), sync ) ){
+            latency.onTimeSync( sync, recvUs );
         }
-        else {
-            memcpy( &datagram.data()[recvCount * 60000], recvBuff.data(), recvBuff.size() );
-            recvCount ++;
-            qDebug()<<"recvCount : "<<recvCount<<endl;
-
-            if( recvCount == frameSize / 60000 + 1 ){
-                recvCount = 0;
-                getImageFromArray(datagram.data());
-                ui->image_label->setPixmap(QPixmap::fromImage(this->image).scaled(ui->image_label->size()));
-            }
+    }
+    else if( type == pcs::MSG_STREAM_DESC ){
+        pcs::StreamDescriptor desc;
+        if( pcs::decodeStreamDescriptor( data, msg.size(), desc ) && desc.streamId == displayChannel ){
+            applyStreamDescriptor( desc );
         }
     }
+    else {
+        QMutexLocker locker( &demuxMutex );
+        demux.dispatch( data, msg.size() );
+    }
+}
+
+/*
+@   向设备发送对时请求, 设备的应答在 handleMessage 中处理
+@
+*/
+void MainWindow::sendTimeRequest()
+{
+    pcs::TimeSyncMessage sync;
+    sync.t1 = localTimeUs();
+    sync.t2 = 0;
+    sync.t3 = 0;
+    unsigned char buf[pcs::TIME_SYNC_SIZE];
+    int len = pcs::encodeTimeSync( pcs::MSG_TIME_REQ, sync, buf );
+    sendToDevice( buf, len );
+}
+
+/*
+@   把控制消息发回图像数据的来源地址, 还没有收到过数据时丢弃
+@
+*/
+void MainWindow::sendToDevice( const unsigned char *msg, int len )
+{
+#ifdef Q_OS_LINUX
+    if( frameReceiver != nullptr ){
+        frameReceiver->sendToPeer( msg, len );
+    }
+#else
+    if( udp_server != nullptr && client_port != 0 ){
+        udp_server->writeDatagram( (const char *)msg, len, client_address, client_port );
+    }
+#endif
+}
+
+/*
+@   按上个周期的重组统计生成接收报告发给设备, 设备据此调整显示通道的码率
+@
+*/
+void MainWindow::sendReceiverReport()
+{
+#ifdef Q_OS_LINUX
+    if( frameReceiver == nullptr ){
+        return;
+    }
+    // 取同一时刻的快照, expected/lost 与突发统计前后一致
+    pcs::ReassemblyStats stats;
+    frameReceiver->getStats( stats );
+#else
+    const pcs::ReassemblyStats &stats = reassembler.getStats();
+#endif
+
+    pcs::ReceiverReport report;
+    if( !bandwidth.update( displayChannel, stats, localTimeUs(), report ) ){
+        return;
+    }
+
+    unsigned char buf[pcs::RECV_REPORT_SIZE];
+    int len = pcs::encodeReceiverReport( report, buf );
+    sendToDevice( buf, len );
+
+    // 显示停顿时也定期报告进度, 设备不会一直按旧的积压停发
+    sendBackpressure();
+}
+
+/*
+@   广播发现/协商请求, 请求显示通道按本端能显示的格式发送; 设备的回应发到接收图像的端口, 在 handleMessage 中处理
+@
+*/
+void MainWindow::sendStreamRequest()
+{
+    if( discoverySocket == nullptr ){
+        return;
+    }
+
+    pcs::StreamRequest req;
+    memset( &req, 0, sizeof( req ) );
+    req.streamId = displayChannel;
+    req.dataPort = FRAME_DATA_PORT;
+    req.format.codec = pcs::CODEC_RAW;
+    req.format.pixelFormat = pcs::PIXEL_FORMAT_I420;
+    req.format.width = STREAM_REQ_WIDTH;
+    req.format.height = STREAM_REQ_HEIGHT;
+    req.format.fragSize = STREAM_REQ_FRAG_SIZE;
+    req.format.fecData = STREAM_REQ_FEC_DATA;
+    req.format.fecParity = STREAM_REQ_FEC_PARITY;
+    req.format.fps = STREAM_REQ_FPS;
+
+    unsigned char buf[pcs::STREAM_REQ_SIZE];
+    int len = pcs::encodeStreamRequest( req, buf );
+    discoverySocket->writeDatagram( (const char *)buf, len, QHostAddress::Broadcast, pcs::STREAM_DISCOVERY_PORT );
+}
+
+/*
+@   按设备回应的流描述设置接收图像的格式, 之后收到的帧按新的大小显示
+@
+*/
+void MainWindow::applyStreamDescriptor( const pcs::StreamDescriptor &desc )
+{
+    if( desc.format.codec != pcs::CODEC_RAW || desc.format.pixelFormat != pcs::PIXEL_FORMAT_I420 ){
+        qDebug()<<"unsupported stream codec : "<<desc.format.codec<<" pixel format : "<<desc.format.pixelFormat<<endl;
+        return;
+    }
+
+    prevImgWidth = recvImgWidth;
+    prevImgHeight = recvImgHeight;
+    setRecvImgSize( desc.format.width, desc.format.height );
+    streamNegotiated = true;
+
+    QString group = ( desc.groupAddr != 0 ) ? QHostAddress( desc.groupAddr ).toString() : QString( "unicast" );
+    ui->log->setText( "Stream " + QString::number( desc.streamId ) + " : " + QString::number( desc.format.width ) + "x"
+                      + QString::number( desc.format.height ) + " " + QString::number( desc.format.fps ) + " fps, frag "
+                      + QString::number( desc.format.fragSize ) + ", fec " + QString::number( desc.format.fecData ) + "+"
+                      + QString::number( desc.format.fecParity ) + ", " + group + ":" + QString::number( desc.dataPort ) );
+}
+
+/*
+@   打印各阶段延时的直方图统计, 然后重新开始统计
+@
+*/
+void MainWindow::printLatency()
+{
+    char text[256];
+    const pcs::ClockSync &clock = latency.getClockSync();
+    qDebug()<<"clock offset : "<<clock.getOffsetUs()<<"us rtt : "<<clock.getRttUs()<<"us"<<endl;
+    for( int i = 0; i < pcs::LATENCY_STAGE_NUM; i ++ ){
+        latency.getHistogram( i ).format( text, sizeof( text ) );
+        qDebug()<<pcs::LatencyTracker::stageName( i )<<" : "<<text<<endl;
+    }
+    latency.reset();
 }
 
 /*
@@ -187,12 +701,11 @@ void MainWindow::setRecvImgSize( int width, int height )
 }
 
 /*
-@   将接收到的图像数据数组转成jpg格式显示
+@   将接收到的图像数据数组转成jpg格式显示, 大小与协商的格式不符时返回 false
 @
 */
-void MainWindow::getImageFromArray( const QString &data )
+bool MainWindow::getImageFromArray( const QByteArray &imageData )
 {
-    QByteArray imageData = QByteArray::fromBase64(data.toLatin1());
     qDebug()<<"imageData.size = "<<imageData.size()<<endl;
 
     qDebug()<<"image data: "<<endl;
@@ -200,16 +713,33 @@ void MainWindow::getImageFromArray( const QString &data )
     //    qDebug()<<"imageData()["<<i<<"] = " <<imageData.data()[i]<<endl;
     //}
 
+    // 格式切换期间, 还会收到几帧上一个格式的图像
+    int width = recvImgWidth;
+    int height = recvImgHeight;
+    if( (quint32)imageData.size() != pcs::rawFrameSize( pcs::PIXEL_FORMAT_I420, width, height ) ){
+        width = prevImgWidth;
+        height = prevImgHeight;
+    }
+    if( (quint32)imageData.size() != pcs::rawFrameSize( pcs::PIXEL_FORMAT_I420, width, height ) ){
+        qDebug()<<"skip frame of size "<<imageData.size()<<", expect "<<recvImgWidth<<"x"<<recvImgHeight<<endl;
+        return false;
+    }
+
     cv::Mat src_yuv;
     //src_yuv.create( recvImgHeight, recvImgWidth, CV_8UC3); // height, width
-    src_yuv.create( 720 * 3 / 2, 1280, CV_8UC1); // height, width
-    memcpy(src_yuv.data, imageData.data(), imageData.size() );
+    src_yuv.create( height * 3 / 2, width, CV_8UC1); // height, width
+    memcpy(src_yuv.data, imageData.constData(), src_yuv.total() );
 
     cv::Mat src_jpg;
     //cv::cvtColor(src_yuv, src_jpg, cv::COLOR_YUV2BGR);
     cv::cvtColor(src_yuv, src_jpg, cv::COLOR_YUV2BGR_I420);
     //cv::imshow("test", src_jpg);
 
+    // 设备按协商缩小了图像, 放大回检测结果坐标所在的大小再画结果
+    if( src_jpg.cols != DETECT_IMG_WIDTH || src_jpg.rows != DETECT_IMG_HEIGHT ){
+        cv::resize( src_jpg, src_jpg, cv::Size( DETECT_IMG_WIDTH, DETECT_IMG_HEIGHT ) );
+    }
+
     // -------------- 在检测上的图像上画出检测结果 -------------- //
     // 1. 画检测框
     if( !objectRects.empty() ){
@@ -254,28 +784,69 @@ void MainWindow::getImageFromArray( const QString &data )
     // Create QImage with same dimensions as input Mat
     QImage image1(pSrc, src_jpg.cols, src_jpg.rows, src_jpg.step, QImage::Format_RGB888);
     this->image = image1.rgbSwapped();
+    return true;
 }
 
 
 // 点击开始按钮
 void MainWindow::on_pushButton_clicked()
 {
-    // 1. 点击开始按钮之后初始化 Udp Server
+    // 1. 点击开始按钮之后初始化 Udp Server, 图像和检测结果都从这里收
     this->udpInit();
 
-    // 2. 初始化接收 图片检测结果的 UDP Server
-    this->resultsUDPInit();
+    // 2. 设备也可以选择 TCP 传输图像
+    this->tcpInit();
+
+    // 3. 广播发现/协商请求, 没有收到回应时每秒重发
+    if( discoverySocket == nullptr ){
+        discoverySocket = new QUdpSocket(this);
+    }
+    streamNegotiated = false;
+    sendStreamRequest();
+
+    // 4. 定时向设备报告接收情况
+    bandwidth.reset();
+    reportTimer.start();
+
+    statsTimer.start();
 }
 
 // 点击停止按钮
 void MainWindow::on_pushButton_2_clicked()
 {
+    statsTimer.stop();
+    playoutTimer.stop();
+    jitter.reset();
+    streamNegotiated = false;
+    reportTimer.stop();
+    frameShown = false;
+    showCostUs = 0;
+
     // 关闭 Udp Server
-    udp_server->close();
+#ifdef Q_OS_LINUX
+    delete frameReceiver;
+    frameReceiver = nullptr;
+#else
+    reassemblyTimer.stop();
+    if( udp_server != nullptr ){
+        udp_server->close();
+        udp_server->deleteLater();
+        udp_server = nullptr;
+    }
+#endif
 
-    udp_server2->close();
+    if( tcp_client != nullptr ){
+        tcp_client->close();
+        tcp_client->deleteLater();
+        tcp_client = nullptr;
+    }
+    if( tcp_server != nullptr ){
+        tcp_server->close();
+        tcp_server->deleteLater();
+        tcp_server = nullptr;
+    }
 
     ui->connection_status->setText("DisConnected");
 
-    ui->log->setText("DisConnected from the UDP Client ...\r\nUDP Results Receiver Closed ...");
+    ui->log->setText("DisConnected from the UDP Client ...");
 }
@@ -4,6 +4,8 @@
 #include <QMainWindow>
 
 #include <QUdpSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
 #include <QImage>
 
 #include <QNetworkInterface>
@@ -17,6 +19,38 @@
 
 #include "dataType.h"
 
+#include "frame_protocol.h"
+#include "frame_reassembler.h"
+#include "latency_stats.h"
+#include "result_codec.h"
+#include "stream_demux.h"
+#include "jitter_buffer.h"
+#include "bandwidth_estimator.h"
+
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QAtomicInt>
+#include <QMutex>
+
+#ifdef Q_OS_LINUX
+#include "frame_receiver.h"
+#endif
+
+#define FRAME_MULTICAST_GROUP "239.255.22.69"  // 与设备端 testcase.cpp 中的图像组播组一致
+#define PLAYOUT_MIN_DELAY_MS 40    // 抖动缓冲播放延时的下限, 与上限相同时为固定延时
+#define PLAYOUT_MAX_DELAY_MS 200   // 抖动缓冲播放延时的上限, 也是缓冲带来的额外延时的上界
+#define PLAYOUT_IDLE_MS 20         // 缓冲为空时检查欠载的周期
+#define FRAME_DATA_PORT 2333       // 接收图像和检测结果的端口
+#define DETECT_IMG_WIDTH 1280      // 检测结果坐标所在的图像大小, 即设备的源图像大小
+#define DETECT_IMG_HEIGHT 720
+// 向设备请求的格式, 0 表示不限制, 由设备选择; 设备回应实际采用的格式
+#define STREAM_REQ_WIDTH 1280      // 能显示的最大分辨率
+#define STREAM_REQ_HEIGHT 720
+#define STREAM_REQ_FRAG_SIZE 0     // 分片长度上限, 0 表示按路径 MTU
+#define STREAM_REQ_FEC_DATA 0      // 前向纠错每组数据分片数, 0 表示用设备的默认值
+#define STREAM_REQ_FEC_PARITY 0    // 前向纠错每组校验分片数
+#define STREAM_REQ_FPS 0           // 帧率上限
+
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
@@ -32,46 +66,133 @@ public:
     // init the udp server
     bool udpInit();
 
-    bool resultsUDPInit();
+    // 设备选择 TCP 传输时, 在同一端口上接收长度前缀的分片
+    bool tcpInit();
 
     bool resultsUpdInit();
 
-    void getImageFromArray( const QString &data );
+    bool getImageFromArray( const QByteArray &data );
 
     void setRecvImgSize( int width, int height );
 
 private slots:
     void udpServerReceiveData();
-    void udpReceiveResults();
+
+    void tcpNewConnection();
+    void tcpReceiveData();
+
+    void bufferFrame( const QByteArray &frame, quint16 streamId, quint32 frameId, qint64 recvUs );
+
+    void playoutFrames();
+
+    void showFrame( const QByteArray &frame, quint16 streamId, quint32 frameId, qint64 recvUs );
+
+    void handleMessage( const QByteArray &msg, qint64 recvUs );
+
+    void checkReassembler();
+
+    void showTransportStats();
+
+    void sendReceiverReport();
 
     void on_pushButton_clicked();
 
     void on_pushButton_2_clicked();
 
 private:
-    QUdpSocket *udp_server;
-    QUdpSocket *udp_server2;
+    QUdpSocket *udp_server = nullptr;
+
+    QTcpServer *tcp_server = nullptr;
+    QTcpSocket *tcp_client = nullptr;
+    QByteArray tcpBuffer;
+
+#ifdef Q_OS_LINUX
+    // Linux 下用 recvmmsg 接收线程代替 udp_server
+    pcs::FrameReceiver *frameReceiver = nullptr;
+    static void onFrameReceived( const pcs::ReceivedFrame *pFrame, void *pPrivData );
+    static void onMessageReceived( const unsigned char *msg, int len, const struct sockaddr_in *from, void *pPrivData );
+#endif
 
     QHostAddress client_address;
     quint16 client_port = 0;
 
-    QHostAddress client_address2;
-    quint16 client_port2 = 0;
-
 
     // --------- 接收检测图片的相关参数 ------ //
-    QByteArray datagram;
-    int frameSize = 0;
-    int recvCount = 0;
+    pcs::FrameReassembler reassembler;
+    QElapsedTimer recvClock;
+    static void onFrameReassembled( const pcs::ReceivedFrame *pFrame, void *pPrivData );
+
+    // 所有通道的图像和检测结果都从 2333 端口收上来, 按通道号和类型分发, 只显示 displayChannel
+    pcs::StreamDemux demux;
+    // Linux 下图像在接收线程中分发, 消息和统计在界面线程中, demux 的调用都要持这个锁
+    QMutex demuxMutex;
+    quint16 displayChannel = pcs::CHANNEL_ADAS;
+    static void onFrameDemux( const pcs::ReceivedFrame *pFrame, void *pPrivData );
+    static void onFrameTimingMessage( const unsigned char *msg, int len, void *pPrivData );
+    static void onObjectResult( const unsigned char *msg, int len, void *pPrivData );
+    static void onLanePoints( const unsigned char *msg, int len, void *pPrivData );
+
+    // 收全的帧先进抖动缓冲, 按设备的采集时刻加播放延时到点显示, 网络抖动不再直接变成卡顿
+    pcs::JitterBuffer jitter;
+    QTimer playoutTimer;
+    void schedulePlayout();
+    static void onFramePlayout( const pcs::JitterFrame *pFrame, void *pPrivData );
+
+    // 定时检查缺失的分片并向设备请求重传
+    QTimer reassemblyTimer;
+
+    // 定时在状态栏显示收包统计, 区分丢在网络, 内核接收队列还是重组
+    QTimer statsTimer;
+    quint32 recvDatagrams = 0;
+    quint64 recvTotalBytes = 0;
+
+    // --------- 端到端延时统计 ------ //
+    // 每秒向设备对时一次, 每帧显示完成后按设备发来的时间戳记入各阶段的直方图
+    pcs::LatencyTracker latency;
+    int statsTicks = 0;
+    qint64 localTimeUs() const
+    {
+        return recvClock.nsecsElapsed() / 1000;
+    }
+    void sendTimeRequest();
+    void sendToDevice( const unsigned char *msg, int len );
+    void printLatency();
+    static void onNackRequest( uint16_t streamId, uint32_t frameId, const uint16_t *indices, int count, void *pPrivData );
 
     QImage image;
 
     int recvImgHeight = 720;
     int recvImgWidth = 1280;
+    // 设备切换格式时, 已经在路上和抖动缓冲中的帧还是上一个格式
+    int prevImgHeight = 720;
+    int prevImgWidth = 1280;
+
+    // --------- 码率自适应 ------ //
+    // 定时把接收码率, 链路容量和丢包率报告给设备, 设备据此降低或恢复分辨率和帧率
+    pcs::BandwidthEstimator bandwidth;
+    QTimer reportTimer;
+
+    // --------- 反压 ------ //
+    // 每显示一帧把显示进度, 积压的帧数和显示耗时发给设备, 显示跟不上时设备跳过来不及显示的帧
+    QAtomicInt pendingFrames;   // 接收线程已交出, 界面线程还没放进抖动缓冲的帧数
+    qint64 showCostUs = 0;      // 平滑后的每帧显示耗时
+    quint32 lastShownFrameId = 0;
+    bool frameShown = false;
+    void sendBackpressure();
+
+    // --------- 发现设备并协商格式 ------ //
+    // 广播 MSG_STREAM_REQ 到设备的发现端口, 直到收到设备回应的 MSG_STREAM_DESC, 按它设置接收图像的大小
+    QUdpSocket *discoverySocket = nullptr;
+    bool streamNegotiated = false;
+    void sendStreamRequest();
+    void applyStreamDescriptor( const pcs::StreamDescriptor &desc );
 
     // ---------- 检测结果相关参数 ---------- //
+    void showObjectResult( const pcs::ObjectResultView &objectsResults );
+    void showLanePoints();
     std::vector<cv::Rect> objectRects;
     std::vector<std::vector<cv::Point2f>> linePoints;
+    pcs::LanePoints lanePoints; // 车道线解码缓存, 约 19KB, 不放在栈上
 
     std::vector<cv::Point> objectsTypesPoses;
     std::vector<ObjectDetectType> objectsTypes;;
@@ -19,12 +19,40 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
     main.cpp \
     mainwindow.cpp \
-    mypainter.cpp
+    mypainter.cpp \
+    ../../yuv_transport_test/frame_reassembler.cpp \
+    ../../yuv_transport_test/fec.cpp \
+    ../../yuv_transport_test/latency_stats.cpp \
+    ../../yuv_transport_test/stream_demux.cpp \
+    ../../yuv_transport_test/jitter_buffer.cpp \
+    ../../yuv_transport_test/bandwidth_estimator.cpp
 
 HEADERS += \
     dataType.h \
     mainwindow.h \
-    mypainter.h
+    mypainter.h \
+    ../../yuv_transport_test/frame_protocol.h \
+    ../../yuv_transport_test/frame_reassembler.h \
+    ../../yuv_transport_test/fec.h \
+    ../../yuv_transport_test/latency_stats.h \
+    ../../yuv_transport_test/result_codec.h \
+    ../../yuv_transport_test/stream_demux.h \
+    ../../yuv_transport_test/jitter_buffer.h \
+    ../../yuv_transport_test/bandwidth_estimator.h
+
+INCLUDEPATH += $$PWD/../../yuv_transport_test
+
+# Linux 下使用 recvmmsg 批量接收引擎
+linux {
+    SOURCES += ../../yuv_transport_test/frame_receiver.cpp \
+        ../../yuv_transport_test/event_loop.cpp \
+        ../../yuv_transport_test/io_uring_recv.cpp \
+        ../../yuv_transport_test/socket_stats.cpp
+    HEADERS += ../../yuv_transport_test/frame_receiver.h \
+        ../../yuv_transport_test/event_loop.h \
+        ../../yuv_transport_test/io_uring_recv.h \
+        ../../yuv_transport_test/socket_stats.h
+}
 
 
 FORMS += \
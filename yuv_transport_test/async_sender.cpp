@@ -0,0 +1,132 @@
+#include "async_sender.h"
+
+#include <time.h>
+
+namespace pcs{
+
+AsyncSender::AsyncSender( Transport *transport, RetransmitRing *ring, int queueDepth ) : transport(transport),
+											ring(ring),
+											queue(queueDepth),
+											running(false)
+{
+	memset( &stats, 0, sizeof( stats ) );
+	pthread_mutex_init( &mutex, NULL );
+}
+
+AsyncSender::~AsyncSender()
+{
+	stop();
+	pthread_mutex_destroy( &mutex );
+}
+
+int64_t AsyncSender::nowUs()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool AsyncSender::start()
+{
+	if( running ){
+		return true;
+	}
+
+	running = true;
+	queue.open();
+	if( pthread_create( &threadId, NULL, sendThread, this ) != 0 ){
+		std::cerr<<"pthread_create sendThread error ..."<<std::endl;
+		running = false;
+		return false;
+	}
+	return true;
+}
+
+void AsyncSender::stop()
+{
+	pthread_mutex_lock( &mutex );
+	if( !running ){
+		pthread_mutex_unlock( &mutex );
+		return;
+	}
+	running = false;
+	pthread_mutex_unlock( &mutex );
+
+	queue.close();
+	pthread_join( threadId, NULL );
+}
+
+void AsyncSender::submit( const FragmentHeader &header, const unsigned char *frame, int size, const struct sockaddr_in &destAddr,
+			const FrameTiming *timing, int maxFragSize )
+{
+	FrameItem *item = queue.acquire( header.streamId );
+	if( item == NULL ){
+		return;
+	}
+
+	// 该帧槽此时只属于当前线程, 拷贝不需要持锁
+	item->header = header;
+	item->destAddr = destAddr;
+	item->data.assign( frame, frame + size );
+	item->hasTiming = ( timing != NULL );
+	item->maxFragSize = maxFragSize;
+	if( timing != NULL ){
+		item->timing = *timing;
+	}
+
+	queue.push( item, header.streamId );
+}
+
+void* AsyncSender::sendThread( void *pArg )
+{
+	AsyncSender *sender = (AsyncSender *)pArg;
+	while( true ){
+		FrameItem *item = sender->queue.pop();
+		if( item == NULL ){
+			break;
+		}
+
+		// 分片长度跟随路径 MTU, 每个分片正好装进一个以太网帧
+		Transport *transport = sender->transport;
+		if( item->hasTiming ){
+			unsigned char timingBuf[FRAME_TIMING_SIZE];
+			item->timing.sendUs = nowUs();
+			int len = encodeFrameTiming( item->timing, timingBuf );
+			transport->write( transport->getClientFd(), timingBuf, len, item->destAddr );
+		}
+
+		int size = item->data.size();
+		int fragSize = transport->getFragmentSize( item->destAddr );
+		if( item->maxFragSize > 0 && fragSize > item->maxFragSize ){
+			fragSize = item->maxFragSize;
+		}
+		transport->writeFrame( transport->getClientFd(), &item->data[0], size, fragSize, item->header, item->destAddr );
+		if( sender->ring != NULL ){
+			// 帧缓存交给重传环, 换回的旧缓存留给下一次 submit 复用容量
+			sender->ring->store( item->header, item->data, fragSize, nowUs() / 1000 );
+		}
+
+		pthread_mutex_lock( &sender->mutex );
+		sender->stats.sent ++;
+		if( item->header.streamId < MAX_STREAM_CHANNELS ){
+			sender->stats.sentBytes[item->header.streamId] += size;
+		}
+		pthread_mutex_unlock( &sender->mutex );
+		sender->queue.release( item );
+	}
+	return NULL;
+}
+
+AsyncSenderStats AsyncSender::getStats()
+{
+	FrameQueueStats queueStats = queue.getStats();
+	pthread_mutex_lock( &mutex );
+	AsyncSenderStats ret = stats;
+	pthread_mutex_unlock( &mutex );
+	ret.enqueued = queueStats.enqueued;
+	ret.dropped = queueStats.dropped;
+	ret.queued = queueStats.queued;
+	return ret;
+}
+
+}
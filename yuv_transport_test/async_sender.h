@@ -0,0 +1,74 @@
+#ifndef __ASYNC_SENDER_H_
+#define __ASYNC_SENDER_H_
+
+#include <vector>
+#include <pthread.h>
+
+#include "transport.h"
+#include "retransmit_ring.h"
+#include "frame_queue.h"
+
+#define ASYNC_SEND_QUEUE_DEPTH 2  // 每个发送器最多排队的帧数, 超出时丢弃最旧的帧
+
+namespace pcs{
+
+struct AsyncSenderStats
+{
+	uint32_t enqueued;	// 提交的帧数
+	uint32_t sent;		// 发送完成的帧数
+	uint32_t dropped;	// 排队期间被更新的帧挤掉, 或帧槽都被占用而未入队的帧数
+	uint32_t queued;	// 当前排队的帧数
+	uint64_t sentBytes[MAX_STREAM_CHANNELS];	// 各通道发送完成的图像字节数, 不含分片头和校验分片
+};
+
+/*
+ * 异步发送线程: 检测线程只把帧拷贝进有界队列就返回, 由发送线程调用 Transport::writeFrame.
+ * 队列 (FrameQueue) 满时丢弃同一通道中最旧的排队帧 (新帧优先), 网络变慢只会丢帧, 不会拖慢检测.
+ * 发送后帧缓存与重传环交换, 每帧只在入队时拷贝一次.
+ */
+class AsyncSender
+{
+public:
+	// ring 不为 NULL 时, 每帧发送后存入重传环
+	AsyncSender( Transport *transport, RetransmitRing *ring = NULL, int queueDepth = ASYNC_SEND_QUEUE_DEPTH );
+	~AsyncSender();
+
+	bool start();
+	void stop();
+
+	// 拷贝一帧进入发送队列, 分片长度由发送线程按目的地址的路径 MTU 决定, maxFragSize 大于 0 时不超过它;
+	// timing 不为 NULL 时, 发送线程填入开始发送的时刻, 在该帧之前发出 MSG_FRAME_TIMING
+	void submit( const FragmentHeader &header, const unsigned char *frame, int size, const struct sockaddr_in &destAddr,
+			const FrameTiming *timing = NULL, int maxFragSize = 0 );
+
+	AsyncSenderStats getStats();
+
+private:
+	struct FrameItem
+	{
+		FragmentHeader header;
+		struct sockaddr_in destAddr;
+		std::vector<unsigned char> data;
+		FrameTiming timing;
+		bool hasTiming;
+		int maxFragSize;
+	};
+
+	static void* sendThread( void *pArg );
+	static int64_t nowUs();
+
+	Transport *transport;
+	RetransmitRing *ring;
+
+	FrameQueue<FrameItem> queue;
+
+	AsyncSenderStats stats;		// 只用发送线程更新的 sent 和 sentBytes, 其余取自 queue
+
+	pthread_mutex_t mutex;		// 保护 stats 和 running
+	pthread_t threadId;
+	bool running;
+};
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+#include "bandwidth_estimator.h"
+
+namespace pcs{
+
+BandwidthEstimator::BandwidthEstimator()
+{
+	reset();
+}
+
+void BandwidthEstimator::reset()
+{
+	memset( &last, 0, sizeof( last ) );
+	lastUs = 0;
+	valid = false;
+	seq = 0;
+	capacityKbps = 0;
+}
+
+static uint16_t clampU16( uint32_t v )
+{
+	return ( v > 0xffff ) ? 0xffff : (uint16_t)v;
+}
+
+bool BandwidthEstimator::update( uint16_t streamId, const ReassemblyStats &stats, int64_t nowUs, ReceiverReport &report )
+{
+	if( !valid || nowUs <= lastUs ){
+		last = stats;
+		lastUs = nowUs;
+		valid = true;
+		return false;
+	}
+
+	int64_t intervalUs = nowUs - lastUs;
+	uint64_t bytes = stats.receivedBytes - last.receivedBytes;
+	uint32_t expected = stats.expected - last.expected;
+	uint32_t lost = stats.lost - last.lost;
+	uint64_t burstBytes = stats.burstBytes - last.burstBytes;
+	uint64_t burstMs = stats.burstMs - last.burstMs;
+
+	// 字节数 * 8 / 毫秒 即 kbps
+	if( burstMs > 0 ){
+		uint32_t sample = (uint32_t)( burstBytes * 8 / burstMs );
+		capacityKbps = ( capacityKbps == 0 ) ? sample : capacityKbps + ( (int64_t)sample - capacityKbps ) / BWE_CAPACITY_WEIGHT;
+	}
+
+	report.streamId = streamId;
+	report.seq = seq ++;
+	report.intervalMs = (uint32_t)( ( intervalUs + 500 ) / 1000 );
+	report.recvKbps = (uint32_t)( bytes * 8 * 1000 / intervalUs );
+	report.capacityKbps = ( burstMs > 0 ) ? capacityKbps : 0;
+	report.lossFraction = ( expected > 0 ) ? (uint16_t)( (uint64_t)lost * 65535 / expected ) : 0;
+	report.framesCompleted = clampU16( stats.completed - last.completed );
+	report.framesDropped = clampU16( stats.dropped - last.dropped );
+
+	last = stats;
+	lastUs = nowUs;
+	return report.intervalMs > 0;
+}
+
+}
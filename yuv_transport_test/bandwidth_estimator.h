@@ -0,0 +1,44 @@
+#ifndef __BANDWIDTH_ESTIMATOR_H_
+#define __BANDWIDTH_ESTIMATOR_H_
+
+#include "frame_protocol.h"
+#include "frame_reassembler.h"
+
+#define BWE_REPORT_INTERVAL_MS	500	// 接收报告的周期, 低帧率时每个周期内也有帧到达
+#define BWE_CAPACITY_WEIGHT	4	// 链路容量按 1/4 的权重平滑
+
+namespace pcs{
+
+/*
+ * 接收端带宽估计: 周期性地对重组统计取差值, 生成发回设备的接收报告.
+ * 链路容量由每帧分片的到达间隔估计 (一帧的分片是连续发出的, 到达间隔由瓶颈链路决定),
+ * 设备降低码率后也能测到完整的链路容量; 丢包率只统计首次发送就丢失的数据分片, 不受前向纠错和重传的影响.
+ * 与平台无关, 不加锁, 时间为本地单调时钟的微秒.
+ */
+class BandwidthEstimator
+{
+public:
+	BandwidthEstimator();
+
+	// 按上次调用以来的统计增量生成接收报告, 第一次调用只记下基准并返回 false
+	bool update( uint16_t streamId, const ReassemblyStats &stats, int64_t nowUs, ReceiverReport &report );
+
+	// 平滑后的链路容量, 还没有样本时为 0
+	uint32_t getCapacityKbps() const
+	{
+		return capacityKbps;
+	}
+
+	void reset();
+
+private:
+	ReassemblyStats last;
+	int64_t lastUs;
+	bool valid;
+	uint32_t seq;
+	uint32_t capacityKbps;
+};
+
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "event_loop.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+namespace pcs{
+
+EventLoop::EventLoop() : epollFd(-1),
+			wakeFd(-1),
+			running(false)
+{
+
+}
+
+EventLoop::~EventLoop()
+{
+	for( std::map<int, Handler>::iterator it = handlers.begin(); it != handlers.end(); ++ it ){
+		if( it->second.isTimer ){
+			close( it->first );
+		}
+	}
+	if( wakeFd >= 0 ){
+		close( wakeFd );
+	}
+	if( epollFd >= 0 ){
+		close( epollFd );
+	}
+}
+
+bool EventLoop::init()
+{
+	epollFd = epoll_create1( EPOLL_CLOEXEC );
+	if( epollFd < 0 ){
+		std::cerr<<"epoll_create failed ..."<<std::endl;
+		return false;
+	}
+
+	// stop 通过 eventfd 唤醒 epoll_wait
+	wakeFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if( wakeFd < 0 ){
+		std::cerr<<"eventfd failed ..."<<std::endl;
+		return false;
+	}
+
+	struct epoll_event ev;
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = EPOLLIN;
+	ev.data.fd = wakeFd;
+	return epoll_ctl( epollFd, EPOLL_CTL_ADD, wakeFd, &ev ) == 0;
+}
+
+bool EventLoop::addFd( int fd, uint32_t events, EventFunc pFunc, void *pPrivData )
+{
+	struct epoll_event ev;
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = events;
+	ev.data.fd = fd;
+	if( epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &ev ) < 0 ){
+		std::cerr<<"epoll add fd "<<fd<<" failed ..."<<std::endl;
+		return false;
+	}
+
+	Handler &handler = handlers[fd];
+	handler.isTimer = false;
+	handler.eventFunc = pFunc;
+	handler.timerFunc = NULL;
+	handler.pPrivData = pPrivData;
+	return true;
+}
+
+bool EventLoop::modifyFd( int fd, uint32_t events )
+{
+	struct epoll_event ev;
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = events;
+	ev.data.fd = fd;
+	return epoll_ctl( epollFd, EPOLL_CTL_MOD, fd, &ev ) == 0;
+}
+
+bool EventLoop::removeFd( int fd )
+{
+	if( handlers.erase( fd ) == 0 ){
+		return false;
+	}
+	epoll_ctl( epollFd, EPOLL_CTL_DEL, fd, NULL );
+	return true;
+}
+
+int EventLoop::addTimer( int intervalMs, TimerFunc pFunc, void *pPrivData )
+{
+	int fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+	if( fd < 0 ){
+		std::cerr<<"timerfd_create failed ..."<<std::endl;
+		return -1;
+	}
+
+	struct itimerspec spec;
+	spec.it_interval.tv_sec = intervalMs / 1000;
+	spec.it_interval.tv_nsec = ( intervalMs % 1000 ) * 1000000;
+	spec.it_value = spec.it_interval;
+	if( timerfd_settime( fd, 0, &spec, NULL ) < 0 || !addFd( fd, EPOLLIN, NULL, pPrivData ) ){
+		close( fd );
+		return -1;
+	}
+
+	Handler &handler = handlers[fd];
+	handler.isTimer = true;
+	handler.timerFunc = pFunc;
+	return fd;
+}
+
+bool EventLoop::removeTimer( int timerId )
+{
+	std::map<int, Handler>::iterator it = handlers.find( timerId );
+	if( it == handlers.end() || !it->second.isTimer ){
+		return false;
+	}
+	removeFd( timerId );
+	close( timerId );
+	return true;
+}
+
+int EventLoop::runOnce( int timeoutMs )
+{
+	struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+	int count = epoll_wait( epollFd, events, EVENT_LOOP_MAX_EVENTS, timeoutMs );
+	if( count < 0 ){
+		if( errno != EINTR ){
+			std::cerr<<"epoll_wait failed ..."<<std::endl;
+		}
+		return 0;
+	}
+
+	int dispatched = 0;
+	for( int i = 0; i < count; i ++ ){
+		int fd = events[i].data.fd;
+		if( fd == wakeFd ){
+			uint64_t value;
+			while( read( wakeFd, &value, sizeof( value ) ) > 0 );
+			continue;
+		}
+
+		std::map<int, Handler>::iterator it = handlers.find( fd );
+		if( it == handlers.end() ){
+			continue;
+		}
+
+		// 处理函数可能删除自己, 先拷贝一份
+		Handler handler = it->second;
+		if( handler.isTimer ){
+			uint64_t expirations;
+			if( read( fd, &expirations, sizeof( expirations ) ) > 0 && handler.timerFunc != NULL ){
+				handler.timerFunc( fd, handler.pPrivData );
+			}
+		}
+		else if( handler.eventFunc != NULL ){
+			handler.eventFunc( fd, events[i].events, handler.pPrivData );
+		}
+		dispatched ++;
+	}
+	return dispatched;
+}
+
+void EventLoop::run()
+{
+	running = true;
+	while( running ){
+		runOnce( -1 );
+	}
+}
+
+void EventLoop::stop()
+{
+	running = false;
+	uint64_t value = 1;
+	if( wakeFd >= 0 && write( wakeFd, &value, sizeof( value ) ) < 0 ){
+		std::cerr<<"wake event loop failed ..."<<std::endl;
+	}
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef __EVENT_LOOP_H_
+#define __EVENT_LOOP_H_
+
+#include <iostream>
+#include <map>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define EVENT_LOOP_MAX_EVENTS 64  // 每次 epoll_wait 最多取出的事件数
+
+namespace pcs{
+
+typedef void (*EventFunc)( int fd, uint32_t events, void *pPrivData );
+typedef void (*TimerFunc)( int timerId, void *pPrivData );
+
+/*
+ * 基于 epoll 的单线程事件循环: 一个线程管理任意多个 socket (各路相机的图像/结果端口, 控制通道)
+ * 和周期定时器 (timerfd), 事件就绪时调用注册的处理函数.
+ * 除 stop 外的接口都应在运行 run 的线程中调用 (或在 run 之前).
+ */
+class EventLoop
+{
+public:
+	EventLoop();
+	~EventLoop();
+
+	bool init();
+
+	// events 为 EPOLLIN / EPOLLOUT 等, 默认水平触发
+	bool addFd( int fd, uint32_t events, EventFunc pFunc, void *pPrivData );
+	bool modifyFd( int fd, uint32_t events );
+	bool removeFd( int fd );
+
+	// 周期定时器, 返回定时器 id, 失败返回 -1
+	int addTimer( int intervalMs, TimerFunc pFunc, void *pPrivData );
+	bool removeTimer( int timerId );
+
+	// 等待最多 timeoutMs 毫秒并分发就绪的事件, 返回分发的事件数
+	int runOnce( int timeoutMs );
+
+	// 循环分发直到 stop
+	void run();
+
+	// 可以在任意线程中调用
+	void stop();
+
+private:
+	struct Handler
+	{
+		bool isTimer;
+		EventFunc eventFunc;
+		TimerFunc timerFunc;
+		void *pPrivData;
+	};
+
+	int epollFd;
+	int wakeFd;
+	volatile bool running;
+
+	// 按 fd 查找处理函数, 处理函数中删除其它 fd 后, 同一批中该 fd 的事件会被跳过
+	std::map<int, Handler> handlers;
+};
+
+}
+
+#endif
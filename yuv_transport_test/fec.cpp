@@ -0,0 +1,219 @@
+#include "fec.h"
+
+#include <string.h>
+
+namespace pcs{
+
+bool FecCodec::tablesReady = false;
+unsigned char FecCodec::expTable[512];
+unsigned char FecCodec::logTable[256];
+unsigned char FecCodec::mulTable[256][256];
+
+FecCodec::FecCodec() : k(0),
+			m(0)
+{
+
+}
+
+void FecCodec::initTables()
+{
+	if( tablesReady ){
+		return;
+	}
+
+	// 本原多项式 x^8 + x^4 + x^3 + x^2 + 1
+	int x = 1;
+	for( int i = 0; i < 255; i ++ ){
+		expTable[i] = x;
+		logTable[x] = i;
+		x <<= 1;
+		if( x & 0x100 ){
+			x ^= 0x11d;
+		}
+	}
+	for( int i = 255; i < 512; i ++ ){
+		expTable[i] = expTable[i - 255];
+	}
+	logTable[0] = 0;
+
+	for( int a = 0; a < 256; a ++ ){
+		for( int b = 0; b < 256; b ++ ){
+			mulTable[a][b] = ( a == 0 || b == 0 ) ? 0 : expTable[logTable[a] + logTable[b]];
+		}
+	}
+
+	tablesReady = true;
+}
+
+unsigned char FecCodec::mul( unsigned char a, unsigned char b )
+{
+	return mulTable[a][b];
+}
+
+unsigned char FecCodec::inv( unsigned char a )
+{
+	return expTable[255 - logTable[a]];
+}
+
+void FecCodec::mulAdd( unsigned char *dst, const unsigned char *src, unsigned char coef, int len )
+{
+	if( coef == 0 ){
+		return;
+	}
+	if( coef == 1 ){
+		for( int i = 0; i < len; i ++ ){
+			dst[i] ^= src[i];
+		}
+		return;
+	}
+
+	const unsigned char *row = mulTable[coef];
+	for( int i = 0; i < len; i ++ ){
+		dst[i] ^= row[src[i]];
+	}
+}
+
+bool FecCodec::init( int dataNum, int parityNum )
+{
+	if( dataNum <= 0 || parityNum <= 0 || dataNum + parityNum > FEC_MAX_BLOCKS ){
+		return false;
+	}
+
+	initTables();
+
+	k = dataNum;
+	m = parityNum;
+
+	// Cauchy 矩阵 c[j][i] = 1 / ( x_j + y_i ), x_j = j, y_i = m + i.
+	// 再把每一列除以第一行的系数, 使第一行全为 1, 任意方子阵仍然可逆
+	coefs.resize( m * k );
+	for( int j = 0; j < m; j ++ ){
+		for( int i = 0; i < k; i ++ ){
+			coefs[j * k + i] = inv( j ^ ( m + i ) );
+		}
+	}
+	for( int i = 0; i < k; i ++ ){
+		unsigned char scale = inv( coefs[i] );
+		for( int j = 0; j < m; j ++ ){
+			coefs[j * k + i] = mul( coefs[j * k + i], scale );
+		}
+	}
+
+	return true;
+}
+
+void FecCodec::encode( const unsigned char * const *data, unsigned char * const *parity, int len ) const
+{
+	for( int j = 0; j < m; j ++ ){
+		memset( parity[j], 0, len );
+		for( int i = 0; i < k; i ++ ){
+			mulAdd( parity[j], data[i], coefs[j * k + i], len );
+		}
+	}
+}
+
+bool FecCodec::invertMatrix( std::vector<unsigned char> &matrix, int n )
+{
+	// 在 [matrix | I] 上做高斯-约当消元
+	std::vector<unsigned char> work( n * 2 * n, 0 );
+	for( int r = 0; r < n; r ++ ){
+		memcpy( &work[r * 2 * n], &matrix[r * n], n );
+		work[r * 2 * n + n + r] = 1;
+	}
+
+	for( int c = 0; c < n; c ++ ){
+		int pivot = c;
+		while( pivot < n && work[pivot * 2 * n + c] == 0 ){
+			pivot ++;
+		}
+		if( pivot == n ){
+			return false;
+		}
+		if( pivot != c ){
+			for( int i = 0; i < 2 * n; i ++ ){
+				unsigned char t = work[c * 2 * n + i];
+				work[c * 2 * n + i] = work[pivot * 2 * n + i];
+				work[pivot * 2 * n + i] = t;
+			}
+		}
+
+		unsigned char scale = inv( work[c * 2 * n + c] );
+		for( int i = 0; i < 2 * n; i ++ ){
+			work[c * 2 * n + i] = mul( work[c * 2 * n + i], scale );
+		}
+
+		for( int r = 0; r < n; r ++ ){
+			unsigned char factor = work[r * 2 * n + c];
+			if( r == c || factor == 0 ){
+				continue;
+			}
+			for( int i = 0; i < 2 * n; i ++ ){
+				work[r * 2 * n + i] ^= mul( factor, work[c * 2 * n + i] );
+			}
+		}
+	}
+
+	for( int r = 0; r < n; r ++ ){
+		memcpy( &matrix[r * n], &work[r * 2 * n + n], n );
+	}
+	return true;
+}
+
+bool FecCodec::decode( unsigned char * const *blocks, const bool *present, int len )
+{
+	std::vector<int> missing;
+	for( int i = 0; i < k; i ++ ){
+		if( !present[i] ){
+			missing.push_back( i );
+		}
+	}
+	int e = missing.size();
+	if( e == 0 ){
+		return true;
+	}
+
+	std::vector<int> rows;
+	for( int j = 0; j < m && (int)rows.size() < e; j ++ ){
+		if( present[k + j] ){
+			rows.push_back( j );
+		}
+	}
+	if( (int)rows.size() < e ){
+		return false;
+	}
+
+	// 缺失数据块在所选校验行上的系数矩阵
+	std::vector<unsigned char> matrix( e * e );
+	for( int r = 0; r < e; r ++ ){
+		for( int c = 0; c < e; c ++ ){
+			matrix[r * e + c] = coefs[rows[r] * k + missing[c]];
+		}
+	}
+	if( !invertMatrix( matrix, e ) ){
+		return false;
+	}
+
+	// 校验块减去已知数据块的贡献, 得到只含缺失块的伴随式
+	scratch.resize( e * len );
+	for( int r = 0; r < e; r ++ ){
+		unsigned char *syndrome = &scratch[r * len];
+		memcpy( syndrome, blocks[k + rows[r]], len );
+		for( int i = 0; i < k; i ++ ){
+			if( present[i] ){
+				mulAdd( syndrome, blocks[i], coefs[rows[r] * k + i], len );
+			}
+		}
+	}
+
+	for( int c = 0; c < e; c ++ ){
+		unsigned char *out = blocks[missing[c]];
+		memset( out, 0, len );
+		for( int r = 0; r < e; r ++ ){
+			mulAdd( out, &scratch[r * len], matrix[c * e + r], len );
+		}
+	}
+
+	return true;
+}
+
+}
@@ -0,0 +1,62 @@
+#ifndef __FEC_H_
+#define __FEC_H_
+
+#include <vector>
+#include <stdint.h>
+
+#define FEC_MAX_BLOCKS 255  // k + m 的上限
+
+namespace pcs{
+
+/*
+ * GF(2^8) 上的系统 Reed-Solomon 纠删码 (Cauchy 矩阵).
+ * 每组 k 个数据块生成 m 个校验块, 收到任意 k 个块即可恢复整组.
+ * 第一行校验系数全为 1, 所以 m = 1 时就是简单的异或校验.
+ */
+class FecCodec
+{
+public:
+	FecCodec();
+
+	bool init( int dataNum, int parityNum );
+
+	int getDataNum() const
+	{
+		return k;
+	}
+
+	int getParityNum() const
+	{
+		return m;
+	}
+
+	// data 为 k 个长度为 len 的数据块, 生成 m 个校验块写入 parity
+	void encode( const unsigned char * const *data, unsigned char * const *parity, int len ) const;
+
+	// blocks 依次为 k 个数据块和 m 个校验块, present 标记哪些块已收到;
+	// 成功时缺失的数据块被恢复到 blocks 指向的缓存中
+	bool decode( unsigned char * const *blocks, const bool *present, int len );
+
+private:
+	static void initTables();
+	static unsigned char mul( unsigned char a, unsigned char b );
+	static unsigned char inv( unsigned char a );
+	static void mulAdd( unsigned char *dst, const unsigned char *src, unsigned char coef, int len );
+
+	bool invertMatrix( std::vector<unsigned char> &matrix, int n );
+
+	int k;
+	int m;
+	std::vector<unsigned char> coefs;	// m x k 校验系数矩阵
+
+	std::vector<unsigned char> scratch;
+
+	static bool tablesReady;
+	static unsigned char expTable[512];
+	static unsigned char logTable[256];
+	static unsigned char mulTable[256][256];
+};
+
+}
+
+#endif
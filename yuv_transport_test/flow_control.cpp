@@ -0,0 +1,107 @@
+#include "flow_control.h"
+
+namespace pcs{
+
+FlowControl::FlowControl()
+{
+	reset();
+}
+
+void FlowControl::reset()
+{
+	inFlight.clear();
+	for( int i = 0; i < FLOW_MAX_VIEWERS; i ++ ){
+		viewers[i].used = false;
+	}
+	lastSentMs = 0;
+	memset( &stats, 0, sizeof( stats ) );
+}
+
+void FlowControl::onFeedback( const BackpressureMessage &msg, uint64_t viewerId, int64_t nowMs )
+{
+	Viewer *viewer = NULL;
+	for( int i = 0; i < FLOW_MAX_VIEWERS; i ++ ){
+		if( viewers[i].used && viewers[i].id == viewerId ){
+			viewer = &viewers[i];
+			break;
+		}
+		if( viewer == NULL || !viewers[i].used || ( viewer->used && viewers[i].feedbackMs < viewer->feedbackMs ) ){
+			viewer = &viewers[i];
+		}
+	}
+
+	if( viewer->used && viewer->id == viewerId ){
+		// 同一显示端乱序到达的旧反馈不能让进度倒退; 帧号回绕时按有符号差值比较
+		if( (int32_t)( msg.shownFrameId - viewer->shownFrameId ) < 0 ){
+			return;
+		}
+	}
+	else {
+		viewer->used = true;
+		viewer->id = viewerId;
+	}
+
+	viewer->feedbackMs = nowMs;
+	viewer->shownFrameId = msg.shownFrameId;
+	viewer->queueDepth = msg.queueDepth;
+	viewer->minIntervalUs = (int64_t)msg.showCostUs * FLOW_COST_MARGIN_PCT / 100;
+}
+
+bool FlowControl::admit( uint32_t frameId, int64_t nowMs )
+{
+	while( !inFlight.empty() && nowMs - inFlight.front().sentMs > FLOW_IN_FLIGHT_TIMEOUT_MS ){
+		inFlight.pop_front();
+	}
+
+	// 汇总仍有反馈的显示端, 取最慢的: 显示进度最小, 积压最多, 显示耗时最长
+	bool feedbackValid = false;
+	uint32_t shownFrameId = 0;
+	int queueDepth = 0;
+	int64_t minIntervalUs = 0;
+	for( int i = 0; i < FLOW_MAX_VIEWERS; i ++ ){
+		const Viewer &viewer = viewers[i];
+		if( !viewer.used || nowMs - viewer.feedbackMs > FLOW_FEEDBACK_TIMEOUT_MS ){
+			continue;
+		}
+		if( !feedbackValid || (int32_t)( viewer.shownFrameId - shownFrameId ) < 0 ){
+			shownFrameId = viewer.shownFrameId;
+		}
+		if( viewer.queueDepth > queueDepth ){
+			queueDepth = viewer.queueDepth;
+		}
+		if( viewer.minIntervalUs > minIntervalUs ){
+			minIntervalUs = viewer.minIntervalUs;
+		}
+		feedbackValid = true;
+	}
+
+	if( feedbackValid ){
+		// 不晚于最慢显示端已显示帧的帧, 要么已显示, 要么丢了再也不会显示
+		while( !inFlight.empty() && (int32_t)( inFlight.front().frameId - shownFrameId ) <= 0 ){
+			inFlight.pop_front();
+		}
+
+		if( (int)inFlight.size() >= FLOW_MAX_IN_FLIGHT ){
+			stats.inFlight ++;
+			return false;
+		}
+		if( queueDepth > FLOW_MAX_QUEUE_DEPTH ){
+			stats.backlog ++;
+			return false;
+		}
+		if( ( nowMs - lastSentMs ) * 1000 < minIntervalUs ){
+			stats.tooFast ++;
+			return false;
+		}
+	}
+
+	SentFrame sent;
+	sent.frameId = frameId;
+	sent.sentMs = nowMs;
+	inFlight.push_back( sent );
+	lastSentMs = nowMs;
+	stats.admitted ++;
+	return true;
+}
+
+}
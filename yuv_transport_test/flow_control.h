@@ -0,0 +1,78 @@
+#ifndef __FLOW_CONTROL_H_
+#define __FLOW_CONTROL_H_
+
+#include <deque>
+
+#include "frame_protocol.h"
+
+#define FLOW_MAX_IN_FLIGHT		8	// 已发出但显示端还没显示的帧数上限, 覆盖抖动缓冲的最大延时和网络延时
+#define FLOW_IN_FLIGHT_TIMEOUT_MS	500	// 发出超过该时间还没显示的帧按已丢失处理, 不再占用窗口
+#define FLOW_MAX_QUEUE_DEPTH		2	// 显示端积压的帧数超过它时暂停发送, 直到积压消化
+#define FLOW_COST_MARGIN_PCT		120	// 发送间隔不小于显示耗时的 120%
+#define FLOW_FEEDBACK_TIMEOUT_MS	1000	// 超过该时间没有反馈时不再限制, 显示端退出或反馈丢失时不会一直停发
+#define FLOW_MAX_VIEWERS		8	// 分别跟踪反馈的显示端数, 超出时替换最久没有反馈的
+
+namespace pcs{
+
+struct FlowStats
+{
+	uint32_t admitted;	// 允许发送的帧数
+	uint32_t inFlight;	// 因在途的帧太多跳过的帧数
+	uint32_t backlog;	// 因显示端积压跳过的帧数
+	uint32_t tooFast;	// 因快于显示速度跳过的帧数
+};
+
+/*
+ * 发送端反压: 按显示端报告的处理进度 (MSG_BACKPRESSURE) 决定每帧是否发送.
+ * 显示线程跟不上时, 它来不及显示的帧在显示端的 socket 缓存里就会被丢掉, 不如在设备端直接跳过, 不占带宽.
+ * 三个条件: 在途 (已发出未显示) 的帧数不超过窗口, 显示端没有积压, 发送间隔不小于显示耗时.
+ * 组播时每个显示端的反馈分别记录, 按其中最慢的一个限制: 显示进度取最小, 积压和显示耗时取最大;
+ * 超过 FLOW_FEEDBACK_TIMEOUT_MS 没有反馈的显示端不参与.
+ * 与平台无关, 不加锁, 时间为毫秒.
+ */
+class FlowControl
+{
+public:
+	FlowControl();
+
+	// viewerId 区分不同的显示端, 例如由来源地址和端口组成
+	void onFeedback( const BackpressureMessage &msg, uint64_t viewerId, int64_t nowMs );
+
+	// 该帧是否发送, 返回 true 时记为在途
+	bool admit( uint32_t frameId, int64_t nowMs );
+
+	const FlowStats& getStats() const
+	{
+		return stats;
+	}
+
+	void reset();
+
+private:
+	struct SentFrame
+	{
+		uint32_t frameId;
+		int64_t sentMs;
+	};
+
+	struct Viewer
+	{
+		bool used;
+		uint64_t id;
+		int64_t feedbackMs;
+		uint32_t shownFrameId;
+		int queueDepth;
+		int64_t minIntervalUs;
+	};
+
+	std::deque<SentFrame> inFlight;
+
+	Viewer viewers[FLOW_MAX_VIEWERS];
+	int64_t lastSentMs;
+
+	FlowStats stats;
+};
+
+}
+
+#endif
@@ -0,0 +1,599 @@
+#ifndef __FRAME_PROTOCOL_H_
+#define __FRAME_PROTOCOL_H_
+
+/*
+ * 设备与显示端之间的二进制分片协议
+ * 每个UDP数据报都以一个定长头开头, 所有多字节字段均为网络字节序(大端).
+ *
+ *  0      2       3      4         6        8          12         14         16       20          22         24          28
+ *  +------+-------+------+---------+--------+----------+----------+----------+--------+-----------+----------+-----------+
+ *  | 'PC' | ver   | type | stream  | flags  | frame id | frag idx | frag cnt | offset | payload   | fec      | frame     |
+ *  |      |       |      | id      |        |          |          |          |        | len       | k | m    | size      |
+ *  +------+-------+------+---------+--------+----------+----------+----------+--------+-----------+----------+-----------+
+ *
+ * 头之后紧跟 payload len 字节的原始图像数据, 放在整帧的 offset 处.
+ * 所有消息共用前 8 个字节 ('PC', ver, type, stream id, flags), 之后的内容由 type 决定.
+ * stream id 为检测通道号 (StreamChannel), type 为负载类型: 各通道的图像, 检测结果, 车道线和时间戳
+ * 都经同一个 socket 发往同一个端口, 接收端用 StreamDemux 按 (通道, 类型) 分发给各自的消费者.
+ *
+ * 带 FRAG_FLAG_PARITY 标志的是前向纠错校验分片: 数据分片按 fec k 个一组, 每组生成 fec m 个校验分片,
+ * 校验分片的 frag idx 为 组号 * m + 组内序号, frag cnt 仍为数据分片总数, payload len 为分片长度.
+ *
+ * MSG_NACK 由显示端发回设备, 请求重传一帧中缺失的数据分片:
+ *  0        8          12      14
+ *  +--------+----------+-------+-----------------------+
+ *  | prefix | frame id | count | frag idx (2) x count  |
+ *  +--------+----------+-------+-----------------------+
+ *
+ * MSG_FRAME_TIMING 由设备在发送每帧之前发出, 携带该帧各阶段的时间戳(设备单调时钟, 微秒):
+ *  0        8          12        20         28         36       44
+ *  +--------+----------+---------+----------+----------+--------+
+ *  | prefix | frame id | capture | decoded  | detected | send   |
+ *  +--------+----------+---------+----------+----------+--------+
+ *
+ * MSG_TIME_REQ / MSG_TIME_RESP 为 NTP 式的时钟对时: 显示端发出 t1, 设备原样带回 t1 并附上
+ * 收到请求的 t2 和发出应答的 t3, 显示端收到应答的时刻为 t4:
+ *  0        8      16     24     32
+ *  +--------+------+------+------+
+ *  | prefix | t1   | t2   | t3   |
+ *  +--------+------+------+------+
+ *
+ * MSG_STREAM_REQ 为发现/协商请求: 显示端不知道设备地址时广播到设备的 STREAM_DISCOVERY_PORT,
+ * 按自己能显示的格式请求 stream id 通道, 各字段为 0 表示不限制, 由设备选择:
+ *  0        8           10      11       12      14       16          18      19      20    21        24
+ *  +--------+-----------+-------+--------+-------+--------+-----------+-------+-------+-----+---------+
+ *  | prefix | data port | codec | pixel  | width | height | max frag  | fec k | fec m | fps | 保留    |
+ *  |        |           |       | format |       |        | size      |       |       |     |         |
+ *  +--------+-----------+-------+--------+-------+--------+-----------+-------+-------+-----+---------+
+ * 设备回应 MSG_STREAM_DESC, 发往请求来源地址的 data port, 描述该通道实际发送的格式, 两端按它分配缓存:
+ *  0        8       9        10      12       14          16      17      18    19     20           24          28          30       32
+ *  +--------+-------+--------+-------+--------+-----------+-------+-------+-----+------+------------+-----------+-----------+--------+
+ *  | prefix | codec | pixel  | width | height | frag size | fec k | fec m | fps | 保留 | frame size | group     | data port | 保留   |
+ *  |        |       | format |       |        |           |       |       |     |      |            | (0: 单播) |           |        |
+ *  +--------+-------+--------+-------+--------+-----------+-------+-------+-----+------+------------+-----------+-----------+--------+
+ * 设备按接收情况降低或恢复发送格式时, 也主动向该通道的目的地址发出 MSG_STREAM_DESC.
+ *
+ * MSG_RECV_REPORT 由显示端周期性发回设备, 报告上一个周期的接收情况, 设备据此调整码率:
+ *  0        8       12         16          20             24          26         28         30       32
+ *  +--------+-------+----------+-----------+--------------+-----------+----------+----------+--------+
+ *  | prefix | seq   | interval | recv rate | capacity     | loss      | frames   | frames   | 保留   |
+ *  |        |       | (ms)     | (kbps)    | (kbps, 0:无) | (/65535)  | complete | dropped  |        |
+ *  +--------+-------+----------+-----------+--------------+-----------+----------+----------+--------+
+ *
+ * MSG_BACKPRESSURE 由显示端每显示一帧发回设备, 报告显示线程的处理进度, 设备据此跳过显示端来不及显示的帧:
+ *  0        8               12            14            16
+ *  +--------+---------------+-------------+-------------+
+ *  | prefix | 最近显示的帧号 | 积压的帧数  | 每帧显示耗时 |
+ *  |        |               |             | (0.1 毫秒)  |
+ *  +--------+---------------+-------------+-------------+
+ * 该文件不依赖任何平台头文件, 设备端与 Qt 显示端共用.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+namespace pcs{
+
+#define PCS_MAGIC_0		'P'
+#define PCS_MAGIC_1		'C'
+#define PCS_PROTOCOL_VERSION	1
+
+const int FRAGMENT_HEADER_SIZE = 28;
+const int MAX_DATAGRAM_SIZE = 65507;
+const int MAX_FRAGMENT_PAYLOAD = MAX_DATAGRAM_SIZE - FRAGMENT_HEADER_SIZE;
+const uint32_t MAX_FRAME_SIZE = 16 * 1024 * 1024;	// 单帧长度上限, 3840x2160 的 I420 图像约 12 MB; 超过它的分片头视为损坏
+
+// 发送端重启后帧号从 0 开始, 接收端据此重新开始计数, 不把新帧都当作迟到帧丢掉
+const int FRAME_ID_RESTART_GAP = 1000;	// 帧号比最近一帧小这么多, 不可能是乱序
+const int STREAM_RESTART_MS = 1000;	// 这么久没有新帧结束, 却一直收到旧帧号的分片
+
+// 分片按路径 MTU 切分, 一个分片正好装进一个以太网帧, 避免 IP 层分片
+const int IPV4_UDP_HEADER_SIZE = 20 + 8;
+const int DEFAULT_PATH_MTU = 1500;
+
+const int MESSAGE_PREFIX_SIZE = 8;
+const int NACK_HEADER_SIZE = 14;
+const int MAX_NACK_INDICES = 512;
+const int FRAME_TIMING_SIZE = 44;
+const int TIME_SYNC_SIZE = 32;
+const int STREAM_REQ_SIZE = 24;
+const int STREAM_DESC_SIZE = 32;
+const int RECV_REPORT_SIZE = 32;
+const int BACKPRESSURE_SIZE = 16;
+
+const int STREAM_DISCOVERY_PORT = 2335;	// 设备接收发现/协商请求的端口
+
+enum MessageType
+{
+	MSG_FRAGMENT = 1,	// 图像分片
+	MSG_NACK = 2,		// 重传请求
+	MSG_FRAME_TIMING = 3,	// 一帧各阶段的时间戳
+	MSG_TIME_REQ = 4,	// 对时请求
+	MSG_TIME_RESP = 5,	// 对时应答
+	MSG_OBJECT_RESULT = 6,	// 检测结果, 编码见 result_codec.h
+	MSG_LANE_POINTS = 7,	// 车道线, 编码见 result_codec.h
+	MSG_STREAM_REQ = 8,	// 发现/格式协商请求
+	MSG_STREAM_DESC = 9,	// 设备回应的流描述
+	MSG_RECV_REPORT = 10,	// 接收报告, 用于码率自适应
+	MSG_BACKPRESSURE = 11,	// 显示端的处理进度, 用于反压
+	MAX_MESSAGE_TYPE = 31	// 类型号上限, 新增类型不能超过它
+};
+
+enum StreamCodec
+{
+	CODEC_ANY = 0,		// 请求中表示由设备选择
+	CODEC_RAW = 1,		// 未压缩
+	CODEC_JPEG = 2,
+	CODEC_H264 = 3
+};
+
+enum PixelFormat
+{
+	PIXEL_FORMAT_ANY = 0,
+	PIXEL_FORMAT_I420 = 1,	// YUV420 平面: Y, U, V
+	PIXEL_FORMAT_NV12 = 2
+};
+
+// 检测通道, 与设备端 StreamSendProcess 的 nDataChannel 一致
+enum StreamChannel
+{
+	CHANNEL_ADAS = 0,
+	CHANNEL_BSD = 1,
+	CHANNEL_DSM = 2,
+	CHANNEL_FRONT_BSD = 3,
+	MAX_STREAM_CHANNELS = 4
+};
+
+#define FRAG_FLAG_PARITY	0x0001	// 前向纠错校验分片
+#define FRAG_FLAG_RETRANSMIT	0x0002	// 应重传请求重发的分片
+
+struct FragmentHeader
+{
+	uint8_t  type;
+	uint16_t streamId;	// 数据通道号
+	uint16_t flags;
+	uint32_t frameId;	// 帧号
+	uint16_t fragIndex;	// 分片序号
+	uint16_t fragCount;	// 本帧分片总数
+	uint32_t offset;	// 分片数据在整帧中的偏移
+	uint16_t payloadLen;	// 分片数据长度
+	uint16_t fecParams;	// 高字节为每组数据分片数 k, 低字节为每组校验分片数 m, 0 表示不带校验
+	uint32_t frameSize;	// 整帧长度
+};
+
+inline void putU16( unsigned char *p, uint16_t v )
+{
+	p[0] = (unsigned char)( v >> 8 );
+	p[1] = (unsigned char)( v );
+}
+
+inline void putU32( unsigned char *p, uint32_t v )
+{
+	p[0] = (unsigned char)( v >> 24 );
+	p[1] = (unsigned char)( v >> 16 );
+	p[2] = (unsigned char)( v >> 8 );
+	p[3] = (unsigned char)( v );
+}
+
+inline void putU64( unsigned char *p, uint64_t v )
+{
+	putU32( p, (uint32_t)( v >> 32 ) );
+	putU32( p + 4, (uint32_t)v );
+}
+
+inline uint16_t getU16( const unsigned char *p )
+{
+	return (uint16_t)( ( p[0] << 8 ) | p[1] );
+}
+
+inline uint32_t getU32( const unsigned char *p )
+{
+	return ( (uint32_t)p[0] << 24 ) | ( (uint32_t)p[1] << 16 ) | ( (uint32_t)p[2] << 8 ) | (uint32_t)p[3];
+}
+
+inline uint64_t getU64( const unsigned char *p )
+{
+	return ( (uint64_t)getU32( p ) << 32 ) | getU32( p + 4 );
+}
+
+/* 一帧按 fragSize 切分后的分片数目 */
+inline int fragmentCount( int frameSize, int fragSize )
+{
+	if( frameSize <= 0 || fragSize <= 0 ){
+		return 0;
+	}
+	return ( frameSize + fragSize - 1 ) / fragSize;
+}
+
+/* 路径 MTU 下每个分片能携带的图像数据长度 */
+inline int fragmentSizeForMtu( int mtu )
+{
+	int size = mtu - IPV4_UDP_HEADER_SIZE - FRAGMENT_HEADER_SIZE;
+	if( size > MAX_FRAGMENT_PAYLOAD ){
+		size = MAX_FRAGMENT_PAYLOAD;
+	}
+	return ( size > 0 ) ? size : 1;
+}
+
+inline int fecDataNum( const FragmentHeader &header )
+{
+	return header.fecParams >> 8;
+}
+
+inline int fecParityNum( const FragmentHeader &header )
+{
+	return header.fecParams & 0xff;
+}
+
+/* 数据报类型, 不是本协议的数据报返回 -1 */
+inline int peekMessageType( const unsigned char *in, int len )
+{
+	if( len < 4 || in[0] != PCS_MAGIC_0 || in[1] != PCS_MAGIC_1 || in[2] != PCS_PROTOCOL_VERSION ){
+		return -1;
+	}
+	return in[3];
+}
+
+/* 消息所属的通道号, 不是本协议的数据报返回 -1 */
+inline int peekStreamId( const unsigned char *in, int len )
+{
+	if( len < MESSAGE_PREFIX_SIZE || peekMessageType( in, len ) < 0 ){
+		return -1;
+	}
+	return getU16( &in[4] );
+}
+
+inline void encodeMessagePrefix( uint8_t type, uint16_t streamId, uint16_t flags, unsigned char *out )
+{
+	out[0] = PCS_MAGIC_0;
+	out[1] = PCS_MAGIC_1;
+	out[2] = PCS_PROTOCOL_VERSION;
+	out[3] = type;
+	putU16( &out[4], streamId );
+	putU16( &out[6], flags );
+}
+
+inline void encodeFragmentHeader( const FragmentHeader &header, unsigned char *out )
+{
+	encodeMessagePrefix( header.type, header.streamId, header.flags, out );
+	putU32( &out[8], header.frameId );
+	putU16( &out[12], header.fragIndex );
+	putU16( &out[14], header.fragCount );
+	putU32( &out[16], header.offset );
+	putU16( &out[20], header.payloadLen );
+	putU16( &out[22], header.fecParams );
+	putU32( &out[24], header.frameSize );
+}
+
+/* 解析并校验分片头, len 为整个数据报的长度 */
+inline bool decodeFragmentHeader( const unsigned char *in, int len, FragmentHeader &header )
+{
+	if( len < FRAGMENT_HEADER_SIZE || peekMessageType( in, len ) != MSG_FRAGMENT ){
+		return false;
+	}
+
+	header.type = in[3];
+	header.streamId = getU16( &in[4] );
+	header.flags = getU16( &in[6] );
+	header.frameId = getU32( &in[8] );
+	header.fragIndex = getU16( &in[12] );
+	header.fragCount = getU16( &in[14] );
+	header.offset = getU32( &in[16] );
+	header.payloadLen = getU16( &in[20] );
+	header.fecParams = getU16( &in[22] );
+	header.frameSize = getU32( &in[24] );
+
+	if( header.payloadLen > len - FRAGMENT_HEADER_SIZE ){
+		return false;
+	}
+	if( header.flags & FRAG_FLAG_PARITY ){
+		int k = fecDataNum( header );
+		int m = fecParityNum( header );
+		return k > 0 && m > 0 && header.fragIndex < ( header.fragCount + k - 1 ) / k * m;
+	}
+	if( header.fragIndex >= header.fragCount ){
+		return false;
+	}
+	if( (uint64_t)header.offset + header.payloadLen > header.frameSize ){
+		return false;
+	}
+	return true;
+}
+
+struct NackMessage
+{
+	uint16_t streamId;
+	uint32_t frameId;
+	uint16_t count;
+	const unsigned char *indices;	// 指向数据报中的分片序号数组, 用 nackIndex 读取
+};
+
+/* 编码重传请求, out 至少 NACK_HEADER_SIZE + 2 * count 字节, 返回消息长度 */
+inline int encodeNack( uint16_t streamId, uint32_t frameId, const uint16_t *indices, int count, unsigned char *out )
+{
+	if( count > MAX_NACK_INDICES ){
+		count = MAX_NACK_INDICES;
+	}
+
+	encodeMessagePrefix( MSG_NACK, streamId, 0, out );
+	putU32( &out[8], frameId );
+	putU16( &out[12], count );
+	for( int i = 0; i < count; i ++ ){
+		putU16( &out[NACK_HEADER_SIZE + 2 * i], indices[i] );
+	}
+	return NACK_HEADER_SIZE + 2 * count;
+}
+
+inline bool decodeNack( const unsigned char *in, int len, NackMessage &nack )
+{
+	if( len < NACK_HEADER_SIZE || peekMessageType( in, len ) != MSG_NACK ){
+		return false;
+	}
+
+	nack.streamId = getU16( &in[4] );
+	nack.frameId = getU32( &in[8] );
+	nack.count = getU16( &in[12] );
+	nack.indices = &in[NACK_HEADER_SIZE];
+	return nack.count <= MAX_NACK_INDICES && NACK_HEADER_SIZE + 2 * nack.count <= len;
+}
+
+inline uint16_t nackIndex( const NackMessage &nack, int i )
+{
+	return getU16( &nack.indices[2 * i] );
+}
+
+struct FrameTiming
+{
+	uint16_t streamId;
+	uint32_t frameId;
+	int64_t captureUs;	// 开始读取/采集图像
+	int64_t decodedUs;	// 解码完成
+	int64_t detectedUs;	// 检测完成
+	int64_t sendUs;		// 开始发送
+};
+
+inline int encodeFrameTiming( const FrameTiming &timing, unsigned char *out )
+{
+	encodeMessagePrefix( MSG_FRAME_TIMING, timing.streamId, 0, out );
+	putU32( &out[8], timing.frameId );
+	putU64( &out[12], timing.captureUs );
+	putU64( &out[20], timing.decodedUs );
+	putU64( &out[28], timing.detectedUs );
+	putU64( &out[36], timing.sendUs );
+	return FRAME_TIMING_SIZE;
+}
+
+inline bool decodeFrameTiming( const unsigned char *in, int len, FrameTiming &timing )
+{
+	if( len < FRAME_TIMING_SIZE || peekMessageType( in, len ) != MSG_FRAME_TIMING ){
+		return false;
+	}
+
+	timing.streamId = getU16( &in[4] );
+	timing.frameId = getU32( &in[8] );
+	timing.captureUs = getU64( &in[12] );
+	timing.decodedUs = getU64( &in[20] );
+	timing.detectedUs = getU64( &in[28] );
+	timing.sendUs = getU64( &in[36] );
+	return true;
+}
+
+struct TimeSyncMessage
+{
+	int64_t t1;	// 显示端发出请求
+	int64_t t2;	// 设备收到请求
+	int64_t t3;	// 设备发出应答
+};
+
+/* type 为 MSG_TIME_REQ 或 MSG_TIME_RESP, 请求中 t2/t3 填 0 */
+inline int encodeTimeSync( uint8_t type, const TimeSyncMessage &sync, unsigned char *out )
+{
+	encodeMessagePrefix( type, 0, 0, out );
+	putU64( &out[8], sync.t1 );
+	putU64( &out[16], sync.t2 );
+	putU64( &out[24], sync.t3 );
+	return TIME_SYNC_SIZE;
+}
+
+inline bool decodeTimeSync( const unsigned char *in, int len, TimeSyncMessage &sync )
+{
+	int type = peekMessageType( in, len );
+	if( len < TIME_SYNC_SIZE || ( type != MSG_TIME_REQ && type != MSG_TIME_RESP ) ){
+		return false;
+	}
+
+	sync.t1 = getU64( &in[8] );
+	sync.t2 = getU64( &in[16] );
+	sync.t3 = getU64( &in[24] );
+	return true;
+}
+
+struct StreamFormat
+{
+	uint8_t codec;
+	uint8_t pixelFormat;
+	uint16_t width;
+	uint16_t height;
+	uint16_t fragSize;	// 请求中为分片长度上限
+	uint8_t fecData;
+	uint8_t fecParity;
+	uint8_t fps;
+};
+
+struct StreamRequest
+{
+	uint16_t streamId;
+	uint16_t dataPort;	// 显示端接收图像的端口
+	StreamFormat format;
+};
+
+struct StreamDescriptor
+{
+	uint16_t streamId;
+	StreamFormat format;
+	uint32_t frameSize;	// 每帧字节数
+	uint32_t groupAddr;	// 组播组地址(主机字节序), 0 表示单播
+	uint16_t dataPort;
+};
+
+/* 未压缩图像每帧的字节数, 不支持的格式返回 0 */
+inline uint32_t rawFrameSize( int pixelFormat, int width, int height )
+{
+	if( pixelFormat == PIXEL_FORMAT_I420 || pixelFormat == PIXEL_FORMAT_NV12 ){
+		return (uint32_t)width * height * 3 / 2;
+	}
+	return 0;
+}
+
+inline int encodeStreamRequest( const StreamRequest &req, unsigned char *out )
+{
+	memset( out, 0, STREAM_REQ_SIZE );
+	encodeMessagePrefix( MSG_STREAM_REQ, req.streamId, 0, out );
+	putU16( &out[8], req.dataPort );
+	out[10] = req.format.codec;
+	out[11] = req.format.pixelFormat;
+	putU16( &out[12], req.format.width );
+	putU16( &out[14], req.format.height );
+	putU16( &out[16], req.format.fragSize );
+	out[18] = req.format.fecData;
+	out[19] = req.format.fecParity;
+	out[20] = req.format.fps;
+	return STREAM_REQ_SIZE;
+}
+
+inline bool decodeStreamRequest( const unsigned char *in, int len, StreamRequest &req )
+{
+	if( len < STREAM_REQ_SIZE || peekMessageType( in, len ) != MSG_STREAM_REQ ){
+		return false;
+	}
+
+	req.streamId = getU16( &in[4] );
+	req.dataPort = getU16( &in[8] );
+	req.format.codec = in[10];
+	req.format.pixelFormat = in[11];
+	req.format.width = getU16( &in[12] );
+	req.format.height = getU16( &in[14] );
+	req.format.fragSize = getU16( &in[16] );
+	req.format.fecData = in[18];
+	req.format.fecParity = in[19];
+	req.format.fps = in[20];
+	return req.dataPort != 0;
+}
+
+inline int encodeStreamDescriptor( const StreamDescriptor &desc, unsigned char *out )
+{
+	memset( out, 0, STREAM_DESC_SIZE );
+	encodeMessagePrefix( MSG_STREAM_DESC, desc.streamId, 0, out );
+	out[8] = desc.format.codec;
+	out[9] = desc.format.pixelFormat;
+	putU16( &out[10], desc.format.width );
+	putU16( &out[12], desc.format.height );
+	putU16( &out[14], desc.format.fragSize );
+	out[16] = desc.format.fecData;
+	out[17] = desc.format.fecParity;
+	out[18] = desc.format.fps;
+	putU32( &out[20], desc.frameSize );
+	putU32( &out[24], desc.groupAddr );
+	putU16( &out[28], desc.dataPort );
+	return STREAM_DESC_SIZE;
+}
+
+inline bool decodeStreamDescriptor( const unsigned char *in, int len, StreamDescriptor &desc )
+{
+	if( len < STREAM_DESC_SIZE || peekMessageType( in, len ) != MSG_STREAM_DESC ){
+		return false;
+	}
+
+	desc.streamId = getU16( &in[4] );
+	desc.format.codec = in[8];
+	desc.format.pixelFormat = in[9];
+	desc.format.width = getU16( &in[10] );
+	desc.format.height = getU16( &in[12] );
+	desc.format.fragSize = getU16( &in[14] );
+	desc.format.fecData = in[16];
+	desc.format.fecParity = in[17];
+	desc.format.fps = in[18];
+	desc.frameSize = getU32( &in[20] );
+	desc.groupAddr = getU32( &in[24] );
+	desc.dataPort = getU16( &in[28] );
+	return desc.format.width > 0 && desc.format.height > 0 && desc.frameSize > 0;
+}
+
+struct ReceiverReport
+{
+	uint16_t streamId;
+	uint32_t seq;
+	uint32_t intervalMs;	// 统计周期
+	uint32_t recvKbps;	// 周期内收到的码率
+	uint32_t capacityKbps;	// 按分片到达间隔估计的链路容量, 0 表示周期内没有可用的样本
+	uint16_t lossFraction;	// 首次发送就丢失的数据分片比例, 65535 为全部丢失
+	uint16_t framesCompleted;
+	uint16_t framesDropped;
+};
+
+inline int encodeReceiverReport( const ReceiverReport &report, unsigned char *out )
+{
+	memset( out, 0, RECV_REPORT_SIZE );
+	encodeMessagePrefix( MSG_RECV_REPORT, report.streamId, 0, out );
+	putU32( &out[8], report.seq );
+	putU32( &out[12], report.intervalMs );
+	putU32( &out[16], report.recvKbps );
+	putU32( &out[20], report.capacityKbps );
+	putU16( &out[24], report.lossFraction );
+	putU16( &out[26], report.framesCompleted );
+	putU16( &out[28], report.framesDropped );
+	return RECV_REPORT_SIZE;
+}
+
+inline bool decodeReceiverReport( const unsigned char *in, int len, ReceiverReport &report )
+{
+	if( len < RECV_REPORT_SIZE || peekMessageType( in, len ) != MSG_RECV_REPORT ){
+		return false;
+	}
+
+	report.streamId = getU16( &in[4] );
+	report.seq = getU32( &in[8] );
+	report.intervalMs = getU32( &in[12] );
+	report.recvKbps = getU32( &in[16] );
+	report.capacityKbps = getU32( &in[20] );
+	report.lossFraction = getU16( &in[24] );
+	report.framesCompleted = getU16( &in[26] );
+	report.framesDropped = getU16( &in[28] );
+	return report.intervalMs > 0;
+}
+
+struct BackpressureMessage
+{
+	uint16_t streamId;
+	uint32_t shownFrameId;	// 最近显示完成的帧号
+	uint16_t queueDepth;	// 已经收全, 到了播放时刻还没显示的帧数
+	uint32_t showCostUs;	// 平均每帧的显示耗时, 传输时以 0.1 毫秒为单位
+};
+
+inline int encodeBackpressure( const BackpressureMessage &msg, unsigned char *out )
+{
+	memset( out, 0, BACKPRESSURE_SIZE );
+	encodeMessagePrefix( MSG_BACKPRESSURE, msg.streamId, 0, out );
+	putU32( &out[8], msg.shownFrameId );
+	putU16( &out[12], msg.queueDepth );
+	uint32_t cost = ( msg.showCostUs + 50 ) / 100;
+	putU16( &out[14], ( cost > 0xffff ) ? 0xffff : (uint16_t)cost );
+	return BACKPRESSURE_SIZE;
+}
+
+inline bool decodeBackpressure( const unsigned char *in, int len, BackpressureMessage &msg )
+{
+	if( len < BACKPRESSURE_SIZE || peekMessageType( in, len ) != MSG_BACKPRESSURE ){
+		return false;
+	}
+
+	msg.streamId = getU16( &in[4] );
+	msg.shownFrameId = getU32( &in[8] );
+	msg.queueDepth = getU16( &in[12] );
+	msg.showCostUs = (uint32_t)getU16( &in[14] ) * 100;
+	return true;
+}
+
+}
+
+#endif
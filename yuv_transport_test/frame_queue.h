@@ -0,0 +1,157 @@
+#ifndef __FRAME_QUEUE_H_
+#define __FRAME_QUEUE_H_
+
+#include <vector>
+#include <deque>
+#include <pthread.h>
+#include <stdint.h>
+
+namespace pcs{
+
+struct FrameQueueStats
+{
+	uint32_t enqueued;	// 提交的帧数
+	uint32_t dropped;	// 排队期间被更新的帧挤掉, 或帧槽都被占用而未入队的帧数
+	uint32_t queued;	// 当前排队的帧数
+};
+
+/*
+ * 发送线程用的有界帧队列, 新帧优先: 队列满时挤掉同一 key (通道) 最旧的排队帧, 没有则挤掉最旧的帧,
+ * 网络变慢只会丢帧, 不会拖慢提交的线程. Item 为发送器自己的帧槽类型, 容量在多次使用间复用.
+ * 提交: acquire 取一个帧槽, 不持锁填好后 push; 发送线程: pop 取出, 发完 release 归还.
+ * 可以有多个提交线程; 帧槽有 depth + 1 个, 多出的一个给发送线程正在发送的帧.
+ */
+template <typename Item>
+class FrameQueue
+{
+public:
+	FrameQueue( int depth ) : closed(false)
+	{
+		items.resize( depth + 1 );
+		for( size_t i = 0; i < items.size(); i ++ ){
+			freeItems.push_back( &items[i] );
+		}
+		stats.enqueued = 0;
+		stats.dropped = 0;
+		pthread_mutex_init( &mutex, NULL );
+		pthread_cond_init( &cond, NULL );
+	}
+
+	~FrameQueue()
+	{
+		pthread_cond_destroy( &cond );
+		pthread_mutex_destroy( &mutex );
+	}
+
+	// 取一个空闲帧槽, 此后它只属于调用线程, 拷贝不需要持锁; 帧槽都在发送或被其他提交线程占用时丢弃这一帧, 返回 NULL
+	Item* acquire( int key )
+	{
+		pthread_mutex_lock( &mutex );
+		Item *item = NULL;
+		if( !freeItems.empty() ){
+			item = freeItems.back();
+			freeItems.pop_back();
+		}
+		else if( !queue.empty() ){
+			typename std::deque<Entry>::iterator victim = queue.begin();
+			for( typename std::deque<Entry>::iterator it = queue.begin(); it != queue.end(); ++ it ){
+				if( it->key == key ){
+					victim = it;
+					break;
+				}
+			}
+			item = victim->item;
+			queue.erase( victim );
+			stats.dropped ++;
+		}
+		else {
+			stats.dropped ++;
+		}
+		pthread_mutex_unlock( &mutex );
+		return item;
+	}
+
+	// 填好的帧槽入队并唤醒发送线程
+	void push( Item *item, int key )
+	{
+		Entry entry;
+		entry.item = item;
+		entry.key = key;
+
+		pthread_mutex_lock( &mutex );
+		queue.push_back( entry );
+		stats.enqueued ++;
+		pthread_cond_signal( &cond );
+		pthread_mutex_unlock( &mutex );
+	}
+
+	// 等待下一帧, 关闭后返回 NULL
+	Item* pop()
+	{
+		pthread_mutex_lock( &mutex );
+		while( !closed && queue.empty() ){
+			pthread_cond_wait( &cond, &mutex );
+		}
+		Item *item = NULL;
+		if( !closed ){
+			item = queue.front().item;
+			queue.pop_front();
+		}
+		pthread_mutex_unlock( &mutex );
+		return item;
+	}
+
+	// 发送完的帧槽归还, 留给之后的 acquire 复用
+	void release( Item *item )
+	{
+		pthread_mutex_lock( &mutex );
+		freeItems.push_back( item );
+		pthread_mutex_unlock( &mutex );
+	}
+
+	// open 之后 pop 才会等待帧, close 唤醒发送线程并让 pop 返回 NULL
+	void open()
+	{
+		pthread_mutex_lock( &mutex );
+		closed = false;
+		pthread_mutex_unlock( &mutex );
+	}
+
+	void close()
+	{
+		pthread_mutex_lock( &mutex );
+		closed = true;
+		pthread_cond_broadcast( &cond );
+		pthread_mutex_unlock( &mutex );
+	}
+
+	FrameQueueStats getStats()
+	{
+		pthread_mutex_lock( &mutex );
+		FrameQueueStats ret = stats;
+		ret.queued = queue.size();
+		pthread_mutex_unlock( &mutex );
+		return ret;
+	}
+
+private:
+	struct Entry
+	{
+		Item *item;
+		int key;
+	};
+
+	std::vector<Item> items;
+	std::vector<Item *> freeItems;
+	std::deque<Entry> queue;
+	bool closed;
+
+	FrameQueueStats stats;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+}
+
+#endif
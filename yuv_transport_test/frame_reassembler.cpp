@@ -0,0 +1,421 @@
+#include "frame_reassembler.h"
+
+namespace pcs{
+
+FrameReassembler::FrameReassembler( int slotNum, int timeoutMs ) : timeout(timeoutMs),
+								frameFunc(NULL),
+								frameFuncPriv(NULL),
+								nackFunc(NULL),
+								nackFuncPriv(NULL)
+{
+	slots.resize( slotNum );
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		slots[i].used = false;
+	}
+	memset( &stats, 0, sizeof( stats ) );
+}
+
+void FrameReassembler::setFrameCallback( FrameReceivedFunc pFunc, void *pPrivData )
+{
+	frameFunc = pFunc;
+	frameFuncPriv = pPrivData;
+}
+
+void FrameReassembler::setNackCallback( NackFunc pFunc, void *pPrivData )
+{
+	nackFunc = pFunc;
+	nackFuncPriv = pPrivData;
+}
+
+bool FrameReassembler::isLate( uint16_t streamId, uint32_t frameId ) const
+{
+	std::map<uint16_t, StreamState>::const_iterator it = streams.find( streamId );
+	if( it == streams.end() ){
+		return false;
+	}
+	// 帧号回绕时按有符号差值比较
+	return (int32_t)( frameId - it->second.lastFrameId ) <= 0;
+}
+
+bool FrameReassembler::isRestart( uint16_t streamId, uint32_t frameId, int64_t nowMs ) const
+{
+	std::map<uint16_t, StreamState>::const_iterator it = streams.find( streamId );
+	if( it == streams.end() ){
+		return false;
+	}
+	// 帧号大幅回退, 或者很久没有新帧却一直收到旧帧号: 发送端重启后帧号从头开始了
+	return (int32_t)( frameId - it->second.lastFrameId ) < -FRAME_ID_RESTART_GAP
+		|| nowMs - it->second.releaseMs > STREAM_RESTART_MS;
+}
+
+void FrameReassembler::resetStream( uint16_t streamId, int64_t nowMs )
+{
+	// 上一次运行留下的未收全帧帧号更大, 先丢掉, 否则它们结束时又会把帧号推回去
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		if( slots[i].used && slots[i].streamId == streamId ){
+			releaseSlot( slots[i], false, nowMs );
+		}
+	}
+	streams.erase( streamId );
+	stats.restarts ++;
+}
+
+bool FrameReassembler::checkHeader( const FragmentHeader &header ) const
+{
+	if( header.frameSize > MAX_FRAME_SIZE ){
+		return false;
+	}
+	// 分片数必须与帧长和分片长度相符, 校验分片和非最后一个数据分片的长度就是分片长度
+	bool isParity = ( header.flags & FRAG_FLAG_PARITY ) != 0;
+	if( isParity || header.fragIndex + 1 < header.fragCount ){
+		if( header.fragCount != fragmentCount( header.frameSize, header.payloadLen ) ){
+			return false;
+		}
+		return isParity || header.offset == (uint32_t)header.fragIndex * header.payloadLen;
+	}
+	// 最后一个数据分片到帧尾结束
+	return header.offset + header.payloadLen == header.frameSize;
+}
+
+FrameReassembler::FrameSlot* FrameReassembler::findSlot( uint16_t streamId, uint32_t frameId )
+{
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		if( slots[i].used && slots[i].streamId == streamId && slots[i].frameId == frameId ){
+			return &slots[i];
+		}
+	}
+	return NULL;
+}
+
+FrameReassembler::FrameSlot* FrameReassembler::acquireSlot( const FragmentHeader &header, int64_t nowMs )
+{
+	FrameSlot *slot = NULL;
+	FrameSlot *sameStream = NULL;
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		if( !slots[i].used ){
+			slot = &slots[i];
+			sameStream = NULL;
+			break;
+		}
+		// 没有空槽时挤掉同一通道最早开始的帧, 多路相机同时发送时不互相挤占
+		if( slots[i].streamId == header.streamId && ( sameStream == NULL || slots[i].firstMs < sameStream->firstMs ) ){
+			sameStream = &slots[i];
+		}
+		if( slot == NULL || slots[i].firstMs < slot->firstMs ){
+			slot = &slots[i];
+		}
+	}
+	if( sameStream != NULL ){
+		slot = sameStream;
+	}
+
+	if( slot->used ){
+		releaseSlot( *slot, false, nowMs );
+	}
+
+	slot->used = true;
+	slot->streamId = header.streamId;
+	slot->frameId = header.frameId;
+	slot->frameSize = header.frameSize;
+	slot->fragCount = header.fragCount;
+	slot->recvCount = 0;
+	slot->origCount = 0;
+	slot->origBytes = 0;
+	slot->origLastMs = nowMs;
+	slot->firstMs = nowMs;
+	slot->lastMs = nowMs;
+	slot->nackCount = 0;
+	slot->bitmap.assign( ( header.fragCount + 31 ) / 32, 0 );
+	slot->buffer.resize( header.frameSize );
+	slot->fecK = 0;
+	slot->fecM = 0;
+	slot->fragSize = 0;
+
+	return slot;
+}
+
+void FrameReassembler::releaseSlot( FrameSlot &slot, bool completed, int64_t nowMs )
+{
+	if( completed ){
+		stats.completed ++;
+	}
+	else {
+		stats.dropped ++;
+	}
+	stats.expected += slot.fragCount;
+	stats.lost += slot.fragCount - slot.origCount;
+
+	// 同一帧的分片是连续发出的, 到达的间隔反映了瓶颈链路的容量, 与发送码率无关; 瓶颈处丢包时仍然成立
+	if( slot.origLastMs - slot.firstMs >= BURST_MIN_MS ){
+		stats.burstBytes += slot.origBytes;
+		stats.burstMs += slot.origLastMs - slot.firstMs;
+	}
+
+	if( !isLate( slot.streamId, slot.frameId ) ){
+		StreamState &stream = streams[slot.streamId];
+		stream.lastFrameId = slot.frameId;
+		stream.releaseMs = nowMs;
+	}
+	slot.used = false;
+}
+
+void FrameReassembler::setupFec( FrameSlot &slot, const FragmentHeader &header )
+{
+	if( slot.fecK == 0 && header.fecParams != 0 ){
+		slot.fecK = fecDataNum( header );
+		slot.fecM = fecParityNum( header );
+		int groups = ( slot.fragCount + slot.fecK - 1 ) / slot.fecK;
+		slot.parityBitmap.assign( ( groups * slot.fecM + 31 ) / 32, 0 );
+		slot.groupData.assign( groups, 0 );
+		slot.groupParity.assign( groups, 0 );
+	}
+
+	// 校验分片和非最后一个数据分片的长度就是分片长度
+	if( slot.fragSize == 0 && slot.fecK > 0 ){
+		if( ( header.flags & FRAG_FLAG_PARITY ) || header.fragIndex + 1 < header.fragCount ){
+			slot.fragSize = header.payloadLen;
+			int groups = slot.groupData.size();
+			slot.parity.resize( groups * slot.fecM * slot.fragSize );
+			// 恢复时按整块写入, 帧缓存补齐到整数个分片
+			if( slot.buffer.size() < (size_t)slot.fragCount * slot.fragSize ){
+				slot.buffer.resize( slot.fragCount * slot.fragSize );
+			}
+		}
+	}
+}
+
+void FrameReassembler::recoverGroup( FrameSlot &slot, int group )
+{
+	int k = slot.fecK;
+	int m = slot.fecM;
+	int first = group * k;
+	int groupSize = ( slot.fragCount - first < k ) ? ( slot.fragCount - first ) : k;
+
+	if( slot.fragSize == 0 || slot.groupData[group] >= groupSize
+		|| slot.groupData[group] + slot.groupParity[group] < groupSize ){
+		return;
+	}
+
+	if( fec.getDataNum() != k || fec.getParityNum() != m ){
+		if( !fec.init( k, m ) ){
+			return;
+		}
+	}
+	if( zeroBlock.size() < (size_t)slot.fragSize ){
+		zeroBlock.assign( slot.fragSize, 0 );
+	}
+
+	// 最后一组不满 k 块时, 缺的块按全零的已知块处理
+	std::vector<unsigned char *> blocks( k + m );
+	bool present[FEC_MAX_BLOCKS];
+	for( int i = 0; i < k; i ++ ){
+		int index = first + i;
+		if( index < slot.fragCount ){
+			blocks[i] = &slot.buffer[index * slot.fragSize];
+			present[i] = ( slot.bitmap[index >> 5] >> ( index & 31 ) ) & 1;
+		}
+		else {
+			blocks[i] = &zeroBlock[0];
+			present[i] = true;
+		}
+	}
+	for( int j = 0; j < m; j ++ ){
+		int index = group * m + j;
+		blocks[k + j] = &slot.parity[index * slot.fragSize];
+		present[k + j] = ( slot.parityBitmap[index >> 5] >> ( index & 31 ) ) & 1;
+	}
+
+	if( !fec.decode( &blocks[0], present, slot.fragSize ) ){
+		return;
+	}
+
+	for( int i = 0; i < groupSize; i ++ ){
+		int index = first + i;
+		uint32_t bit = 1u << ( index & 31 );
+		if( !( slot.bitmap[index >> 5] & bit ) ){
+			slot.bitmap[index >> 5] |= bit;
+			slot.recvCount ++;
+			stats.recovered ++;
+		}
+	}
+	slot.groupData[group] = groupSize;
+}
+
+void FrameReassembler::requestMissing( FrameSlot &slot )
+{
+	nackIndices.clear();
+	if( slot.fecK == 0 ){
+		for( int i = 0; i < slot.fragCount; i ++ ){
+			if( !( ( slot.bitmap[i >> 5] >> ( i & 31 ) ) & 1 ) ){
+				nackIndices.push_back( i );
+			}
+		}
+	}
+	else {
+		// 每组只请求校验分片补不上的那几个, 任意数据分片到达都能让该组恢复
+		int groups = slot.groupData.size();
+		for( int group = 0; group < groups; group ++ ){
+			int first = group * slot.fecK;
+			int groupSize = ( slot.fragCount - first < slot.fecK ) ? ( slot.fragCount - first ) : slot.fecK;
+			int lack = groupSize - slot.groupData[group] - slot.groupParity[group];
+			for( int i = first; i < first + groupSize && lack > 0; i ++ ){
+				if( !( ( slot.bitmap[i >> 5] >> ( i & 31 ) ) & 1 ) ){
+					nackIndices.push_back( i );
+					lack --;
+				}
+			}
+		}
+	}
+
+	int count = nackIndices.size();
+	if( count == 0 ){
+		return;
+	}
+	if( count > MAX_NACK_INDICES ){
+		count = MAX_NACK_INDICES;
+	}
+
+	nackFunc( slot.streamId, slot.frameId, &nackIndices[0], count, nackFuncPriv );
+	stats.nacks ++;
+	stats.nacked += count;
+}
+
+void FrameReassembler::completeFrame( FrameSlot &slot, int64_t nowMs )
+{
+	// 同一通道中比它旧的未收全帧已经没有显示的意义, 一并丢弃
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		if( slots[i].used && &slots[i] != &slot && slots[i].streamId == slot.streamId
+			&& (int32_t)( slots[i].frameId - slot.frameId ) < 0 ){
+			releaseSlot( slots[i], false, nowMs );
+		}
+	}
+
+	if( frameFunc != NULL ){
+		ReceivedFrame frame;
+		frame.streamId = slot.streamId;
+		frame.frameId = slot.frameId;
+		frame.data = slot.buffer.empty() ? NULL : &slot.buffer[0];
+		frame.size = slot.frameSize;
+		frameFunc( &frame, frameFuncPriv );
+	}
+	releaseSlot( slot, true, nowMs );
+}
+
+bool FrameReassembler::pushFragment( const unsigned char *datagram, int len, int64_t nowMs )
+{
+	FragmentHeader header;
+	if( !decodeFragmentHeader( datagram, len, header ) ){
+		return false;
+	}
+
+	// 帧长和分片数来自网络, 不可信, 校验之后才能按它分配帧缓存
+	if( !checkHeader( header ) ){
+		stats.invalid ++;
+		return false;
+	}
+
+	evictExpired( nowMs );
+
+	FrameSlot *slot = findSlot( header.streamId, header.frameId );
+	if( slot == NULL ){
+		if( isLate( header.streamId, header.frameId ) ){
+			if( !isRestart( header.streamId, header.frameId, nowMs ) ){
+				stats.late ++;
+				return false;
+			}
+			resetStream( header.streamId, nowMs );
+		}
+		slot = acquireSlot( header, nowMs );
+	}
+	else if( slot->frameSize != header.frameSize || slot->fragCount != header.fragCount ){
+		stats.invalid ++;
+		return false;
+	}
+
+	setupFec( *slot, header );
+
+	bool isParity = ( header.flags & FRAG_FLAG_PARITY ) != 0;
+	if( isParity && ( slot->fecK == 0 || slot->fragSize != header.payloadLen
+		|| header.fragIndex >= slot->groupData.size() * slot->fecM ) ){
+		stats.invalid ++;
+		return false;
+	}
+
+	std::vector<uint32_t> &bitmap = isParity ? slot->parityBitmap : slot->bitmap;
+	uint32_t &word = bitmap[header.fragIndex >> 5];
+	uint32_t bit = 1u << ( header.fragIndex & 31 );
+	if( word & bit ){
+		stats.duplicate ++;
+		return false;
+	}
+	word |= bit;
+	slot->lastMs = nowMs;
+	if( header.flags & FRAG_FLAG_RETRANSMIT ){
+		stats.retransmitted ++;
+	}
+	else {
+		stats.received ++;
+		stats.receivedBytes += header.payloadLen;
+		slot->origBytes += header.payloadLen;
+		slot->origLastMs = nowMs;
+		if( !isParity ){
+			slot->origCount ++;
+		}
+	}
+
+	int group;
+	if( isParity ){
+		memcpy( &slot->parity[header.fragIndex * slot->fragSize], &datagram[FRAGMENT_HEADER_SIZE], header.payloadLen );
+		group = header.fragIndex / slot->fecM;
+		slot->groupParity[group] ++;
+	}
+	else {
+		if( header.payloadLen > 0 ){
+			memcpy( &slot->buffer[header.offset], &datagram[FRAGMENT_HEADER_SIZE], header.payloadLen );
+		}
+		slot->recvCount ++;
+		group = -1;
+		if( slot->fecK > 0 ){
+			group = header.fragIndex / slot->fecK;
+			slot->groupData[group] ++;
+		}
+	}
+
+	if( group >= 0 ){
+		recoverGroup( *slot, group );
+	}
+
+	if( slot->recvCount == slot->fragCount ){
+		completeFrame( *slot, nowMs );
+	}
+
+	return true;
+}
+
+void FrameReassembler::evictExpired( int64_t nowMs )
+{
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		if( slots[i].used && nowMs - slots[i].firstMs > timeout ){
+			releaseSlot( slots[i], false, nowMs );
+		}
+	}
+}
+
+void FrameReassembler::checkNacks( int64_t nowMs )
+{
+	if( nackFunc == NULL ){
+		return;
+	}
+
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		FrameSlot &slot = slots[i];
+		if( !slot.used || slot.nackCount >= NACK_MAX_RETRY || nowMs - slot.lastMs < NACK_DELAY_MS ){
+			continue;
+		}
+		slot.lastMs = nowMs;
+		slot.nackCount ++;
+		requestMissing( slot );
+	}
+}
+
+}
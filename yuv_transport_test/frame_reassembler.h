@@ -0,0 +1,149 @@
+#ifndef __FRAME_REASSEMBLER_H_
+#define __FRAME_REASSEMBLER_H_
+
+#include <vector>
+#include <map>
+
+#include "frame_protocol.h"
+#include "fec.h"
+
+#define REASSEMBLY_SLOT_NUM	( 2 * MAX_STREAM_CHANNELS )	// 同时在拼的帧数, 每个通道两帧
+#define REASSEMBLY_TIMEOUT_MS	200	// 一帧从收到第一个分片起, 超过该时间未收全则丢弃
+#define NACK_DELAY_MS		20	// 一帧超过该时间没有新分片到达, 就请求重传缺失的分片
+#define NACK_MAX_RETRY		3	// 每帧最多请求重传的次数
+#define BURST_MIN_MS		2	// 首末分片间隔不小于它的帧才计入链路容量的估计, 毫秒时钟下太短的间隔误差太大
+
+namespace pcs{
+
+// 收完整的一帧, data 只在回调期间有效
+struct ReceivedFrame
+{
+	uint16_t streamId;
+	uint32_t frameId;
+	const unsigned char *data;
+	int size;
+};
+
+typedef void (*FrameReceivedFunc)( const ReceivedFrame *pFrame, void *pPrivData );
+
+// 请求重传一帧中序号为 indices 的数据分片
+typedef void (*NackFunc)( uint16_t streamId, uint32_t frameId, const uint16_t *indices, int count, void *pPrivData );
+
+struct ReassemblyStats
+{
+	uint32_t completed;	// 收全并回调的帧数
+	uint32_t dropped;	// 超时或被更新的帧挤掉的未收全帧数
+	uint32_t late;		// 所属帧已经回调或丢弃后才到达的分片数
+	uint32_t duplicate;	// 重复分片数
+	uint32_t invalid;	// 分片头损坏或与所在帧不一致的分片数
+	uint32_t restarts;	// 检测到发送端重启(帧号从头开始)的次数
+	uint32_t recovered;	// 由校验分片恢复出的数据分片数
+	uint32_t nacks;		// 发出的重传请求数
+	uint32_t nacked;	// 请求重传的分片数
+	uint32_t retransmitted;	// 收到的重传分片数
+
+	// 以下用于估计链路容量和丢包率, 由调用者按周期取差值
+	uint32_t received;	// 首次发送就收到的分片数(含校验分片)
+	uint64_t receivedBytes;	// 首次发送就收到的分片数据字节数
+	uint32_t expected;	// 已结束(收全或丢弃)的帧的数据分片总数
+	uint32_t lost;		// 其中首次发送时没有收到的数据分片数, 不论之后是否恢复或重传补上
+	uint64_t burstBytes;	// 已结束的帧中首次发送就收到的字节数之和
+	uint64_t burstMs;	// 这些帧从第一个到最后一个首次发送的分片的到达间隔之和
+};
+
+/*
+ * 多帧乱序重组: 固定数目的帧槽按 (通道号, 帧号) 索引, 每个槽用位图记录已收分片,
+ * 分片可以任意顺序到达; 带校验分片时, 一组内丢失的数据分片由 FecCodec 恢复,
+ * 校验分片也补不回来的分片通过 NackFunc 请求发送端重传.
+ * 与平台无关, 时间由调用者传入(单调时钟, 毫秒).
+ */
+class FrameReassembler
+{
+public:
+	FrameReassembler( int slotNum = REASSEMBLY_SLOT_NUM, int timeoutMs = REASSEMBLY_TIMEOUT_MS );
+
+	void setFrameCallback( FrameReceivedFunc pFunc, void *pPrivData );
+
+	void setNackCallback( NackFunc pFunc, void *pPrivData );
+
+	// 处理一个分片数据报, 不是分片或被丢弃时返回 false
+	bool pushFragment( const unsigned char *datagram, int len, int64_t nowMs );
+
+	// 丢弃超时未收全的帧
+	void evictExpired( int64_t nowMs );
+
+	// 对停滞超过 NACK_DELAY_MS 的帧请求重传缺失的分片, 需要周期性调用
+	void checkNacks( int64_t nowMs );
+
+	const ReassemblyStats& getStats() const
+	{
+		return stats;
+	}
+
+private:
+	struct FrameSlot
+	{
+		bool used;
+		uint16_t streamId;
+		uint32_t frameId;
+		uint32_t frameSize;
+		uint16_t fragCount;
+		int recvCount;
+		int origCount;		// 首次发送就收到的数据分片数
+		int origBytes;		// 首次发送就收到的分片字节数(含校验分片)
+		int64_t origLastMs;	// 最后一个首次发送的分片的到达时间
+		int64_t firstMs;
+		int64_t lastMs;		// 最近一次收到分片或请求重传的时间
+		int nackCount;
+		std::vector<uint32_t> bitmap;
+		std::vector<unsigned char> buffer;
+
+		// 前向纠错, fragSize 为 0 表示还不知道分片长度
+		int fecK;
+		int fecM;
+		int fragSize;
+		std::vector<uint32_t> parityBitmap;
+		std::vector<uint16_t> groupData;	// 每组已收数据分片数
+		std::vector<uint16_t> groupParity;	// 每组已收校验分片数
+		std::vector<unsigned char> parity;
+	};
+
+	FrameSlot* findSlot( uint16_t streamId, uint32_t frameId );
+	FrameSlot* acquireSlot( const FragmentHeader &header, int64_t nowMs );
+	void releaseSlot( FrameSlot &slot, bool completed, int64_t nowMs );
+	bool isLate( uint16_t streamId, uint32_t frameId ) const;
+	bool isRestart( uint16_t streamId, uint32_t frameId, int64_t nowMs ) const;
+	void resetStream( uint16_t streamId, int64_t nowMs );
+	bool checkHeader( const FragmentHeader &header ) const;
+	void setupFec( FrameSlot &slot, const FragmentHeader &header );
+	void recoverGroup( FrameSlot &slot, int group );
+	void completeFrame( FrameSlot &slot, int64_t nowMs );
+	void requestMissing( FrameSlot &slot );
+
+	std::vector<FrameSlot> slots;
+	int timeout;
+
+	// 每个通道最近一次回调或丢弃的帧号, 不大于它的帧都算迟到
+	struct StreamState
+	{
+		uint32_t lastFrameId;
+		int64_t releaseMs;	// 最近一次有帧号更新的帧结束的时间
+	};
+	std::map<uint16_t, StreamState> streams;
+
+	ReassemblyStats stats;
+
+	FecCodec fec;
+	std::vector<unsigned char> zeroBlock;
+
+	FrameReceivedFunc frameFunc;
+	void *frameFuncPriv;
+
+	NackFunc nackFunc;
+	void *nackFuncPriv;
+	std::vector<uint16_t> nackIndices;
+};
+
+}
+
+#endif
@@ -0,0 +1,432 @@
+#include "frame_receiver.h"
+
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <time.h>
+
+namespace pcs{
+
+FrameReceiver::FrameReceiver() : sockFd(-1),
+				ownFd(false),
+				hasPeer(false),
+				timerId(-1),
+				msgFunc(NULL),
+				msgFuncPriv(NULL),
+				uring(NULL),
+				loop(NULL),
+				uringNow(0),
+				uringBytes(0),
+				running(false)
+{
+	slab.resize( RECV_BATCH_SIZE * MAX_DATAGRAM_SIZE );
+	iovs.resize( RECV_BATCH_SIZE );
+	msgs.resize( RECV_BATCH_SIZE );
+	addrs.resize( RECV_BATCH_SIZE );
+	controls.resize( RECV_BATCH_SIZE * RECV_CONTROL_SIZE );
+	nackBuf.resize( NACK_HEADER_SIZE + 2 * MAX_NACK_INDICES );
+
+	for( int i = 0; i < RECV_BATCH_SIZE; i ++ ){
+		iovs[i].iov_base = &slab[i * MAX_DATAGRAM_SIZE];
+		iovs[i].iov_len = MAX_DATAGRAM_SIZE;
+	}
+
+	reassembler.setNackCallback( onNack, this );
+
+	memset( &sockStats, 0, sizeof( sockStats ) );
+	recvStats = reassembler.getStats();
+	pthread_mutex_init( &statsMutex, NULL );
+	pthread_mutex_init( &peerMutex, NULL );
+}
+
+FrameReceiver::~FrameReceiver()
+{
+	stop();
+	delete uring;
+	if( ownFd && sockFd >= 0 ){
+		close( sockFd );
+	}
+	pthread_mutex_destroy( &statsMutex );
+	pthread_mutex_destroy( &peerMutex );
+}
+
+bool FrameReceiver::init( const char *ip, const int port )
+{
+	int fd = socket( AF_INET, SOCK_DGRAM, 0 );
+	if( fd < 0 ){
+		std::cerr<<"socket UDP receiver failed ..."<<std::endl;
+		return false;
+	}
+
+	// 同一主机上的多个接收端可以绑定同一端口, 一起接收组播
+	int on = 1;
+	setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+
+	struct sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = ( ip == NULL ) ? htonl( INADDR_ANY ) : inet_addr( ip );
+	addr.sin_port = htons( port );
+
+	if( bind( fd, ( struct sockaddr* )&addr, sizeof( addr ) ) < 0 ){
+		std::cerr<<"Bind the addr failed ..."<<std::endl;
+		close( fd );
+		return false;
+	}
+
+	ownFd = true;
+	return init( fd );
+}
+
+bool FrameReceiver::init( int fd )
+{
+	sockFd = fd;
+
+	// 加大接收缓存, 避免多路 720p 码流突发时内核丢包
+	int rcvBuf = 8 * 1024 * 1024;
+	if( setsockopt( sockFd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof( rcvBuf ) ) < 0 ){
+		std::cerr<<"set SO_RCVBUF failed ..."<<std::endl;
+	}
+	enableDropCounter( sockFd );
+
+	return true;
+}
+
+bool FrameReceiver::joinGroup( const char *group, const char *ifaceIp )
+{
+	struct ip_mreq mreq;
+	memset( &mreq, 0, sizeof( mreq ) );
+	mreq.imr_multiaddr.s_addr = inet_addr( group );
+	mreq.imr_interface.s_addr = ( ifaceIp == NULL ) ? htonl( INADDR_ANY ) : inet_addr( ifaceIp );
+	if( setsockopt( sockFd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof( mreq ) ) < 0 ){
+		std::cerr<<"join multicast group "<<group<<" failed ..."<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool FrameReceiver::setGro( bool enable )
+{
+	int on = enable ? 1 : 0;
+	if( setsockopt( sockFd, SOL_UDP, UDP_GRO, &on, sizeof( on ) ) < 0 ){
+		std::cerr<<"udp gro is not supported ..."<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool FrameReceiver::setUring( bool enable )
+{
+	if( !enable ){
+		delete uring;
+		uring = NULL;
+		return true;
+	}
+	if( uring != NULL ){
+		return true;
+	}
+
+	uring = new IoUringRecv();
+	if( !uring->init( sockFd, RECV_CONTROL_SIZE ) ){
+		delete uring;
+		uring = NULL;
+		return false;
+	}
+	return true;
+}
+
+void FrameReceiver::setFrameCallback( FrameReceivedFunc pFunc, void *pPrivData )
+{
+	reassembler.setFrameCallback( pFunc, pPrivData );
+}
+
+void FrameReceiver::setMessageCallback( MessageReceivedFunc pFunc, void *pPrivData )
+{
+	msgFunc = pFunc;
+	msgFuncPriv = pPrivData;
+}
+
+bool FrameReceiver::sendToPeer( const unsigned char *msg, int len )
+{
+	pthread_mutex_lock( &peerMutex );
+	bool valid = hasPeer;
+	struct sockaddr_in addr = peerAddr;
+	pthread_mutex_unlock( &peerMutex );
+
+	if( !valid ){
+		return false;
+	}
+	if( sendto( sockFd, msg, len, 0, ( struct sockaddr* )&addr, sizeof( addr ) ) < 0 ){
+		std::cerr<<"send to peer failed ..."<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+int64_t FrameReceiver::nowMs()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void FrameReceiver::onNack( uint16_t streamId, uint32_t frameId, const uint16_t *indices, int count, void *pPrivData )
+{
+	FrameReceiver *receiver = (FrameReceiver *)pPrivData;
+	if( !receiver->hasPeer ){
+		return;
+	}
+
+	int len = encodeNack( streamId, frameId, indices, count, &receiver->nackBuf[0] );
+	if( sendto( receiver->sockFd, &receiver->nackBuf[0], len, 0, ( struct sockaddr* )&receiver->peerAddr, sizeof( receiver->peerAddr ) ) < 0 ){
+		std::cerr<<"send nack failed ..."<<std::endl;
+	}
+}
+
+int FrameReceiver::poll( int timeoutMs )
+{
+	struct pollfd pfd;
+	pfd.fd = getPollFd();
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	int ret = ::poll( &pfd, 1, timeoutMs );
+	if( ret <= 0 ){
+		tick();
+		return 0;
+	}
+
+	int total = receive();
+	reassembler.checkNacks( nowMs() );
+	return total;
+}
+
+void FrameReceiver::tick()
+{
+	int64_t now = nowMs();
+	reassembler.evictExpired( now );
+	reassembler.checkNacks( now );
+	publishStats();
+}
+
+void FrameReceiver::handleDatagram( const unsigned char *datagram, int len, int segSize, const struct sockaddr_in &from, int64_t now )
+{
+	// 开启 GRO 后一个数据报可能是多个等长分片合并的超级包, 按 segSize 拆开
+	for( int offset = 0; offset < len; offset += segSize ){
+		int segLen = ( len - offset < segSize ) ? ( len - offset ) : segSize;
+		int type = peekMessageType( datagram + offset, segLen );
+		if( type != MSG_FRAGMENT && type >= 0 && msgFunc != NULL ){
+			msgFunc( datagram + offset, segLen, &from, msgFuncPriv );
+			continue;
+		}
+		// 接收线程是唯一的写者, 自己读取不需要加锁; 来源不变时也不必加锁
+		if( reassembler.pushFragment( datagram + offset, segLen, now ) &&
+			( !hasPeer || peerAddr.sin_addr.s_addr != from.sin_addr.s_addr || peerAddr.sin_port != from.sin_port ) ){
+			pthread_mutex_lock( &peerMutex );
+			peerAddr = from;
+			hasPeer = true;
+			pthread_mutex_unlock( &peerMutex );
+		}
+	}
+}
+
+void FrameReceiver::onDatagram( const unsigned char *datagram, int len, int segSize, const struct sockaddr_in *from, void *pPrivData )
+{
+	FrameReceiver *receiver = (FrameReceiver *)pPrivData;
+	receiver->uringBytes += len;
+	receiver->handleDatagram( datagram, len, segSize, *from, receiver->uringNow );
+}
+
+void FrameReceiver::countReceived( int bytes, int datagrams, uint32_t dropped )
+{
+	pthread_mutex_lock( &statsMutex );
+	sockStats.rxBytes += bytes;
+	sockStats.rxDatagrams += datagrams;
+	sockStats.rxDropped = dropped;
+	recvStats = reassembler.getStats();
+	pthread_mutex_unlock( &statsMutex );
+}
+
+void FrameReceiver::publishStats()
+{
+	pthread_mutex_lock( &statsMutex );
+	recvStats = reassembler.getStats();
+	pthread_mutex_unlock( &statsMutex );
+}
+
+void FrameReceiver::getStats( ReassemblyStats &stats )
+{
+	pthread_mutex_lock( &statsMutex );
+	stats = recvStats;
+	pthread_mutex_unlock( &statsMutex );
+}
+
+void FrameReceiver::getSocketStats( SocketStats &stats )
+{
+	pthread_mutex_lock( &statsMutex );
+	stats = sockStats;
+	pthread_mutex_unlock( &statsMutex );
+	querySocketQueues( sockFd, stats );
+}
+
+void FrameReceiver::fallbackFromUring()
+{
+	std::cerr<<"io_uring receive failed, fall back to recvmmsg ..."<<std::endl;
+	if( loop != NULL ){
+		loop->removeFd( uring->getFd() );
+	}
+	delete uring;
+	uring = NULL;
+	if( loop != NULL ){
+		loop->addFd( sockFd, EPOLLIN, onReadable, this );
+	}
+}
+
+int FrameReceiver::receiveUring()
+{
+	uringNow = nowMs();
+	uringBytes = 0;
+	int total = uring->drain( onDatagram, this );
+	if( total < 0 ){
+		fallbackFromUring();
+		return 0;
+	}
+	countReceived( uringBytes, total, uring->getDropped() );
+	return total;
+}
+
+int FrameReceiver::receive()
+{
+	if( uring != NULL ){
+		return receiveUring();
+	}
+
+	int total = 0;
+	while( true ){
+		for( int i = 0; i < RECV_BATCH_SIZE; i ++ ){
+			memset( &msgs[i].msg_hdr, 0, sizeof( msgs[i].msg_hdr ) );
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof( addrs[i] );
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_control = &controls[i * RECV_CONTROL_SIZE];
+			msgs[i].msg_hdr.msg_controllen = RECV_CONTROL_SIZE;
+			msgs[i].msg_len = 0;
+		}
+
+		int count = recvmmsg( sockFd, &msgs[0], RECV_BATCH_SIZE, MSG_DONTWAIT, NULL );
+		if( count <= 0 ){
+			if( count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ){
+				std::cerr<<"received error ..."<<std::endl;
+			}
+			break;
+		}
+
+		int64_t now = nowMs();
+		int bytes = 0;
+		uint32_t dropped = sockStats.rxDropped;
+		for( int i = 0; i < count; i ++ ){
+			int len = msgs[i].msg_len;
+			bytes += len;
+			parseDropCounter( &msgs[i].msg_hdr, dropped );
+			// 超过 MAX_DATAGRAM_SIZE 的数据报被截断, 内容不完整, 直接丢弃
+			if( msgs[i].msg_hdr.msg_flags & MSG_TRUNC ){
+				continue;
+			}
+			int segSize = len;
+			for( struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msgs[i].msg_hdr ); cmsg != NULL; cmsg = CMSG_NXTHDR( &msgs[i].msg_hdr, cmsg ) ){
+				if( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO ){
+					memcpy( &segSize, CMSG_DATA( cmsg ), sizeof( int ) );
+				}
+			}
+			if( segSize <= 0 ){
+				segSize = len;
+			}
+
+			handleDatagram( (const unsigned char *)iovs[i].iov_base, len, segSize, addrs[i], now );
+		}
+		countReceived( bytes, count, dropped );
+		total += count;
+
+		if( count < RECV_BATCH_SIZE ){
+			break;
+		}
+	}
+
+	return total;
+}
+
+void FrameReceiver::onReadable( int fd, uint32_t events, void *pPrivData )
+{
+	FrameReceiver *receiver = (FrameReceiver *)pPrivData;
+	receiver->receive();
+}
+
+void FrameReceiver::onTimer( int timerId, void *pPrivData )
+{
+	FrameReceiver *receiver = (FrameReceiver *)pPrivData;
+	receiver->tick();
+}
+
+bool FrameReceiver::attach( EventLoop &loop )
+{
+	int fd = getPollFd();
+	if( !loop.addFd( fd, EPOLLIN, onReadable, this ) ){
+		return false;
+	}
+
+	timerId = loop.addTimer( NACK_DELAY_MS / 2, onTimer, this );
+	if( timerId < 0 ){
+		loop.removeFd( fd );
+		return false;
+	}
+	this->loop = &loop;
+	return true;
+}
+
+void FrameReceiver::detach( EventLoop &loop )
+{
+	loop.removeFd( getPollFd() );
+	if( timerId >= 0 ){
+		loop.removeTimer( timerId );
+		timerId = -1;
+	}
+	this->loop = NULL;
+}
+
+void* FrameReceiver::receiveThread( void *pArg )
+{
+	FrameReceiver *receiver = (FrameReceiver *)pArg;
+	while( receiver->running ){
+		receiver->poll( NACK_DELAY_MS / 2 );
+	}
+	return NULL;
+}
+
+bool FrameReceiver::start()
+{
+	if( running ){
+		return true;
+	}
+
+	running = true;
+	if( pthread_create( &threadId, NULL, receiveThread, this ) != 0 ){
+		std::cerr<<"pthread_create receiveThread error ..."<<std::endl;
+		running = false;
+		return false;
+	}
+	return true;
+}
+
+void FrameReceiver::stop()
+{
+	if( !running ){
+		return;
+	}
+
+	running = false;
+	pthread_join( threadId, NULL );
+}
+
+}
@@ -0,0 +1,157 @@
+#ifndef __FRAME_RECEIVER_H_
+#define __FRAME_RECEIVER_H_
+
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <netinet/udp.h>
+
+#include "frame_protocol.h"
+#include "frame_reassembler.h"
+#include "event_loop.h"
+#include "io_uring_recv.h"
+#include "socket_stats.h"
+
+#define RECV_BATCH_SIZE 32  // 每次 recvmmsg 最多收取的数据报数
+#define RECV_CONTROL_SIZE ( CMSG_SPACE( sizeof( int ) ) + DROP_COUNTER_CMSG_SPACE )  // 每个数据报的控制消息: GRO 分片长度 + 内核丢包数
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104  // 旧的内核头文件中没有定义
+#endif
+
+namespace pcs{
+
+// 收到分片以外的协议消息(帧时间戳, 对时应答等), 在接收线程中回调
+typedef void (*MessageReceivedFunc)( const unsigned char *msg, int len, const struct sockaddr_in *from, void *pPrivData );
+
+/*
+ * Linux 下的批量接收引擎: 用 recvmmsg 把 socket 中的数据报一次性收到预先分配的 slab 中,
+ * 交给 FrameReassembler 乱序重组, 每收完一帧回调一次; 缺失的分片通过同一个 socket 向发送端请求重传.
+ * 可以用 start 在独立线程中运行, 也可以 attach 到 EventLoop 上, 由一个线程服务多路相机.
+ * 内核支持时可以改用 io_uring 接收, 重组和重传逻辑不变.
+ */
+class FrameReceiver
+{
+public:
+	FrameReceiver();
+	~FrameReceiver();
+
+	bool init( const char *ip, const int port );
+	bool init( int fd );
+
+	// 加入组播组, ifaceIp 为接收网卡地址(NULL 时由内核选择); 接收多个组时多次调用
+	bool joinGroup( const char *group, const char *ifaceIp = NULL );
+
+	void setFrameCallback( FrameReceivedFunc pFunc, void *pPrivData );
+
+	void setMessageCallback( MessageReceivedFunc pFunc, void *pPrivData );
+
+	// 发给最近一个分片的来源(设备), 还没有收到过分片时返回 false; 可以在任意线程调用
+	bool sendToPeer( const unsigned char *msg, int len );
+
+	// 由内核把同一条流的多个分片合并成一个超级包上交, 内核不支持时返回 false
+	bool setGro( bool enable );
+
+	// 改用 io_uring multishot 接收, 须在 start/attach 之前调用; 内核不支持时返回 false, 继续使用 recvmmsg
+	bool setUring( bool enable );
+
+	// 等待最多 timeoutMs 毫秒, 然后收空 socket, 返回收到的数据报数
+	int poll( int timeoutMs );
+
+	bool start();
+	void stop();
+
+	// 在事件循环中接收, 与 start 二选一
+	bool attach( EventLoop &loop );
+	void detach( EventLoop &loop );
+
+	int getFd() const
+	{
+		return sockFd;
+	}
+
+	bool isUring() const
+	{
+		return uring != NULL;
+	}
+
+	// 重组统计, 接收线程每收完一批数据报或检查一次超时后更新, 各项取自同一时刻; 可以在任意线程调用
+	void getStats( ReassemblyStats &stats );
+
+	// 接收字节数, 数据报数, 内核丢包和接收队列积压
+	void getSocketStats( SocketStats &stats );
+
+private:
+	static void* receiveThread( void *pArg );
+	static int64_t nowMs();
+	static void onReadable( int fd, uint32_t events, void *pPrivData );
+	static void onTimer( int timerId, void *pPrivData );
+	static void onDatagram( const unsigned char *datagram, int len, int segSize, const struct sockaddr_in *from, void *pPrivData );
+
+	// 等待可读的 fd, io_uring 模式下为完成队列
+	int getPollFd() const
+	{
+		return ( uring != NULL ) ? uring->getFd() : sockFd;
+	}
+
+	// 按 GRO 分片长度拆开数据报并送入重组
+	void handleDatagram( const unsigned char *datagram, int len, int segSize, const struct sockaddr_in &from, int64_t now );
+	void countReceived( int bytes, int datagrams, uint32_t dropped );
+	// 把重组统计拷贝给其它线程读取
+	void publishStats();
+	int receiveUring();
+	// io_uring 接收出错时回退到 recvmmsg
+	void fallbackFromUring();
+
+	// 收空 socket 中的数据报
+	int receive();
+	// 丢弃超时帧并发出重传请求
+	void tick();
+
+	static void onNack( uint16_t streamId, uint32_t frameId, const uint16_t *indices, int count, void *pPrivData );
+
+	int sockFd;
+	bool ownFd;
+
+	std::vector<unsigned char> slab;
+	std::vector<struct iovec> iovs;
+	std::vector<struct mmsghdr> msgs;
+	std::vector<struct sockaddr_in> addrs;
+	std::vector<char> controls;
+
+	// 最近一个分片的来源, 重传请求发往这里; 只由接收线程写, 其它线程经 sendToPeer 在锁内读取
+	struct sockaddr_in peerAddr;
+	bool hasPeer;
+	pthread_mutex_t peerMutex;
+	int timerId;
+	std::vector<unsigned char> nackBuf;
+
+	FrameReassembler reassembler;
+
+	MessageReceivedFunc msgFunc;
+	void *msgFuncPriv;
+
+	SocketStats sockStats;
+	ReassemblyStats recvStats;	// reassembler 统计的快照
+	pthread_mutex_t statsMutex;	// 保护 sockStats 和 recvStats
+
+	IoUringRecv *uring;
+	EventLoop *loop;
+	int64_t uringNow;
+	int uringBytes;
+
+	pthread_t threadId;
+	volatile bool running;
+};
+
+}
+
+#endif
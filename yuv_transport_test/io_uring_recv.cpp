@@ -0,0 +1,387 @@
+#include "io_uring_recv.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/udp.h>
+#include <linux/io_uring.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#define URING_RECV_TAG 1  // multishot 接收的 user_data
+
+namespace pcs{
+
+IoUringRecv::IoUringRecv() : sockFd(-1),
+				ringFd(-1),
+				sqPtr(MAP_FAILED),
+				sqSize(0),
+				cqPtr(MAP_FAILED),
+				cqSize(0),
+				sqes(NULL),
+				sqesSize(0),
+				toSubmit(0),
+				bufRing(NULL),
+				bufRingSize(0),
+				bufTail(0),
+				bufSize(0),
+				armed(false),
+				dropped(0)
+{
+	memset( &recvHdr, 0, sizeof( recvHdr ) );
+}
+
+IoUringRecv::~IoUringRecv()
+{
+	release();
+}
+
+void IoUringRecv::release()
+{
+	// 关闭 ring fd 时内核会取消挂起的接收并注销缓存
+	if( ringFd >= 0 ){
+		close( ringFd );
+		ringFd = -1;
+	}
+	if( bufRing != NULL ){
+		munmap( bufRing, bufRingSize );
+		bufRing = NULL;
+	}
+	if( sqes != NULL ){
+		munmap( sqes, sqesSize );
+		sqes = NULL;
+	}
+	if( cqPtr != MAP_FAILED && cqPtr != sqPtr ){
+		munmap( cqPtr, cqSize );
+	}
+	cqPtr = MAP_FAILED;
+	if( sqPtr != MAP_FAILED ){
+		munmap( sqPtr, sqSize );
+		sqPtr = MAP_FAILED;
+	}
+	armed = false;
+}
+
+#ifdef IORING_RECV_MULTISHOT
+
+bool IoUringRecv::setupRing()
+{
+	struct io_uring_params params;
+	memset( &params, 0, sizeof( params ) );
+	// 每个完成事件占用一个接收缓存, 完成队列按缓存数分配才不会溢出
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = URING_BUFFER_NUM * 2;
+	ringFd = syscall( __NR_io_uring_setup, URING_QUEUE_DEPTH, &params );
+	if( ringFd < 0 ){
+		std::cerr<<"io_uring is not available: "<<strerror( errno )<<std::endl;
+		return false;
+	}
+
+	sqSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+	cqSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+	if( params.features & IORING_FEAT_SINGLE_MMAP ){
+		if( cqSize > sqSize ){
+			sqSize = cqSize;
+		}
+		cqSize = sqSize;
+	}
+
+	sqPtr = mmap( NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING );
+	if( sqPtr == MAP_FAILED ){
+		std::cerr<<"mmap io_uring sq ring failed ..."<<std::endl;
+		return false;
+	}
+	if( params.features & IORING_FEAT_SINGLE_MMAP ){
+		cqPtr = sqPtr;
+	}
+	else {
+		cqPtr = mmap( NULL, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING );
+		if( cqPtr == MAP_FAILED ){
+			std::cerr<<"mmap io_uring cq ring failed ..."<<std::endl;
+			return false;
+		}
+	}
+
+	sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+	void *ptr = mmap( NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES );
+	if( ptr == MAP_FAILED ){
+		std::cerr<<"mmap io_uring sqes failed ..."<<std::endl;
+		return false;
+	}
+	sqes = (struct io_uring_sqe *)ptr;
+
+	unsigned char *sq = (unsigned char *)sqPtr;
+	sqHead = (unsigned *)( sq + params.sq_off.head );
+	sqTail = (unsigned *)( sq + params.sq_off.tail );
+	sqMask = (unsigned *)( sq + params.sq_off.ring_mask );
+	sqFlags = (unsigned *)( sq + params.sq_off.flags );
+	sqArray = (unsigned *)( sq + params.sq_off.array );
+
+	unsigned char *cq = (unsigned char *)cqPtr;
+	cqHead = (unsigned *)( cq + params.cq_off.head );
+	cqTail = (unsigned *)( cq + params.cq_off.tail );
+	cqMask = (unsigned *)( cq + params.cq_off.ring_mask );
+	cqes = (struct io_uring_cqe *)( cq + params.cq_off.cqes );
+
+	return true;
+}
+
+bool IoUringRecv::probeOps()
+{
+	std::vector<unsigned char> buf( sizeof( struct io_uring_probe ) + 256 * sizeof( struct io_uring_probe_op ), 0 );
+	struct io_uring_probe *probe = (struct io_uring_probe *)&buf[0];
+	if( syscall( __NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, 256 ) < 0 ){
+		std::cerr<<"io_uring probe failed: "<<strerror( errno )<<std::endl;
+		return false;
+	}
+	if( probe->last_op < IORING_OP_RECVMSG || !( probe->ops[IORING_OP_RECVMSG].flags & IO_URING_OP_SUPPORTED ) ){
+		std::cerr<<"io_uring recvmsg is not supported ..."<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool IoUringRecv::setupBuffers()
+{
+	// 缓存布局: io_uring_recvmsg_out + 地址 + 控制消息 + 数据
+	bufSize = sizeof( struct io_uring_recvmsg_out ) + recvHdr.msg_namelen + recvHdr.msg_controllen + MAX_DATAGRAM_SIZE;
+	slab.resize( (size_t)bufSize * URING_BUFFER_NUM );
+
+	// 缓存环必须页对齐, 用匿名映射分配
+	bufRingSize = URING_BUFFER_NUM * sizeof( struct io_uring_buf );
+	void *ptr = mmap( NULL, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if( ptr == MAP_FAILED ){
+		std::cerr<<"mmap io_uring buffer ring failed ..."<<std::endl;
+		return false;
+	}
+	bufRing = (struct io_uring_buf *)ptr;
+
+	struct io_uring_buf_reg reg;
+	memset( &reg, 0, sizeof( reg ) );
+	reg.ring_addr = (unsigned long)bufRing;
+	reg.ring_entries = URING_BUFFER_NUM;
+	reg.bgid = URING_BUFFER_GROUP;
+	if( syscall( __NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1 ) < 0 ){
+		std::cerr<<"io_uring buffer ring is not supported: "<<strerror( errno )<<std::endl;
+		munmap( bufRing, bufRingSize );
+		bufRing = NULL;
+		return false;
+	}
+
+	bufTail = 0;
+	for( int i = 0; i < URING_BUFFER_NUM; i ++ ){
+		recycleBuffer( i );
+	}
+	return true;
+}
+
+void IoUringRecv::recycleBuffer( int bid )
+{
+	// 只写入环中的空位, 由 drain 结束时统一发布尾指针
+	struct io_uring_buf *buf = &bufRing[bufTail & ( URING_BUFFER_NUM - 1 )];
+	buf->addr = (unsigned long)&slab[(size_t)bid * bufSize];
+	buf->len = bufSize;
+	buf->bid = bid;
+	bufTail ++;
+}
+
+bool IoUringRecv::armRecv()
+{
+	unsigned tail = *sqTail;
+	unsigned head = __atomic_load_n( sqHead, __ATOMIC_ACQUIRE );
+	if( tail - head >= URING_QUEUE_DEPTH ){
+		return false;
+	}
+
+	unsigned index = tail & *sqMask;
+	struct io_uring_sqe *sqe = &sqes[index];
+	memset( sqe, 0, sizeof( *sqe ) );
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = sockFd;
+	sqe->addr = (unsigned long)&recvHdr;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUFFER_GROUP;
+	sqe->user_data = URING_RECV_TAG;
+
+	sqArray[index] = index;
+	__atomic_store_n( sqTail, tail + 1, __ATOMIC_RELEASE );
+	toSubmit ++;
+	armed = true;
+	return true;
+}
+
+int IoUringRecv::submit()
+{
+	// 完成队列曾经溢出时, 带 GETEVENTS 进入内核把积压的完成事件搬回队列
+	unsigned flags = 0;
+	if( __atomic_load_n( sqFlags, __ATOMIC_ACQUIRE ) & IORING_SQ_CQ_OVERFLOW ){
+		flags |= IORING_ENTER_GETEVENTS;
+	}
+	if( toSubmit == 0 && flags == 0 ){
+		return 0;
+	}
+
+	int ret = syscall( __NR_io_uring_enter, ringFd, toSubmit, 0, flags, NULL, 0 );
+	if( ret < 0 ){
+		if( errno == EAGAIN || errno == EBUSY || errno == EINTR ){
+			return 0;
+		}
+		std::cerr<<"io_uring_enter failed: "<<strerror( errno )<<std::endl;
+		return -1;
+	}
+	toSubmit -= ret;
+	return ret;
+}
+
+bool IoUringRecv::init( int fd, int ctrlLen )
+{
+	release();
+	sockFd = fd;
+
+	// namelen/controllen 只作为预留长度, 地址由内核写进每个缓存的头部
+	memset( &recvHdr, 0, sizeof( recvHdr ) );
+	recvHdr.msg_namelen = sizeof( struct sockaddr_in );
+	recvHdr.msg_controllen = ctrlLen;
+
+	if( !setupRing() || !probeOps() || !setupBuffers() ){
+		release();
+		return false;
+	}
+	__atomic_store_n( &bufRing[0].resv, bufTail, __ATOMIC_RELEASE );
+
+	if( !armRecv() || submit() < 0 ){
+		release();
+		return false;
+	}
+
+	// 6.0 之前的内核不认识 multishot 标志, 提交时就会返回 -EINVAL 的完成事件
+	unsigned head = *cqHead;
+	unsigned tail = __atomic_load_n( cqTail, __ATOMIC_ACQUIRE );
+	for( ; head != tail; head ++ ){
+		struct io_uring_cqe *cqe = &cqes[head & *cqMask];
+		if( cqe->user_data == URING_RECV_TAG && cqe->res < 0 && !( cqe->flags & IORING_CQE_F_MORE ) ){
+			std::cerr<<"io_uring multishot recvmsg is not supported: "<<strerror( -cqe->res )<<std::endl;
+			release();
+			return false;
+		}
+	}
+	return true;
+}
+
+int IoUringRecv::drain( UringDatagramFunc pFunc, void *pPrivData )
+{
+	if( ringFd < 0 ){
+		return -1;
+	}
+
+	int total = 0;
+	bool failed = false;
+	unsigned head = *cqHead;
+	unsigned tail = __atomic_load_n( cqTail, __ATOMIC_ACQUIRE );
+	for( ; head != tail; head ++ ){
+		struct io_uring_cqe *cqe = &cqes[head & *cqMask];
+		if( cqe->user_data != URING_RECV_TAG ){
+			continue;
+		}
+		if( !( cqe->flags & IORING_CQE_F_MORE ) ){
+			armed = false;
+		}
+
+		if( cqe->res < 0 ){
+			// 缓存用完时内核会停止接收, 归还缓存后重新挂起即可
+			if( cqe->res != -ENOBUFS ){
+				std::cerr<<"io_uring recvmsg error: "<<strerror( -cqe->res )<<std::endl;
+				if( cqe->res == -EINVAL || cqe->res == -EBADF || cqe->res == -ENOTSOCK ){
+					failed = true;
+				}
+			}
+			continue;
+		}
+		if( !( cqe->flags & IORING_CQE_F_BUFFER ) ){
+			continue;
+		}
+
+		int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		unsigned char *buf = &slab[(size_t)bid * bufSize];
+		struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buf;
+		unsigned char *name = buf + sizeof( struct io_uring_recvmsg_out );
+		unsigned char *control = name + recvHdr.msg_namelen;
+		unsigned char *payload = control + recvHdr.msg_controllen;
+
+		if( !( out->flags & MSG_TRUNC ) && (int)out->payloadlen <= cqe->res ){
+			int len = out->payloadlen;
+			int segSize = len;
+
+			// 借用 msghdr 遍历内核写入的控制消息
+			struct msghdr msg;
+			memset( &msg, 0, sizeof( msg ) );
+			msg.msg_control = control;
+			msg.msg_controllen = out->controllen;
+			for( struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg ); cmsg != NULL; cmsg = CMSG_NXTHDR( &msg, cmsg ) ){
+				if( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO ){
+					memcpy( &segSize, CMSG_DATA( cmsg ), sizeof( int ) );
+				}
+			}
+			if( segSize <= 0 ){
+				segSize = len;
+			}
+			parseDropCounter( &msg, dropped );
+
+			struct sockaddr_in from;
+			memcpy( &from, name, sizeof( from ) );
+			pFunc( payload, len, segSize, &from, pPrivData );
+			total ++;
+		}
+		recycleBuffer( bid );
+	}
+	__atomic_store_n( cqHead, head, __ATOMIC_RELEASE );
+	__atomic_store_n( &bufRing[0].resv, bufTail, __ATOMIC_RELEASE );
+
+	if( failed ){
+		return -1;
+	}
+	if( !armed ){
+		armRecv();
+	}
+	if( submit() < 0 ){
+		return -1;
+	}
+	return total;
+}
+
+#else
+
+// 编译用的内核头文件太旧, 没有 multishot 接收, 始终回退到 recvmmsg
+bool IoUringRecv::init( int fd, int ctrlLen )
+{
+	std::cerr<<"io_uring multishot recvmsg is not supported by the kernel headers ..."<<std::endl;
+	return false;
+}
+
+int IoUringRecv::drain( UringDatagramFunc pFunc, void *pPrivData )
+{
+	return -1;
+}
+
+#endif
+
+}
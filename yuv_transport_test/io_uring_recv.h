@@ -0,0 +1,100 @@
+#ifndef __IO_URING_RECV_H_
+#define __IO_URING_RECV_H_
+
+#include <iostream>
+#include <vector>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "frame_protocol.h"
+#include "socket_stats.h"
+
+#define URING_QUEUE_DEPTH 8    // 提交队列长度, 只挂一个 multishot 接收, 够用
+#define URING_BUFFER_NUM 64    // 注册给内核的接收缓存块数, 必须是 2 的幂
+#define URING_BUFFER_GROUP 0   // 接收缓存组号
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf;
+
+namespace pcs{
+
+// 每收到一个数据报回调一次, segSize 为 GRO 超级包中单个分片的长度(未合并时等于 len)
+typedef void (*UringDatagramFunc)( const unsigned char *datagram, int len, int segSize, const struct sockaddr_in *from, void *pPrivData );
+
+/*
+ * io_uring 接收后端: 不依赖 liburing, 直接用系统调用建立提交/完成队列.
+ * 接收缓存以 provided buffer ring 的方式一次性注册给内核, socket 上挂一个 multishot recvmsg,
+ * 内核收到数据报后直接写入缓存并产生完成事件, 用户态收取时不再需要每包一次系统调用.
+ * 内核不支持(< 6.0 或被禁用)时 init 返回 false, 调用者继续使用 recvmmsg.
+ */
+class IoUringRecv
+{
+public:
+	IoUringRecv();
+	~IoUringRecv();
+
+	// 探测内核能力并在 sockFd 上挂起接收, ctrlLen 为每个数据报预留的控制消息长度
+	bool init( int sockFd, int ctrlLen );
+
+	// 完成队列非空时可读, 可以放进 poll/epoll
+	int getFd() const
+	{
+		return ringFd;
+	}
+
+	// 取出所有已完成的数据报, 返回数据报数; 接收被内核终止且无法恢复时返回 -1
+	int drain( UringDatagramFunc pFunc, void *pPrivData );
+
+	// 最近一个数据报带回的内核丢包累计值 (SO_RXQ_OVFL)
+	uint32_t getDropped() const
+	{
+		return dropped;
+	}
+
+private:
+	bool setupRing();
+	bool setupBuffers();
+	bool probeOps();
+	bool armRecv();
+	int submit();
+	void recycleBuffer( int bid );
+	void release();
+
+	int sockFd;
+	int ringFd;
+
+	void *sqPtr;
+	size_t sqSize;
+	void *cqPtr;
+	size_t cqSize;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+
+	unsigned *sqHead;
+	unsigned *sqTail;
+	unsigned *sqMask;
+	unsigned *sqArray;
+	unsigned *sqFlags;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned *cqMask;
+	struct io_uring_cqe *cqes;
+	unsigned toSubmit;
+
+	struct io_uring_buf *bufRing;
+	size_t bufRingSize;
+	uint16_t bufTail;
+	int bufSize;
+	std::vector<unsigned char> slab;
+
+	// multishot recvmsg 的模板, 内核按其中的长度给地址和控制消息留位置
+	struct msghdr recvHdr;
+	bool armed;
+	uint32_t dropped;
+};
+
+}
+
+#endif
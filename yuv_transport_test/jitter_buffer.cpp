@@ -0,0 +1,266 @@
+#include "jitter_buffer.h"
+
+#include <algorithm>
+
+namespace pcs{
+
+JitterBuffer::JitterBuffer( int slotNum ) : minDelayUs((int64_t)JITTER_MIN_DELAY_MS * 1000),
+						maxDelayUs((int64_t)JITTER_MAX_DELAY_MS * 1000),
+						releaseFunc(NULL),
+						releaseFuncPriv(NULL)
+{
+	slots.resize( slotNum );
+	reset();
+}
+
+void JitterBuffer::setDelay( int minDelayMs, int maxDelayMs )
+{
+	if( maxDelayMs < minDelayMs ){
+		maxDelayMs = minDelayMs;
+	}
+	minDelayUs = (int64_t)minDelayMs * 1000;
+	maxDelayUs = (int64_t)maxDelayMs * 1000;
+}
+
+void JitterBuffer::setReleaseCallback( JitterReleaseFunc pFunc, void *pPrivData )
+{
+	releaseFunc = pFunc;
+	releaseFuncPriv = pPrivData;
+}
+
+void JitterBuffer::reset()
+{
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		slots[i].used = false;
+	}
+	streams.clear();
+	transitNum = 0;
+	transitNext = 0;
+	offsetUs = 0;
+	offsetValid = false;
+	memset( &stats, 0, sizeof( stats ) );
+	stats.delayUs = minDelayUs;
+}
+
+void JitterBuffer::updateDelay( int64_t transitUs )
+{
+	transits[transitNext] = transitUs;
+	transitNext = ( transitNext + 1 ) % JITTER_WINDOW;
+	if( transitNum < JITTER_WINDOW ){
+		transitNum ++;
+	}
+
+	int64_t sorted[JITTER_WINDOW];
+	memcpy( sorted, transits, transitNum * sizeof( int64_t ) );
+	std::sort( sorted, sorted + transitNum );
+	int64_t baseUs = sorted[0];
+	int64_t jitterUs = sorted[( transitNum - 1 ) * JITTER_PERCENTILE / 100] - baseUs;
+
+	int64_t delayUs = jitterUs + JITTER_MARGIN_US;
+	delayUs = std::max( minDelayUs, std::min( maxDelayUs, delayUs ) );
+	int64_t targetUs = baseUs + delayUs;
+
+	// 平时逐帧向目标值靠拢, 播放节奏不会突变; 这一帧按当前延时已经迟到时立即跟上, 否则后面的帧都会迟到
+	if( !offsetValid || ( transitUs > offsetUs && targetUs > offsetUs ) ){
+		offsetUs = targetUs;
+		offsetValid = true;
+	}
+	else if( targetUs > offsetUs + JITTER_SLEW_US ){
+		offsetUs += JITTER_SLEW_US;
+	}
+	else if( targetUs < offsetUs - JITTER_SLEW_US ){
+		offsetUs -= JITTER_SLEW_US;
+	}
+	else {
+		offsetUs = targetUs;
+	}
+
+	stats.delayUs = offsetUs - baseUs;
+	stats.jitterUs = jitterUs;
+}
+
+JitterBuffer::Slot* JitterBuffer::acquireSlot( uint16_t streamId )
+{
+	Slot *slot = NULL;
+	Slot *sameStream = NULL;
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		if( !slots[i].used ){
+			return &slots[i];
+		}
+		// 缓冲满时挤掉同一通道最早播放的帧
+		if( slots[i].streamId == streamId && ( sameStream == NULL || slots[i].playoutUs < sameStream->playoutUs ) ){
+			sameStream = &slots[i];
+		}
+		if( slot == NULL || slots[i].playoutUs < slot->playoutUs ){
+			slot = &slots[i];
+		}
+	}
+	if( sameStream != NULL ){
+		slot = sameStream;
+	}
+
+	stats.dropped ++;
+	slot->used = false;
+	return slot;
+}
+
+bool JitterBuffer::hasFrame( uint16_t streamId ) const
+{
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		if( slots[i].used && slots[i].streamId == streamId ){
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JitterBuffer::isRestart( const StreamState &stream, uint32_t frameId, int64_t nowUs ) const
+{
+	// 与 FrameReassembler 相同: 帧号大幅回退, 或者很久没有交出新帧却一直收到旧帧号
+	return (int32_t)( frameId - stream.lastFrameId ) < -FRAME_ID_RESTART_GAP
+		|| nowUs - stream.lastReleaseUs > (int64_t)STREAM_RESTART_MS * 1000;
+}
+
+void JitterBuffer::resetStream( uint16_t streamId )
+{
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		if( slots[i].used && slots[i].streamId == streamId ){
+			slots[i].used = false;
+			stats.dropped ++;
+		}
+	}
+	streams.erase( streamId );
+
+	// 设备重启后采集时钟也可能从头开始, 旧的传输时间不再可比
+	transitNum = 0;
+	transitNext = 0;
+	offsetValid = false;
+	stats.restarts ++;
+}
+
+bool JitterBuffer::push( uint16_t streamId, uint32_t frameId, const unsigned char *data, int size, int64_t senderUs, int64_t arrivalUs )
+{
+	stats.pushed ++;
+
+	// 帧号回绕时按有符号差值比较
+	std::map<uint16_t, StreamState>::iterator it = streams.find( streamId );
+	if( it != streams.end() && it->second.released && (int32_t)( frameId - it->second.lastFrameId ) <= 0 ){
+		if( !isRestart( it->second, frameId, arrivalUs ) ){
+			stats.dropped ++;
+			return false;
+		}
+		resetStream( streamId );
+	}
+	StreamState &stream = streams[streamId];
+
+	int64_t stampUs = ( senderUs >= 0 ) ? senderUs : arrivalUs;
+	if( stream.queued && stampUs > stream.lastStampUs ){
+		int64_t intervalUs = stampUs - stream.lastStampUs;
+		stream.intervalUs = ( stream.intervalUs == 0 ) ? intervalUs : ( stream.intervalUs * 7 + intervalUs ) / 8;
+	}
+	stream.lastStampUs = stampUs;
+	stream.queued = true;
+
+	// 播放延时每帧最多变化 JITTER_SLEW_US, 远小于帧间隔, 乱序到达的帧仍按采集顺序播放
+	int64_t playoutUs;
+	if( senderUs >= 0 ){
+		updateDelay( arrivalUs - senderUs );
+		playoutUs = senderUs + offsetUs;
+	}
+	else {
+		playoutUs = arrivalUs + stats.delayUs;
+	}
+
+	if( playoutUs < arrivalUs ){
+		stats.late ++;
+	}
+
+	Slot *slot = acquireSlot( streamId );
+	slot->used = true;
+	slot->streamId = streamId;
+	slot->frameId = frameId;
+	slot->arrivalUs = arrivalUs;
+	slot->playoutUs = playoutUs;
+	if( (int)slot->data.size() < size ){
+		slot->data.resize( size );
+	}
+	memcpy( &slot->data[0], data, size );
+	slot->size = size;
+	return true;
+}
+
+int JitterBuffer::poll( int64_t nowUs )
+{
+	int released = 0;
+	while( true ){
+		Slot *slot = NULL;
+		for( size_t i = 0; i < slots.size(); i ++ ){
+			if( slots[i].used && slots[i].playoutUs <= nowUs && ( slot == NULL || slots[i].playoutUs < slot->playoutUs ) ){
+				slot = &slots[i];
+			}
+		}
+		if( slot == NULL ){
+			break;
+		}
+		slot->used = false;
+
+		StreamState &stream = streams[slot->streamId];
+		if( stream.released && (int32_t)( slot->frameId - stream.lastFrameId ) <= 0 ){
+			stats.dropped ++;
+			continue;
+		}
+		stream.released = true;
+		stream.lastFrameId = slot->frameId;
+		stream.lastPlayoutUs = slot->playoutUs;
+		stream.lastReleaseUs = nowUs;
+		stream.underrun = false;
+
+		stats.released ++;
+		released ++;
+		if( releaseFunc != NULL ){
+			JitterFrame frame;
+			frame.streamId = slot->streamId;
+			frame.frameId = slot->frameId;
+			frame.data = &slot->data[0];
+			frame.size = slot->size;
+			frame.arrivalUs = slot->arrivalUs;
+			frame.playoutUs = slot->playoutUs;
+			releaseFunc( &frame, releaseFuncPriv );
+		}
+	}
+
+	// 超过 1.5 个帧间隔还没有下一帧可以播放, 记一次欠载, 直到下一帧交出
+	for( std::map<uint16_t, StreamState>::iterator it = streams.begin(); it != streams.end(); ++ it ){
+		StreamState &stream = it->second;
+		if( stream.released && !stream.underrun && stream.intervalUs > 0
+				&& nowUs > stream.lastPlayoutUs + stream.intervalUs * 3 / 2 && !hasFrame( it->first ) ){
+			stream.underrun = true;
+			stats.underruns ++;
+		}
+	}
+	return released;
+}
+
+int64_t JitterBuffer::nextPlayoutUs() const
+{
+	int64_t next = -1;
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		if( slots[i].used && ( next < 0 || slots[i].playoutUs < next ) ){
+			next = slots[i].playoutUs;
+		}
+	}
+	return next;
+}
+
+int JitterBuffer::overdueFrames( int64_t nowUs ) const
+{
+	int count = 0;
+	for( size_t i = 0; i < slots.size(); i ++ ){
+		if( slots[i].used && slots[i].playoutUs <= nowUs ){
+			count ++;
+		}
+	}
+	return count;
+}
+
+}
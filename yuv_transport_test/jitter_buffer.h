@@ -0,0 +1,132 @@
+#ifndef __JITTER_BUFFER_H_
+#define __JITTER_BUFFER_H_
+
+#include <vector>
+#include <map>
+
+#include "frame_protocol.h"
+
+#define JITTER_SLOT_NUM		( 8 * MAX_STREAM_CHANNELS )	// 缓冲的帧数, 每个通道 8 帧, 够 25fps 下最大的播放延时
+#define JITTER_MIN_DELAY_MS	40	// 自适应播放延时的下限, 25fps 下一帧
+#define JITTER_MAX_DELAY_MS	200	// 自适应播放延时的上限
+#define JITTER_WINDOW		256	// 用最近 256 帧的传输时间估计抖动, 25fps 单路约 10 秒
+#define JITTER_PERCENTILE	99	// 播放延时覆盖传输时间的百分位
+#define JITTER_MARGIN_US	5000	// 抖动估计之外再留的余量
+#define JITTER_SLEW_US		1000	// 每收到一帧播放延时最多调整 1 毫秒, 避免画面跳动
+
+namespace pcs{
+
+// 到了播放时刻的一帧, data 只在回调期间有效
+struct JitterFrame
+{
+	uint16_t streamId;
+	uint32_t frameId;
+	const unsigned char *data;
+	int size;
+	int64_t arrivalUs;	// 收全的本地时刻
+	int64_t playoutUs;	// 计划的播放时刻
+};
+
+typedef void (*JitterReleaseFunc)( const JitterFrame *pFrame, void *pPrivData );
+
+struct JitterStats
+{
+	uint32_t pushed;	// 收到的帧数
+	uint32_t released;	// 按时交出的帧数
+	uint32_t late;		// 到达时已过了播放时刻的帧数, 仍然立即交出
+	uint32_t dropped;	// 比已交出的帧还旧, 或缓冲满被挤掉的帧数
+	uint32_t underruns;	// 到了下一帧的播放时刻缓冲中却没有该通道的帧的次数
+	uint32_t restarts;	// 检测到发送端重启(帧号从头开始)的次数
+	int64_t delayUs;	// 当前的播放延时(相对最快到达的帧)
+	int64_t jitterUs;	// 最近窗口内传输时间的 JITTER_PERCENTILE 分位减最小值
+};
+
+/*
+ * 接收端抖动缓冲: 重组好的帧先放进来, 按发送端的采集时刻加上固定的播放延时排定播放时刻,
+ * 再按本地时钟到点交出, 网络抖动不再直接变成画面卡顿, 端到端延时也有确定的上界.
+ * 播放时刻 = 采集时刻 + 最小传输时间 + 播放延时; 最小传输时间取最近窗口内的最小值, 吸收两端时钟的偏差和漂移,
+ * 播放延时在 [minDelay, maxDelay] 内按抖动自适应, 两者相等时为固定延时.
+ * 所有通道共用同一个发送时钟, 多路相机的画面按采集时刻对齐.
+ * 与平台无关, 不加锁, 由显示端在一个线程中调用, 时间均为本地单调时钟的微秒.
+ */
+class JitterBuffer
+{
+public:
+	JitterBuffer( int slotNum = JITTER_SLOT_NUM );
+
+	void setDelay( int minDelayMs, int maxDelayMs );
+
+	void setReleaseCallback( JitterReleaseFunc pFunc, void *pPrivData );
+
+	// senderUs 为设备时钟的采集时刻, 不知道时传 -1, 此时按到达时刻加播放延时播放; 被丢弃时返回 false
+	bool push( uint16_t streamId, uint32_t frameId, const unsigned char *data, int size, int64_t senderUs, int64_t arrivalUs );
+
+	// 交出播放时刻已到的帧并检查欠载, 返回交出的帧数
+	int poll( int64_t nowUs );
+
+	// 最早一帧的播放时刻, 缓冲为空时返回 -1; 调用者据此安排下一次 poll
+	int64_t nextPlayoutUs() const;
+
+	// 播放时刻已过还没交出的帧数, 调用者来不及 poll 时增加
+	int overdueFrames( int64_t nowUs ) const;
+
+	const JitterStats& getStats() const
+	{
+		return stats;
+	}
+
+	void reset();
+
+private:
+	struct Slot
+	{
+		bool used;
+		uint16_t streamId;
+		uint32_t frameId;
+		int64_t arrivalUs;
+		int64_t playoutUs;
+		std::vector<unsigned char> data;
+		int size;
+	};
+
+	struct StreamState
+	{
+		bool released;
+		uint32_t lastFrameId;
+		int64_t lastPlayoutUs;
+		int64_t lastReleaseUs;	// 最近一次交出帧的本地时刻
+		bool queued;		// 已经收到过帧
+		int64_t lastStampUs;
+		int64_t intervalUs;	// 帧间隔的平滑估计
+		bool underrun;		// 本次欠载已经计数
+	};
+
+	void updateDelay( int64_t transitUs );
+	Slot* acquireSlot( uint16_t streamId );
+	bool hasFrame( uint16_t streamId ) const;
+	bool isRestart( const StreamState &stream, uint32_t frameId, int64_t nowUs ) const;
+	void resetStream( uint16_t streamId );
+
+	std::vector<Slot> slots;
+	std::map<uint16_t, StreamState> streams;
+
+	int64_t minDelayUs;
+	int64_t maxDelayUs;
+
+	// 最近的传输时间(到达时刻 - 采集时刻, 含两端时钟偏差)
+	int64_t transits[JITTER_WINDOW];
+	int transitNum;
+	int transitNext;
+	// 当前采用的 最小传输时间 + 播放延时, 逐帧向目标值靠拢
+	int64_t offsetUs;
+	bool offsetValid;
+
+	JitterStats stats;
+
+	JitterReleaseFunc releaseFunc;
+	void *releaseFuncPriv;
+};
+
+}
+
+#endif
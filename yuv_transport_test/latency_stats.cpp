@@ -0,0 +1,176 @@
+#include "latency_stats.h"
+
+#include <stdio.h>
+
+namespace pcs{
+
+LatencyHistogram::LatencyHistogram()
+{
+	buckets.resize( LATENCY_BUCKET_NUM + 1 );
+	reset();
+}
+
+void LatencyHistogram::reset()
+{
+	for( size_t i = 0; i < buckets.size(); i ++ ){
+		buckets[i] = 0;
+	}
+	count = 0;
+	sumUs = 0;
+	maxUs = 0;
+}
+
+void LatencyHistogram::add( int64_t us )
+{
+	// 对时误差可能让很短的阶段算出负值
+	if( us < 0 ){
+		us = 0;
+	}
+
+	int64_t index = us / LATENCY_BUCKET_US;
+	if( index > LATENCY_BUCKET_NUM ){
+		index = LATENCY_BUCKET_NUM;
+	}
+	buckets[index] ++;
+	count ++;
+	sumUs += us;
+	if( us > maxUs ){
+		maxUs = us;
+	}
+}
+
+int64_t LatencyHistogram::percentileUs( double percent ) const
+{
+	if( count == 0 ){
+		return 0;
+	}
+
+	uint32_t target = (uint32_t)( count * percent / 100.0 + 0.5 );
+	if( target == 0 ){
+		target = 1;
+	}
+	uint32_t seen = 0;
+	for( size_t i = 0; i < buckets.size(); i ++ ){
+		seen += buckets[i];
+		if( seen >= target ){
+			// 最后一格没有上界, 用最大值
+			int64_t upper = (int64_t)( i + 1 ) * LATENCY_BUCKET_US;
+			return ( i == buckets.size() - 1 || upper > maxUs ) ? maxUs : upper;
+		}
+	}
+	return maxUs;
+}
+
+int LatencyHistogram::format( char *buf, int size ) const
+{
+	return snprintf( buf, size, "n=%u mean=%.1fms p50=%.1fms p90=%.1fms p99=%.1fms max=%.1fms",
+			count, getMeanUs() / 1000.0, percentileUs( 50 ) / 1000.0, percentileUs( 90 ) / 1000.0,
+			percentileUs( 99 ) / 1000.0, maxUs / 1000.0 );
+}
+
+ClockSync::ClockSync() : sampleNum(0),
+			next(0)
+{
+}
+
+void ClockSync::addSample( const TimeSyncMessage &sync, int64_t t4 )
+{
+	Sample &sample = samples[next];
+	sample.offsetUs = ( ( sync.t2 - sync.t1 ) + ( sync.t3 - t4 ) ) / 2;
+	sample.rttUs = ( t4 - sync.t1 ) - ( sync.t3 - sync.t2 );
+
+	next = ( next + 1 ) % CLOCK_SYNC_WINDOW;
+	if( sampleNum < CLOCK_SYNC_WINDOW ){
+		sampleNum ++;
+	}
+}
+
+const ClockSync::Sample& ClockSync::best() const
+{
+	int index = 0;
+	for( int i = 1; i < sampleNum; i ++ ){
+		if( samples[i].rttUs < samples[index].rttUs ){
+			index = i;
+		}
+	}
+	return samples[index];
+}
+
+int64_t ClockSync::getOffsetUs() const
+{
+	return isValid() ? best().offsetUs : 0;
+}
+
+int64_t ClockSync::getRttUs() const
+{
+	return isValid() ? best().rttUs : 0;
+}
+
+LatencyTracker::LatencyTracker() : pendingNext(0)
+{
+	for( int i = 0; i < LATENCY_PENDING_NUM; i ++ ){
+		pendingValid[i] = false;
+	}
+}
+
+void LatencyTracker::onFrameTiming( const FrameTiming &timing )
+{
+	pending[pendingNext] = timing;
+	pendingValid[pendingNext] = true;
+	pendingNext = ( pendingNext + 1 ) % LATENCY_PENDING_NUM;
+}
+
+void LatencyTracker::onTimeSync( const TimeSyncMessage &sync, int64_t nowUs )
+{
+	clock.addSample( sync, nowUs );
+}
+
+bool LatencyTracker::findTiming( uint16_t streamId, uint32_t frameId, FrameTiming &timing ) const
+{
+	for( int i = 0; i < LATENCY_PENDING_NUM; i ++ ){
+		if( pendingValid[i] && pending[i].streamId == streamId && pending[i].frameId == frameId ){
+			timing = pending[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LatencyTracker::onFrameShown( uint16_t streamId, uint32_t frameId, int64_t recvUs, int64_t shownUs )
+{
+	for( int i = 0; i < LATENCY_PENDING_NUM; i ++ ){
+		if( !pendingValid[i] || pending[i].streamId != streamId || pending[i].frameId != frameId ){
+			continue;
+		}
+		pendingValid[i] = false;
+
+		// 设备内的阶段用同一个时钟, 不需要对时
+		const FrameTiming &timing = pending[i];
+		histograms[LATENCY_DECODE].add( timing.decodedUs - timing.captureUs );
+		histograms[LATENCY_DETECT].add( timing.detectedUs - timing.decodedUs );
+		histograms[LATENCY_QUEUE].add( timing.sendUs - timing.detectedUs );
+		histograms[LATENCY_RENDER].add( shownUs - recvUs );
+		if( !clock.isValid() ){
+			return false;
+		}
+		histograms[LATENCY_NETWORK].add( recvUs - clock.toLocalUs( timing.sendUs ) );
+		histograms[LATENCY_TOTAL].add( shownUs - clock.toLocalUs( timing.captureUs ) );
+		return true;
+	}
+	return false;
+}
+
+void LatencyTracker::reset()
+{
+	for( int i = 0; i < LATENCY_STAGE_NUM; i ++ ){
+		histograms[i].reset();
+	}
+}
+
+const char* LatencyTracker::stageName( int stage )
+{
+	static const char *names[LATENCY_STAGE_NUM] = { "decode", "detect", "queue", "network", "render", "total" };
+	return ( stage >= 0 && stage < LATENCY_STAGE_NUM ) ? names[stage] : "unknown";
+}
+
+}
@@ -0,0 +1,148 @@
+#ifndef __LATENCY_STATS_H_
+#define __LATENCY_STATS_H_
+
+#include <vector>
+
+#include "frame_protocol.h"
+
+#define LATENCY_BUCKET_US	1000	// 直方图每格 1 毫秒
+#define LATENCY_BUCKET_NUM	500	// 超过 500 毫秒的记入最后一格
+#define CLOCK_SYNC_WINDOW	16	// 取最近 16 次对时中往返时间最短的一次
+#define LATENCY_PENDING_NUM	16	// 等待显示的帧时间戳个数
+
+namespace pcs{
+
+/*
+ * 定长分格的延时直方图, 记录次数, 均值, 最大值, 可以按百分位取值(取所在格的上界).
+ */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void add( int64_t us );
+	void reset();
+
+	uint32_t getCount() const
+	{
+		return count;
+	}
+
+	int64_t getMeanUs() const
+	{
+		return ( count == 0 ) ? 0 : sumUs / count;
+	}
+
+	int64_t getMaxUs() const
+	{
+		return maxUs;
+	}
+
+	// percent 取 0 ~ 100
+	int64_t percentileUs( double percent ) const;
+
+	// 格式化为 "n=.. mean=..ms p50=..ms p90=..ms p99=..ms max=..ms", 返回写入的长度
+	int format( char *buf, int size ) const;
+
+private:
+	std::vector<uint32_t> buckets;
+	uint32_t count;
+	int64_t sumUs;
+	int64_t maxUs;
+};
+
+/*
+ * NTP 式的时钟偏差估计: 每次对时得到 offset = ((t2 - t1) + (t3 - t4)) / 2 和往返时间,
+ * 往返时间越短, 来回路径越对称, 偏差越准, 所以取窗口内往返时间最短的一次.
+ */
+class ClockSync
+{
+public:
+	ClockSync();
+
+	// t1/t4 为本地时钟, t2/t3 为设备时钟, 均为微秒
+	void addSample( const TimeSyncMessage &sync, int64_t t4 );
+
+	bool isValid() const
+	{
+		return sampleNum > 0;
+	}
+
+	// 设备时钟减去本地时钟
+	int64_t getOffsetUs() const;
+	int64_t getRttUs() const;
+
+	int64_t toLocalUs( int64_t deviceUs ) const
+	{
+		return deviceUs - getOffsetUs();
+	}
+
+private:
+	struct Sample
+	{
+		int64_t offsetUs;
+		int64_t rttUs;
+	};
+
+	const Sample& best() const;
+
+	Sample samples[CLOCK_SYNC_WINDOW];
+	int sampleNum;
+	int next;
+};
+
+enum LatencyStage
+{
+	LATENCY_DECODE = 0,	// 采集 -> 解码完成
+	LATENCY_DETECT,		// 解码完成 -> 检测完成
+	LATENCY_QUEUE,		// 检测完成 -> 开始发送
+	LATENCY_NETWORK,	// 开始发送 -> 显示端收全
+	LATENCY_RENDER,		// 显示端收全 -> 显示完成, 含抖动缓冲的等待
+	LATENCY_TOTAL,		// 采集 -> 显示完成
+	LATENCY_STAGE_NUM
+};
+
+/*
+ * 端到端延时统计: 设备发来每帧的时间戳, 显示端在显示完成时结合对时结果把各阶段延时记入直方图.
+ * 与平台无关, 不加锁, 由显示端在一个线程中调用.
+ */
+class LatencyTracker
+{
+public:
+	LatencyTracker();
+
+	void onFrameTiming( const FrameTiming &timing );
+	void onTimeSync( const TimeSyncMessage &sync, int64_t nowUs );
+
+	// 查找一帧的时间戳, 不影响之后的 onFrameShown
+	bool findTiming( uint16_t streamId, uint32_t frameId, FrameTiming &timing ) const;
+
+	// recvUs 为收全该帧的本地时刻, shownUs 为显示完成的本地时刻; 没有该帧的时间戳或尚未对时时返回 false
+	bool onFrameShown( uint16_t streamId, uint32_t frameId, int64_t recvUs, int64_t shownUs );
+
+	const LatencyHistogram& getHistogram( int stage ) const
+	{
+		return histograms[stage];
+	}
+
+	const ClockSync& getClockSync() const
+	{
+		return clock;
+	}
+
+	void reset();
+
+	static const char* stageName( int stage );
+
+private:
+	FrameTiming pending[LATENCY_PENDING_NUM];
+	bool pendingValid[LATENCY_PENDING_NUM];
+	int pendingNext;
+
+	ClockSync clock;
+	LatencyHistogram histograms[LATENCY_STAGE_NUM];
+};
+
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include "pacer.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+namespace pcs{
+
+Pacer::Pacer() : rate(0),
+		burst(0),
+		emptyUs(0),
+		windowStartUs(0),
+		windowBytes(0),
+		windowCount(0),
+		windowDelayUs(0),
+		windowMaxDelayUs(0)
+{
+	memset( &stats, 0, sizeof( stats ) );
+	pthread_mutex_init( &mutex, NULL );
+}
+
+Pacer::~Pacer()
+{
+	pthread_mutex_destroy( &mutex );
+}
+
+int64_t Pacer::nowUs()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void Pacer::sleepUntil( int64_t us )
+{
+	struct timespec ts;
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = ( us % 1000000 ) * 1000;
+	while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR );
+}
+
+void Pacer::setRate( int64_t bitsPerSec, int burstBytes )
+{
+	pthread_mutex_lock( &mutex );
+	rate = ( bitsPerSec > 0 ) ? bitsPerSec : 0;
+	burst = ( burstBytes > 0 ) ? burstBytes : 1;
+	emptyUs = 0;
+	stats.rateBps = rate;
+	windowStartUs = nowUs();
+	pthread_mutex_unlock( &mutex );
+}
+
+int64_t Pacer::acquire( int bytes )
+{
+	pthread_mutex_lock( &mutex );
+	if( rate == 0 ){
+		pthread_mutex_unlock( &mutex );
+		return 0;
+	}
+
+	int64_t now = nowUs();
+
+	// 令牌最多累积 burst 字节
+	int64_t burstUs = (int64_t)burst * 8 * 1000000 / rate;
+	if( emptyUs < now - burstUs ){
+		emptyUs = now - burstUs;
+	}
+	emptyUs += (int64_t)bytes * 8 * 1000000 / rate;
+
+	int64_t sendUs = emptyUs;
+	int64_t delayUs = ( sendUs > now ) ? ( sendUs - now ) : 0;
+
+	stats.bytes += bytes;
+	if( delayUs > 0 ){
+		stats.waits ++;
+	}
+	windowBytes += bytes;
+	windowCount ++;
+	windowDelayUs += delayUs;
+	if( delayUs > windowMaxDelayUs ){
+		windowMaxDelayUs = delayUs;
+	}
+	if( now - windowStartUs >= PACER_STATS_WINDOW_MS * 1000 ){
+		stats.achievedBps = windowBytes * 8 * 1000000 / ( now - windowStartUs );
+		stats.avgDelayUs = windowDelayUs / windowCount;
+		stats.maxDelayUs = windowMaxDelayUs;
+		windowStartUs = now;
+		windowBytes = 0;
+		windowCount = 0;
+		windowDelayUs = 0;
+		windowMaxDelayUs = 0;
+	}
+
+	pthread_mutex_unlock( &mutex );
+
+	if( delayUs > 0 ){
+		sleepUntil( sendUs );
+	}
+	return delayUs;
+}
+
+PacerStats Pacer::getStats()
+{
+	pthread_mutex_lock( &mutex );
+	PacerStats ret = stats;
+	pthread_mutex_unlock( &mutex );
+	return ret;
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef __PACER_H_
+#define __PACER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define PACER_STATS_WINDOW_MS 1000  // 实际码率和排队延时的统计窗口
+
+namespace pcs{
+
+struct PacerStats
+{
+	int64_t rateBps;	// 设定码率, 0 表示未开启
+	int64_t achievedBps;	// 上一个统计窗口的实际发送码率
+	uint64_t bytes;		// 累计发送字节数
+	uint32_t waits;		// 因令牌不足而等待的次数
+	int64_t avgDelayUs;	// 上一个统计窗口的平均排队延时
+	int64_t maxDelayUs;	// 上一个统计窗口的最大排队延时
+};
+
+/*
+ * 令牌桶发送节拍器: 令牌按设定码率累积, 最多累积 burst 字节,
+ * 令牌不足时在单调时钟上睡眠到可以发送为止, 使一帧的分片均匀分布在帧间隔内.
+ * 可以被多个发送线程同时调用, 睡眠时不持有锁.
+ */
+class Pacer
+{
+public:
+	Pacer();
+	~Pacer();
+
+	// bitsPerSec 为 0 时关闭
+	void setRate( int64_t bitsPerSec, int burstBytes );
+
+	// 未开启时返回 0
+	int getBurst() const
+	{
+		return ( rate > 0 ) ? burst : 0;
+	}
+
+	// 申请发送 bytes 字节, 返回等待的微秒数
+	int64_t acquire( int bytes );
+
+	PacerStats getStats();
+
+private:
+	static int64_t nowUs();
+	static void sleepUntil( int64_t us );
+
+	int64_t rate;
+	int burst;
+
+	// 令牌桶恰好为空的时刻, 当前令牌数为 ( now - emptyUs ) * rate
+	int64_t emptyUs;
+
+	PacerStats stats;
+	int64_t windowStartUs;
+	uint64_t windowBytes;
+	uint32_t windowCount;
+	int64_t windowDelayUs;
+	int64_t windowMaxDelayUs;
+
+	pthread_mutex_t mutex;
+};
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include "rate_controller.h"
+
+namespace pcs{
+
+// 由高到低, 先降分辨率再降帧率; 25fps 下 1280x720 约 276Mbps, 最低一档约 0.7Mbps
+static const RateLevel rateLevels[] = {
+	{ 1, 1 }, { 1, 2 }, { 2, 1 }, { 2, 2 }, { 4, 1 }, { 4, 2 }, { 4, 3 }, { 4, 5 }, { 4, 8 }, { 4, 12 }, { 4, 25 }
+};
+static const int RATE_LEVEL_NUM = sizeof( rateLevels ) / sizeof( rateLevels[0] );
+
+RateController::RateController() : sourceWidth(1280),
+				sourceHeight(720),
+				sourceFps(25),
+				ceilScale(1),
+				ceilStep(1),
+				level(0),
+				upgradeSinceMs(-1),
+				sentValid(false),
+				lastSentBytes(0),
+				lastSentMs(0),
+				traceFile(NULL)
+{
+	targetKbps = levelKbps( 0 );
+}
+
+void RateController::setSource( int width, int height, int fps )
+{
+	sourceWidth = width;
+	sourceHeight = height;
+	sourceFps = fps;
+	targetKbps = levelKbps( level );
+}
+
+void RateController::setCeiling( int scale, int frameStep )
+{
+	ceilScale = scale;
+	ceilStep = frameStep;
+	if( targetKbps > levelKbps( 0 ) ){
+		targetKbps = levelKbps( 0 );
+	}
+}
+
+void RateController::setTrace( FILE *trace )
+{
+	traceFile = trace;
+}
+
+int RateController::getScale() const
+{
+	return ( rateLevels[level].scale > ceilScale ) ? rateLevels[level].scale : ceilScale;
+}
+
+int RateController::getFrameStep() const
+{
+	return ( rateLevels[level].frameStep > ceilStep ) ? rateLevels[level].frameStep : ceilStep;
+}
+
+uint32_t RateController::levelKbps( int index ) const
+{
+	int scale = ( rateLevels[index].scale > ceilScale ) ? rateLevels[index].scale : ceilScale;
+	int step = ( rateLevels[index].frameStep > ceilStep ) ? rateLevels[index].frameStep : ceilStep;
+	uint64_t frameBits = (uint64_t)rawFrameSize( PIXEL_FORMAT_I420, sourceWidth / scale, sourceHeight / scale ) * 8;
+	return (uint32_t)( frameBits * sourceFps / step / 1000 );
+}
+
+int RateController::chooseLevel() const
+{
+	for( int i = 0; i < RATE_LEVEL_NUM; i ++ ){
+		if( levelKbps( i ) <= targetKbps ){
+			return i;
+		}
+	}
+	return RATE_LEVEL_NUM - 1;
+}
+
+void RateController::writeTraceHeader( FILE *trace )
+{
+	fprintf( trace, "time_ms,stream,seq,recv_kbps,capacity_kbps,loss,target_kbps,sent_kbps,level,width,height,fps\n" );
+	fflush( trace );
+}
+
+bool RateController::onReport( const ReceiverReport &report, int64_t nowMs, uint64_t sentBytes )
+{
+	double loss = report.lossFraction / 65535.0;
+	double target = targetKbps;
+	if( loss > RATE_LOSS_HIGH ){
+		target *= 1.0 - loss / 2;
+	}
+	else if( loss < RATE_LOSS_LOW ){
+		target *= RATE_INCREASE;
+	}
+	if( report.capacityKbps > 0 && target > report.capacityKbps * RATE_CAPACITY_HEADROOM ){
+		target = report.capacityKbps * RATE_CAPACITY_HEADROOM;
+	}
+	// 不超过最高一档, 链路一直很好时目标码率不会无限增长, 变差后能立即降下来
+	if( target > levelKbps( 0 ) ){
+		target = levelKbps( 0 );
+	}
+	if( target < RATE_MIN_KBPS ){
+		target = RATE_MIN_KBPS;
+	}
+	targetKbps = (uint32_t)target;
+
+	// 上限之下相邻几档可能是同一个格式, 只有实际格式变化才需要通知
+	int oldScale = getScale();
+	int oldStep = getFrameStep();
+	int wanted = chooseLevel();
+	if( wanted > level ){
+		level = wanted;
+		upgradeSinceMs = -1;
+	}
+	else if( wanted < level ){
+		if( upgradeSinceMs < 0 ){
+			upgradeSinceMs = nowMs;
+		}
+		else if( nowMs - upgradeSinceMs >= RATE_UPGRADE_HOLD_MS ){
+			// 升到格式不同的上一档
+			while( level > wanted && getScale() == oldScale && getFrameStep() == oldStep ){
+				level --;
+			}
+			upgradeSinceMs = nowMs;
+		}
+	}
+	else {
+		upgradeSinceMs = -1;
+	}
+
+	uint32_t sentKbps = 0;
+	if( sentValid && nowMs > lastSentMs ){
+		sentKbps = (uint32_t)( ( sentBytes - lastSentBytes ) * 8 / ( nowMs - lastSentMs ) );
+	}
+	sentValid = true;
+	lastSentBytes = sentBytes;
+	lastSentMs = nowMs;
+
+	if( traceFile != NULL ){
+		fprintf( traceFile, "%lld,%d,%u,%u,%u,%.4f,%u,%u,%d,%d,%d,%d\n", (long long)nowMs, report.streamId, report.seq,
+			report.recvKbps, report.capacityKbps, loss, targetKbps, sentKbps, level,
+			sourceWidth / getScale(), sourceHeight / getScale(), getFps() );
+		fflush( traceFile );
+	}
+
+	return getScale() != oldScale || getFrameStep() != oldStep;
+}
+
+}
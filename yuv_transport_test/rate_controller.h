@@ -0,0 +1,85 @@
+#ifndef __RATE_CONTROLLER_H_
+#define __RATE_CONTROLLER_H_
+
+#include <stdio.h>
+
+#include "frame_protocol.h"
+
+#define RATE_LOSS_LOW		0.02	// 丢包率低于它时逐步提高目标码率
+#define RATE_LOSS_HIGH		0.10	// 丢包率高于它时按丢包率降低目标码率
+#define RATE_INCREASE		1.08	// 每份接收报告目标码率最多提高 8%
+#define RATE_CAPACITY_HEADROOM	0.85	// 目标码率不超过估计的链路容量的 85%, 给重传和校验分片留余量
+#define RATE_UPGRADE_HOLD_MS	3000	// 目标码率持续够用这么久才升一档, 避免在两档之间来回切换
+#define RATE_MIN_KBPS		300	// 目标码率的下限
+
+namespace pcs{
+
+// 一档发送格式: 相对源图像的缩小倍数和隔帧数
+struct RateLevel
+{
+	int scale;
+	int frameStep;
+};
+
+/*
+ * 发送端码率自适应: 按显示端的接收报告 (链路容量, 丢包率) 调整目标码率,
+ * 再从由高到低排列的档位中选出不超过目标码率的最高一档. 设备只有原始 I420 图像, 没有编码质量可调,
+ * 档位先降分辨率再降帧率. 降档立即生效, 升档须持续 RATE_UPGRADE_HOLD_MS 且每次只升一档.
+ * 与平台无关, 不加锁, 由处理接收报告的线程调用; 时间为毫秒.
+ */
+class RateController
+{
+public:
+	RateController();
+
+	// 源图像的大小和标称帧率, 用于计算每一档的码率
+	void setSource( int width, int height, int fps );
+
+	// 协商得到的格式是上限, 各档位的缩小倍数和隔帧数都不小于它
+	void setCeiling( int scale, int frameStep );
+
+	// trace 不为 NULL 时每份报告记一行 CSV: 估计的容量, 目标码率与实际发送的码率
+	void setTrace( FILE *trace );
+
+	// 处理一份接收报告, sentBytes 为该通道累计发送的图像字节数; 档位变化时返回 true
+	bool onReport( const ReceiverReport &report, int64_t nowMs, uint64_t sentBytes );
+
+	int getScale() const;
+	int getFrameStep() const;
+	int getFps() const
+	{
+		return sourceFps / getFrameStep();
+	}
+	uint32_t getTargetKbps() const
+	{
+		return targetKbps;
+	}
+
+	// 某一档在上限之下的实际码率
+	uint32_t levelKbps( int level ) const;
+
+	static void writeTraceHeader( FILE *trace );
+
+private:
+	int chooseLevel() const;
+
+	int sourceWidth;
+	int sourceHeight;
+	int sourceFps;
+	int ceilScale;
+	int ceilStep;
+
+	int level;
+	uint32_t targetKbps;
+	int64_t upgradeSinceMs;	// 开始允许升档的时间, -1 表示目前不允许
+
+	bool sentValid;
+	uint64_t lastSentBytes;
+	int64_t lastSentMs;
+
+	FILE *traceFile;
+};
+
+}
+
+#endif
@@ -0,0 +1,581 @@
+#ifndef __RESULT_CODEC_H_
+#define __RESULT_CODEC_H_
+
+/*
+ * 检测结果的紧凑编码, 代替直接 memcpy 整个 ObjectTrackEventResult (约 21KB).
+ * 只编码有效的目标, tsr 目标和人脸关键点, 所有多字节字段为大端, 浮点按 IEEE754 位模式传输,
+ * 与结构体的内存布局无关, ARM 设备与 x86 显示端之间可以安全互通.
+ *
+ * 消息以协议公共的 8 字节前缀开头 (type 为 MSG_OBJECT_RESULT, flags 的 bit0 表示带 bsd 报警区域):
+ *  0        8          12          20          24          28              48           52
+ *  +--------+----------+-----------+-----------+-----------+---------------+------------+
+ *  | prefix | frame id | timestamp | event     | main obj  | warn frame id | danger     |
+ *  |        |          | (ms)      | type      | id        | x 5           | level      |
+ *  +--------+----------+-----------+-----------+-----------+---------------+------------+
+ *  52        53         54      55      56        60        61       62       63       64
+ *  +---------+----------+-------+-------+---------+---------+--------+--------+--------+
+ *  | left    | right    | cargo | ver   | sli     | obj num | tsr    | face   | 保留   |
+ *  | line    | line     | type  |       | velo    |         | num    | num    |        |
+ *  +---------+----------+-------+-------+---------+---------+--------+--------+--------+
+ * 之后依次为 obj num 个目标, tsr num 个 tsr 目标 (每个 OBJECT_ENTRY_SIZE 字节),
+ * 带报警区域时的 3 x 4 个点, face num 个人脸关键点 (每个点 x, y 各 2 字节).
+ *
+ * 目标:
+ *  0      4      5      7     9      11       13     17     21      23      25
+ *  +------+------+------+-----+------+--------+------+------+-------+-------+
+ *  | id   | type | left | top | right| bottom | dist | velo | pos x | pos y |
+ *  +------+------+------+-----+------+--------+------+------+-------+-------+
+ * 坐标为像素, 按有符号 16 位传输.
+ *
+ * 显示端用 ObjectResultView 直接在收到的数据报上按需读取字段, 不拷贝.
+ *
+ * 车道线 (DrawPointInfo) 以 MSG_LANE_POINTS 发送, 每条车道线只带有效点, 可先按容差抽稀:
+ *  0        8     9          10
+ *  +--------+-----+----------+---------------------+
+ *  | prefix | ver | lane num | lane x lane num     |
+ *  +--------+-----+----------+---------------------+
+ * 每条车道线:
+ *  0         1           3                   7
+ *  +---------+-----------+-------------------+----------------------------------------+
+ *  | lane id | point num | first point x, y  | (point num - 1) x (dx, dy)             |
+ *  +---------+-----------+-------------------+----------------------------------------+
+ * 第一个点为有符号 16 位的锚点, 之后每个点相对前一个点的差值做 zig-zag 后按 varint 编码
+ * (每字节 7 位, 最高位为 1 表示还有后续字节), 相邻点通常只差几个像素, 一个差值只占 1 字节.
+ * point num 为 0 时后面没有点.
+ *
+ * 设备端和显示端各有一份字段相同的结构体定义, 编码函数写成模板, 两边都能使用.
+ */
+
+#include "frame_protocol.h"
+
+namespace pcs{
+
+#define OBJECT_RESULT_VERSION	1	// 结果编码版本, 字段变化时递增
+
+const int OBJECT_RESULT_HEADER_SIZE = 64;
+const int OBJECT_ENTRY_SIZE = 25;
+const int ALARM_REGION_SIZE = 3 * 4 * 4;
+const int RESULT_POINT_SIZE = 4;
+const int MAX_RESULT_OBJECTS = 255;
+const int MAX_FACE_LANDMARKS = 68;
+// 所有字段取最大值时的编码长度
+const int MAX_OBJECT_RESULT_SIZE = OBJECT_RESULT_HEADER_SIZE + 2 * MAX_RESULT_OBJECTS * OBJECT_ENTRY_SIZE
+					+ ALARM_REGION_SIZE + MAX_FACE_LANDMARKS * RESULT_POINT_SIZE;
+
+#define RESULT_FLAG_ALARM_REGION	0x0001	// 带 bsd 报警区域
+
+#define LANE_POINTS_VERSION	1	// 车道线编码版本
+
+const int LANE_NUM = 4;
+const int MAX_LANE_POINTS = 600;
+const int LANE_POINTS_HEADER_SIZE = 10;
+const int LANE_ENTRY_HEADER_SIZE = 3;
+const int MAX_VARINT_SIZE = 5;
+// 16 位坐标的差值 zig-zag 后不超过 17 位, varint 最多 3 字节
+const int MAX_LANE_DELTA_SIZE = 3;
+const int MAX_LANE_POINTS_SIZE = LANE_POINTS_HEADER_SIZE
+				+ LANE_NUM * ( LANE_ENTRY_HEADER_SIZE + RESULT_POINT_SIZE + ( MAX_LANE_POINTS - 1 ) * 2 * MAX_LANE_DELTA_SIZE );
+
+inline void putF32( unsigned char *p, float v )
+{
+	uint32_t bits;
+	memcpy( &bits, &v, sizeof( bits ) );
+	putU32( p, bits );
+}
+
+inline float getF32( const unsigned char *p )
+{
+	uint32_t bits = getU32( p );
+	float v;
+	memcpy( &v, &bits, sizeof( v ) );
+	return v;
+}
+
+inline int clampI16( int v )
+{
+	if( v > 32767 ){
+		return 32767;
+	}
+	else if( v < -32768 ){
+		return -32768;
+	}
+	return v;
+}
+
+// 像素坐标按有符号 16 位传输, 超出范围的截断
+inline void putI16( unsigned char *p, int v )
+{
+	putU16( p, (uint16_t)(int16_t)clampI16( v ) );
+}
+
+inline int getI16( const unsigned char *p )
+{
+	return (int16_t)getU16( p );
+}
+
+inline int clampCount( int n, int maxNum )
+{
+	return ( n < 0 ) ? 0 : ( ( n > maxNum ) ? maxNum : n );
+}
+
+template <typename ObjectParaT>
+inline unsigned char* encodeObjectEntry( const ObjectParaT &obj, unsigned char *p )
+{
+	putU32( &p[0], (uint32_t)obj.nObjectId );
+	p[4] = (unsigned char)obj.nDetectType;
+	putI16( &p[5], obj.nLeft );
+	putI16( &p[7], obj.nTop );
+	putI16( &p[9], obj.nRight );
+	putI16( &p[11], obj.nBottom );
+	putF32( &p[13], obj.fDist );
+	putF32( &p[17], obj.fVelo );
+	putI16( &p[21], obj.nTargetPosX );
+	putI16( &p[23], obj.nTargetPosY );
+	return p + OBJECT_ENTRY_SIZE;
+}
+
+template <typename PointT>
+inline unsigned char* encodeResultPoints( const PointT *points, int num, unsigned char *p )
+{
+	for( int i = 0; i < num; i ++ ){
+		putI16( &p[0], points[i].x );
+		putI16( &p[2], points[i].y );
+		p += RESULT_POINT_SIZE;
+	}
+	return p;
+}
+
+template <typename PointT>
+inline bool hasAlarmRegion( const PointT *points, int num )
+{
+	for( int i = 0; i < num; i ++ ){
+		if( points[i].x != 0 || points[i].y != 0 ){
+			return true;
+		}
+	}
+	return false;
+}
+
+/* 编码一帧检测结果, out 至少 MAX_OBJECT_RESULT_SIZE 字节, 返回消息长度 */
+template <typename ResultT>
+inline int encodeObjectResult( const ResultT &result, uint16_t streamId, unsigned char *out )
+{
+	int objNum = clampCount( result.nObjectNumber, MAX_RESULT_OBJECTS );
+	int tsrNum = clampCount( result.nTsrObjectNumber, MAX_RESULT_OBJECTS );
+	int faceNum = clampCount( result.nFaceLandMarksNum, MAX_FACE_LANDMARKS );
+	bool alarm = hasAlarmRegion( result.tFirstAlarmPoint, 4 ) || hasAlarmRegion( result.tSecondAlarmPoint, 4 )
+			|| hasAlarmRegion( result.tThirdAlarmPoint, 4 );
+
+	encodeMessagePrefix( MSG_OBJECT_RESULT, streamId, alarm ? RESULT_FLAG_ALARM_REGION : 0, out );
+	putU32( &out[8], (uint32_t)result.nFrameId );
+	putU64( &out[12], (uint64_t)result.lTimeStamp );
+	putU32( &out[20], (uint32_t)result.nEventType );
+	putU32( &out[24], (uint32_t)result.nMainObjectId );
+	for( int i = 0; i < 5; i ++ ){
+		putU32( &out[28 + 4 * i], (uint32_t)result.nWarnFrameId[i] );
+	}
+	putU32( &out[48], (uint32_t)result.nDangerLevel );
+	out[52] = (unsigned char)result.nLeftLineType;
+	out[53] = (unsigned char)result.nRightLineType;
+	out[54] = (unsigned char)result.nCargoType;
+	out[55] = OBJECT_RESULT_VERSION;
+	putF32( &out[56], result.fSliVelo );
+	out[60] = (unsigned char)objNum;
+	out[61] = (unsigned char)tsrNum;
+	out[62] = (unsigned char)faceNum;
+	out[63] = 0;
+
+	unsigned char *p = &out[OBJECT_RESULT_HEADER_SIZE];
+	for( int i = 0; i < objNum; i ++ ){
+		p = encodeObjectEntry( result.objInfo[i], p );
+	}
+	for( int i = 0; i < tsrNum; i ++ ){
+		p = encodeObjectEntry( result.objTsrInfo[i], p );
+	}
+	if( alarm ){
+		p = encodeResultPoints( result.tFirstAlarmPoint, 4, p );
+		p = encodeResultPoints( result.tSecondAlarmPoint, 4, p );
+		p = encodeResultPoints( result.tThirdAlarmPoint, 4, p );
+	}
+	p = encodeResultPoints( result.tFaceLandMarks, faceNum, p );
+	return p - out;
+}
+
+inline uint32_t zigzagEncode( int v )
+{
+	return ( (uint32_t)v << 1 ) ^ (uint32_t)( v >> 31 );
+}
+
+inline int zigzagDecode( uint32_t v )
+{
+	return (int)( v >> 1 ) ^ -(int)( v & 1 );
+}
+
+inline unsigned char* putVarint( unsigned char *p, uint32_t v )
+{
+	while( v >= 0x80 ){
+		*p ++ = (unsigned char)( v | 0x80 );
+		v >>= 7;
+	}
+	*p ++ = (unsigned char)v;
+	return p;
+}
+
+// 数据不完整或超过 5 字节时返回 NULL
+inline const unsigned char* getVarint( const unsigned char *p, const unsigned char *end, uint32_t &v )
+{
+	v = 0;
+	for( int i = 0; i < MAX_VARINT_SIZE && p < end; i ++ ){
+		unsigned char b = *p ++;
+		v |= (uint32_t)( b & 0x7f ) << ( 7 * i );
+		if( ( b & 0x80 ) == 0 ){
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Douglas-Peucker 抽稀: 保留的点连成的折线与原始点的距离都不超过 tolerance 像素.
+ * keep 至少 num 字节, 返回保留的点数; tolerance <= 0 时保留全部.
+ */
+inline int decimateLane( const unsigned int *xs, const unsigned int *ys, int num, float tolerance, unsigned char *keep )
+{
+	if( num <= 2 || tolerance <= 0 ){
+		memset( keep, 1, num );
+		return num;
+	}
+
+	memset( keep, 0, num );
+	keep[0] = 1;
+	keep[num - 1] = 1;
+	int kept = 2;
+
+	// 用栈代替递归, 每个区间最多拆成两个, 栈深度不会超过点数
+	int stack[MAX_LANE_POINTS * 2];
+	int top = 0;
+	stack[top ++] = 0;
+	stack[top ++] = num - 1;
+	double tol2 = (double)tolerance * tolerance;
+	while( top > 0 ){
+		int last = stack[-- top];
+		int first = stack[-- top];
+		double x0 = clampI16( (int)xs[first] ), y0 = clampI16( (int)ys[first] );
+		double dx = clampI16( (int)xs[last] ) - x0, dy = clampI16( (int)ys[last] ) - y0;
+		double len2 = dx * dx + dy * dy;
+
+		// 比较距离的平方乘以线段长度的平方, 省掉开方和除法
+		double maxDist = 0;
+		int maxIdx = -1;
+		for( int i = first + 1; i < last; i ++ ){
+			double px = clampI16( (int)xs[i] ) - x0, py = clampI16( (int)ys[i] ) - y0;
+			double dist;
+			if( len2 > 0 ){
+				double cross = px * dy - py * dx;
+				dist = cross * cross;
+			}
+			else {
+				dist = px * px + py * py;
+			}
+			if( dist > maxDist ){
+				maxDist = dist;
+				maxIdx = i;
+			}
+		}
+
+		if( maxIdx >= 0 && maxDist > tol2 * ( len2 > 0 ? len2 : 1 ) ){
+			keep[maxIdx] = 1;
+			kept ++;
+			stack[top ++] = first;
+			stack[top ++] = maxIdx;
+			stack[top ++] = maxIdx;
+			stack[top ++] = last;
+		}
+	}
+	return kept;
+}
+
+/* 编码一帧车道线, tolerance 为抽稀容差(像素), out 至少 MAX_LANE_POINTS_SIZE 字节, 返回消息长度 */
+template <typename PointInfoT>
+inline int encodeLanePoints( const PointInfoT &info, uint16_t streamId, float tolerance, unsigned char *out )
+{
+	encodeMessagePrefix( MSG_LANE_POINTS, streamId, 0, out );
+	out[8] = LANE_POINTS_VERSION;
+	out[9] = LANE_NUM;
+
+	unsigned char keep[MAX_LANE_POINTS];
+	unsigned char *p = &out[LANE_POINTS_HEADER_SIZE];
+	for( int i = 0; i < LANE_NUM; i ++ ){
+		int num = clampCount( (int)info.nPointCounters[i], MAX_LANE_POINTS );
+		int kept = decimateLane( info.pSrcPointX[i], info.pSrcPointY[i], num, tolerance, keep );
+		p[0] = (unsigned char)(int8_t)info.nLaneID[i];
+		putU16( &p[1], (uint16_t)kept );
+		p += LANE_ENTRY_HEADER_SIZE;
+
+		int lastX = 0, lastY = 0;
+		bool anchor = true;
+		for( int j = 0; j < num; j ++ ){
+			if( !keep[j] ){
+				continue;
+			}
+			int x = clampI16( (int)info.pSrcPointX[i][j] );
+			int y = clampI16( (int)info.pSrcPointY[i][j] );
+			if( anchor ){
+				putI16( &p[0], x );
+				putI16( &p[2], y );
+				p += RESULT_POINT_SIZE;
+				anchor = false;
+			}
+			else {
+				p = putVarint( p, zigzagEncode( x - lastX ) );
+				p = putVarint( p, zigzagEncode( y - lastY ) );
+			}
+			lastX = x;
+			lastY = y;
+		}
+	}
+	return p - out;
+}
+
+struct ResultObject
+{
+	int32_t id;
+	int type;
+	int left;
+	int top;
+	int right;
+	int bottom;
+	float dist;
+	float velo;
+	int posX;
+	int posY;
+};
+
+struct ResultPoint
+{
+	int x;
+	int y;
+};
+
+/*
+ * 在收到的数据报上直接读取检测结果, 数据报需在使用期间保持有效.
+ */
+class ObjectResultView
+{
+public:
+	ObjectResultView() : data(NULL),
+				objNum(0),
+				tsrNum(0),
+				faceNum(0),
+				alarm(false)
+	{
+	}
+
+	// 校验版本和长度, 不是合法的结果消息时返回 false
+	bool parse( const unsigned char *in, int len )
+	{
+		data = NULL;
+		if( len < OBJECT_RESULT_HEADER_SIZE || peekMessageType( in, len ) != MSG_OBJECT_RESULT || in[55] != OBJECT_RESULT_VERSION ){
+			return false;
+		}
+
+		objNum = in[60];
+		tsrNum = in[61];
+		faceNum = in[62];
+		alarm = ( getU16( &in[6] ) & RESULT_FLAG_ALARM_REGION ) != 0;
+		if( faceNum > MAX_FACE_LANDMARKS ){
+			return false;
+		}
+
+		int need = OBJECT_RESULT_HEADER_SIZE + ( objNum + tsrNum ) * OBJECT_ENTRY_SIZE + ( alarm ? ALARM_REGION_SIZE : 0 )
+				+ faceNum * RESULT_POINT_SIZE;
+		if( len < need ){
+			return false;
+		}
+		data = in;
+		return true;
+	}
+
+	uint16_t streamId() const
+	{
+		return getU16( &data[4] );
+	}
+	int frameId() const
+	{
+		return (int32_t)getU32( &data[8] );
+	}
+	int64_t timeStamp() const
+	{
+		return (int64_t)getU64( &data[12] );
+	}
+	uint32_t eventType() const
+	{
+		return getU32( &data[20] );
+	}
+	int mainObjectId() const
+	{
+		return (int32_t)getU32( &data[24] );
+	}
+	int warnFrameId( int i ) const
+	{
+		return (int32_t)getU32( &data[28 + 4 * i] );
+	}
+	int dangerLevel() const
+	{
+		return (int32_t)getU32( &data[48] );
+	}
+	int leftLineType() const
+	{
+		return data[52];
+	}
+	int rightLineType() const
+	{
+		return data[53];
+	}
+	int cargoType() const
+	{
+		return data[54];
+	}
+
+	float sliVelo() const
+	{
+		return getF32( &data[56] );
+	}
+
+	int objectNumber() const
+	{
+		return objNum;
+	}
+	int tsrObjectNumber() const
+	{
+		return tsrNum;
+	}
+	int faceLandMarksNum() const
+	{
+		return faceNum;
+	}
+	bool hasAlarmRegion() const
+	{
+		return alarm;
+	}
+
+	ResultObject object( int i ) const
+	{
+		return readObject( &data[OBJECT_RESULT_HEADER_SIZE + i * OBJECT_ENTRY_SIZE] );
+	}
+
+	ResultObject tsrObject( int i ) const
+	{
+		return readObject( &data[OBJECT_RESULT_HEADER_SIZE + ( objNum + i ) * OBJECT_ENTRY_SIZE] );
+	}
+
+	// level 为 0 ~ 2 (一级 ~ 三级), i 为 0 ~ 3; 不带报警区域时为 (0, 0)
+	ResultPoint alarmPoint( int level, int i ) const
+	{
+		ResultPoint pt = { 0, 0 };
+		if( alarm ){
+			pt = readPoint( &data[pointsOffset() + ( level * 4 + i ) * RESULT_POINT_SIZE] );
+		}
+		return pt;
+	}
+
+	ResultPoint faceLandMark( int i ) const
+	{
+		return readPoint( &data[pointsOffset() + ( alarm ? ALARM_REGION_SIZE : 0 ) + i * RESULT_POINT_SIZE] );
+	}
+
+private:
+	int pointsOffset() const
+	{
+		return OBJECT_RESULT_HEADER_SIZE + ( objNum + tsrNum ) * OBJECT_ENTRY_SIZE;
+	}
+
+	static ResultObject readObject( const unsigned char *p )
+	{
+		ResultObject obj;
+		obj.id = (int32_t)getU32( &p[0] );
+		obj.type = p[4];
+		obj.left = getI16( &p[5] );
+		obj.top = getI16( &p[7] );
+		obj.right = getI16( &p[9] );
+		obj.bottom = getI16( &p[11] );
+		obj.dist = getF32( &p[13] );
+		obj.velo = getF32( &p[17] );
+		obj.posX = getI16( &p[21] );
+		obj.posY = getI16( &p[23] );
+		return obj;
+	}
+
+	static ResultPoint readPoint( const unsigned char *p )
+	{
+		ResultPoint pt;
+		pt.x = getI16( &p[0] );
+		pt.y = getI16( &p[2] );
+		return pt;
+	}
+
+	const unsigned char *data;
+	int objNum;
+	int tsrNum;
+	int faceNum;
+	bool alarm;
+};
+
+struct LanePoints
+{
+	int laneNum;
+	int laneId[LANE_NUM];	// -1 表示不存在此车道线
+	int pointNum[LANE_NUM];
+	ResultPoint points[LANE_NUM][MAX_LANE_POINTS];
+};
+
+// 解码车道线, 不是合法的车道线消息或数据不完整时返回 false
+inline bool decodeLanePoints( const unsigned char *in, int len, LanePoints &lanes )
+{
+	if( len < LANE_POINTS_HEADER_SIZE || peekMessageType( in, len ) != MSG_LANE_POINTS || in[8] != LANE_POINTS_VERSION || in[9] > LANE_NUM ){
+		return false;
+	}
+
+	const unsigned char *p = &in[LANE_POINTS_HEADER_SIZE];
+	const unsigned char *end = in + len;
+	lanes.laneNum = in[9];
+	for( int i = 0; i < lanes.laneNum; i ++ ){
+		if( end - p < LANE_ENTRY_HEADER_SIZE ){
+			return false;
+		}
+		lanes.laneId[i] = (int8_t)p[0];
+		int num = getU16( &p[1] );
+		p += LANE_ENTRY_HEADER_SIZE;
+		if( num > MAX_LANE_POINTS ){
+			return false;
+		}
+		lanes.pointNum[i] = num;
+		if( num == 0 ){
+			continue;
+		}
+
+		if( end - p < RESULT_POINT_SIZE ){
+			return false;
+		}
+		int x = getI16( &p[0] );
+		int y = getI16( &p[2] );
+		p += RESULT_POINT_SIZE;
+		lanes.points[i][0].x = x;
+		lanes.points[i][0].y = y;
+		for( int j = 1; j < num; j ++ ){
+			uint32_t dx, dy;
+			if( ( p = getVarint( p, end, dx ) ) == NULL || ( p = getVarint( p, end, dy ) ) == NULL ){
+				return false;
+			}
+			x += zigzagDecode( dx );
+			y += zigzagDecode( dy );
+			lanes.points[i][j].x = x;
+			lanes.points[i][j].y = y;
+		}
+	}
+	return true;
+}
+
+}
+
+#endif
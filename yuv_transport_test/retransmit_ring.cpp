@@ -0,0 +1,108 @@
+#include "retransmit_ring.h"
+
+namespace pcs{
+
+RetransmitRing::RetransmitRing( int slotNum, int deadlineMs ) : next(0),
+								deadline(deadlineMs)
+{
+	entries.resize( slotNum );
+	for( size_t i = 0; i < entries.size(); i ++ ){
+		entries[i].used = false;
+		entries[i].sending = false;
+	}
+	memset( &stats, 0, sizeof( stats ) );
+	pthread_mutex_init( &mutex, NULL );
+}
+
+RetransmitRing::~RetransmitRing()
+{
+	pthread_mutex_destroy( &mutex );
+}
+
+void RetransmitRing::store( const FragmentHeader &header, std::vector<unsigned char> &frame, int fragSize, int64_t nowMs )
+{
+	pthread_mutex_lock( &mutex );
+
+	// 跳过正在重传的帧; 都在重传时不保存这一帧, 它丢了分片也不再重传
+	size_t skipped = 0;
+	while( entries[next].sending && skipped < entries.size() ){
+		next = ( next + 1 ) % entries.size();
+		skipped ++;
+	}
+	if( skipped == entries.size() ){
+		pthread_mutex_unlock( &mutex );
+		return;
+	}
+
+	FrameEntry &entry = entries[next];
+	next = ( next + 1 ) % entries.size();
+
+	entry.used = true;
+	entry.header = header;
+	entry.size = frame.size();
+	entry.fragSize = fragSize;
+	entry.sentMs = nowMs;
+	// 调用者的帧缓存之后会装下一帧, 直接接管它, 把最旧一帧的缓存还给调用者
+	entry.data.swap( frame );
+
+	pthread_mutex_unlock( &mutex );
+}
+
+int RetransmitRing::handleNack( const unsigned char *msg, int len, int64_t nowMs, Transport *transport, int fd, struct sockaddr_in &from )
+{
+	NackMessage nack;
+	if( !decodeNack( msg, len, nack ) ){
+		return -1;
+	}
+
+	pthread_mutex_lock( &mutex );
+	stats.nacks ++;
+
+	FrameEntry *entry = NULL;
+	for( size_t i = 0; i < entries.size(); i ++ ){
+		if( entries[i].used && entries[i].header.streamId == nack.streamId && entries[i].header.frameId == nack.frameId ){
+			entry = &entries[i];
+			break;
+		}
+	}
+	if( entry == NULL || nowMs - entry->sentMs > deadline ){
+		stats.stale ++;
+		pthread_mutex_unlock( &mutex );
+		return 0;
+	}
+	if( nack.count == 0 || entry->sending ){
+		pthread_mutex_unlock( &mutex );
+		return 0;
+	}
+
+	// 标记后放开锁再发送, 发送期间 store 不会替换这一帧的缓存
+	entry->sending = true;
+	FragmentHeader header = entry->header;
+	header.flags |= FRAG_FLAG_RETRANSMIT;
+	const unsigned char *data = &entry->data[0];
+	int size = entry->size;
+	int fragSize = entry->fragSize;
+	pthread_mutex_unlock( &mutex );
+
+	uint16_t indices[MAX_NACK_INDICES];
+	for( int i = 0; i < nack.count; i ++ ){
+		indices[i] = nackIndex( nack, i );
+	}
+	int sent = transport->writeFragments( fd, data, size, fragSize, header, indices, nack.count, from );
+
+	pthread_mutex_lock( &mutex );
+	entry->sending = false;
+	stats.resent += sent;
+	pthread_mutex_unlock( &mutex );
+	return sent;
+}
+
+RetransmitStats RetransmitRing::getStats()
+{
+	pthread_mutex_lock( &mutex );
+	RetransmitStats ret = stats;
+	pthread_mutex_unlock( &mutex );
+	return ret;
+}
+
+}
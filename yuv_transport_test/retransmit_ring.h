@@ -0,0 +1,66 @@
+#ifndef __RETRANSMIT_RING_H_
+#define __RETRANSMIT_RING_H_
+
+#include <vector>
+#include <pthread.h>
+
+#include "transport.h"
+#include "frame_protocol.h"
+
+#define RETRANSMIT_RING_SIZE	8	// 保留最近发送的帧数
+#define RETRANSMIT_DEADLINE_MS	160	// 发送超过该时间的帧不再重传, 显示端早已放弃
+
+namespace pcs{
+
+struct RetransmitStats
+{
+	uint32_t nacks;		// 收到的重传请求数
+	uint32_t resent;	// 重传的分片数
+	uint32_t stale;		// 因帧已过期或已被覆盖而忽略的请求数
+};
+
+/*
+ * 发送端重传环: 保存最近 RETRANSMIT_RING_SIZE 帧的副本,
+ * 收到显示端的 MSG_NACK 后只把请求的数据分片重发给请求方.
+ * store 与 handleNack 可以在不同线程中调用. 重传时不持锁, 只把该帧标记为正在重传,
+ * store 跳过它写入下一个位置, 大的重传请求经过节拍器等待时不会推迟新帧的发送.
+ */
+class RetransmitRing
+{
+public:
+	RetransmitRing( int slotNum = RETRANSMIT_RING_SIZE, int deadlineMs = RETRANSMIT_DEADLINE_MS );
+	~RetransmitRing();
+
+	// 保存刚发送的一帧, header 与传给 writeFrame 的相同; 帧缓存与环中被替换的旧缓存交换, 不做拷贝,
+	// 返回时 frame 中是旧缓存, 内容无意义, 调用者可以复用它的容量
+	void store( const FragmentHeader &header, std::vector<unsigned char> &frame, int fragSize, int64_t nowMs );
+
+	// 处理一个重传请求数据报, 返回重传的分片数, 不是有效请求时返回 -1
+	int handleNack( const unsigned char *msg, int len, int64_t nowMs, Transport *transport, int fd, struct sockaddr_in &from );
+
+	RetransmitStats getStats();
+
+private:
+	struct FrameEntry
+	{
+		bool used;
+		FragmentHeader header;
+		int size;
+		int fragSize;
+		int64_t sentMs;
+		bool sending;		// handleNack 正在重传, 不能被 store 替换
+		std::vector<unsigned char> data;
+	};
+
+	std::vector<FrameEntry> entries;
+	int next;
+	int deadline;
+
+	RetransmitStats stats;
+
+	pthread_mutex_t mutex;
+};
+
+}
+
+#endif
@@ -0,0 +1,418 @@
+#include "rtp_sender.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+
+namespace pcs{
+
+// NTP 时间从 1900 年开始, Unix 时间从 1970 年开始
+static const uint64_t NTP_UNIX_OFFSET = 2208988800ULL;
+
+RtpSender::RtpSender() : fd(-1),
+			multicast(false),
+			multicastTtl(1),
+			width(0),
+			height(0),
+			fps(25),
+			lastReportUs(0),
+			pacer(NULL),
+			queue(RTP_SEND_QUEUE_DEPTH),
+			running(false)
+{
+	memset( &rtpAddr, 0, sizeof( rtpAddr ) );
+	memset( &rtcpAddr, 0, sizeof( rtcpAddr ) );
+	memset( &sendStats, 0, sizeof( sendStats ) );
+	memset( &stats, 0, sizeof( stats ) );
+
+	pthread_mutex_init( &mutex, NULL );
+
+	maxPacketSize = DEFAULT_PATH_MTU - IPV4_UDP_HEADER_SIZE;
+	packets.resize( RTP_BATCH_SIZE * maxPacketSize );
+	packetSizes.resize( RTP_BATCH_SIZE );
+
+	// SSRC 和起始序号, 起始时间戳按 RFC 3550 取随机值
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	srand( (unsigned int)( tv.tv_sec ^ tv.tv_usec ^ getpid() ) );
+	ssrc = ( (uint32_t)rand() << 16 ) ^ (uint32_t)rand();
+	seq = (uint32_t)rand() & 0xffff;
+	timestampBase = ( (uint32_t)rand() << 16 ) ^ (uint32_t)rand();
+}
+
+RtpSender::~RtpSender()
+{
+	stop();
+	pthread_mutex_destroy( &mutex );
+	if( fd >= 0 ){
+		close( fd );
+	}
+}
+
+int64_t RtpSender::monotonicUs()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool RtpSender::init( const char *destIp, int port, int ttl, const char *ifaceIp )
+{
+	if( port <= 0 || ( port & 1 ) ){
+		std::cerr<<"rtp port must be even: "<<port<<std::endl;
+		return false;
+	}
+
+	rtpAddr.sin_family = AF_INET;
+	if( inet_pton( AF_INET, destIp, &rtpAddr.sin_addr ) != 1 ){
+		std::cerr<<"invalid rtp dest address: "<<destIp<<std::endl;
+		return false;
+	}
+	rtpAddr.sin_port = htons( port );
+	rtcpAddr = rtpAddr;
+	rtcpAddr.sin_port = htons( port + 1 );
+	multicast = IN_MULTICAST( ntohl( rtpAddr.sin_addr.s_addr ) );
+	multicastTtl = ttl;
+
+	fd = socket( AF_INET, SOCK_DGRAM, 0 );
+	if( fd < 0 ){
+		std::cerr<<"socket rtp failed ..."<<std::endl;
+		return false;
+	}
+
+	// 一帧上千个包, 加大发送缓存以容纳突发
+	int sndBuf = 4 * 1024 * 1024;
+	setsockopt( fd, SOL_SOCKET, SO_SNDBUF, &sndBuf, sizeof( sndBuf ) );
+	if( multicast ){
+		unsigned char value = ttl;
+		if( setsockopt( fd, IPPROTO_IP, IP_MULTICAST_TTL, &value, sizeof( value ) ) < 0 ){
+			std::cerr<<"set IP_MULTICAST_TTL failed ..."<<std::endl;
+		}
+		// 与 TransportUDP::setMulticast 一致, 多网卡时从指定的网卡发出
+		if( ifaceIp != NULL ){
+			struct in_addr iface;
+			iface.s_addr = inet_addr( ifaceIp );
+			if( setsockopt( fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof( iface ) ) < 0 ){
+				std::cerr<<"set IP_MULTICAST_IF failed ..."<<std::endl;
+			}
+		}
+	}
+	return true;
+}
+
+void RtpSender::setFormat( int width, int height, int fps )
+{
+	this->width = width;
+	this->height = height;
+	this->fps = fps;
+}
+
+void RtpSender::setPacer( Pacer *pacer )
+{
+	this->pacer = pacer;
+}
+
+bool RtpSender::writeSdp( const char *path, const char *sessionName )
+{
+	FILE *fp = fopen( path, "w" );
+	if( fp == NULL ){
+		std::cerr<<"can not write sdp: "<<path<<std::endl;
+		return false;
+	}
+
+	char destIp[INET_ADDRSTRLEN];
+	inet_ntop( AF_INET, &rtpAddr.sin_addr, destIp, sizeof( destIp ) );
+	fprintf( fp, "v=0\r\n" );
+	fprintf( fp, "o=- %u 1 IN IP4 0.0.0.0\r\n", ssrc );
+	fprintf( fp, "s=%s\r\n", sessionName );
+	if( multicast ){
+		fprintf( fp, "c=IN IP4 %s/%d\r\n", destIp, multicastTtl );
+	}
+	else {
+		fprintf( fp, "c=IN IP4 %s\r\n", destIp );
+	}
+	fprintf( fp, "t=0 0\r\n" );
+	fprintf( fp, "m=video %d RTP/AVP %d\r\n", ntohs( rtpAddr.sin_port ), RTP_PAYLOAD_TYPE );
+	fprintf( fp, "a=rtpmap:%d raw/%d\r\n", RTP_PAYLOAD_TYPE, RTP_CLOCK_RATE );
+	fprintf( fp, "a=fmtp:%d sampling=YCbCr-4:2:0; width=%d; height=%d; depth=8; colorimetry=BT601-5; exactframerate=%d\r\n",
+		RTP_PAYLOAD_TYPE, width, height, fps );
+	fprintf( fp, "a=framerate:%d\r\n", fps );
+	fprintf( fp, "a=recvonly\r\n" );
+	fclose( fp );
+	return true;
+}
+
+uint32_t RtpSender::rtpTimestamp( int64_t monotonicUs ) const
+{
+	return timestampBase + (uint32_t)( (uint64_t)monotonicUs * ( RTP_CLOCK_RATE / 1000 ) / 1000 );
+}
+
+/*
+ * RFC 4175 负载: 2 字节扩展序号, 若干 6 字节行段头 (长度, F|行号, C|像素偏移), 之后依次是各行段的 pgroup.
+ * 4:2:0 的 pgroup 为 Y00 Y01 Y10 Y11 Cb Cr, 行号为两行中的第一行.
+ */
+int RtpSender::buildPacket( unsigned char *out, const unsigned char *frame, int &line, int &byteOffset, uint32_t timestamp )
+{
+	const int pgroupSize = 6;
+	const int lineBytes = width * 3;	// 每两行 width / 2 个 pgroup
+
+	Segment segments[RTP_MAX_SEGMENTS];
+	int segmentNum = 0;
+	int room = maxPacketSize - RTP_HEADER_SIZE - 2;
+	while( line < height && segmentNum < RTP_MAX_SEGMENTS && room >= 6 + pgroupSize ){
+		room -= 6;
+		int length = lineBytes - byteOffset;
+		if( length > room / pgroupSize * pgroupSize ){
+			length = room / pgroupSize * pgroupSize;
+		}
+		segments[segmentNum].line = line;
+		segments[segmentNum].pixelOffset = byteOffset / pgroupSize * 2;
+		segments[segmentNum].length = length;
+		segmentNum ++;
+		room -= length;
+
+		byteOffset += length;
+		if( byteOffset >= lineBytes ){
+			byteOffset = 0;
+			line += 2;
+		}
+	}
+
+	bool lastPacket = ( line >= height );
+	out[0] = 0x80;
+	out[1] = RTP_PAYLOAD_TYPE | ( lastPacket ? 0x80 : 0 );
+	putU16( &out[2], (uint16_t)seq );
+	putU32( &out[4], timestamp );
+	putU32( &out[8], ssrc );
+	putU16( &out[12], (uint16_t)( seq >> 16 ) );
+	seq ++;
+
+	unsigned char *p = &out[RTP_HEADER_SIZE + 2];
+	for( int i = 0; i < segmentNum; i ++ ){
+		putU16( &p[0], segments[i].length );
+		putU16( &p[2], segments[i].line & 0x7fff );
+		putU16( &p[4], ( segments[i].pixelOffset & 0x7fff ) | ( ( i + 1 < segmentNum ) ? 0x8000 : 0 ) );
+		p += 6;
+	}
+
+	const unsigned char *yPlane = frame;
+	const unsigned char *uPlane = frame + width * height;
+	const unsigned char *vPlane = uPlane + width * height / 4;
+	for( int i = 0; i < segmentNum; i ++ ){
+		int y = segments[i].line;
+		int x = segments[i].pixelOffset;
+		const unsigned char *y0 = yPlane + y * width + x;
+		const unsigned char *y1 = y0 + width;
+		const unsigned char *u = uPlane + ( y / 2 ) * ( width / 2 ) + x / 2;
+		const unsigned char *v = vPlane + ( y / 2 ) * ( width / 2 ) + x / 2;
+		int pgroups = segments[i].length / pgroupSize;
+		for( int k = 0; k < pgroups; k ++ ){
+			p[0] = y0[0];
+			p[1] = y0[1];
+			p[2] = y1[0];
+			p[3] = y1[1];
+			p[4] = *u ++;
+			p[5] = *v ++;
+			y0 += 2;
+			y1 += 2;
+			p += pgroupSize;
+		}
+	}
+
+	int size = p - out;
+	sendStats.packets ++;
+	sendStats.octets += size - RTP_HEADER_SIZE;
+	return size;
+}
+
+bool RtpSender::flush( int num )
+{
+	struct mmsghdr msgs[RTP_BATCH_SIZE];
+	struct iovec iovs[RTP_BATCH_SIZE];
+	memset( msgs, 0, sizeof( msgs ) );
+	int bytes = 0;
+	for( int i = 0; i < num; i ++ ){
+		iovs[i].iov_base = &packets[i * maxPacketSize];
+		iovs[i].iov_len = packetSizes[i];
+		msgs[i].msg_hdr.msg_name = &rtpAddr;
+		msgs[i].msg_hdr.msg_namelen = sizeof( rtpAddr );
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		bytes += packetSizes[i];
+	}
+	if( pacer != NULL ){
+		pacer->acquire( bytes );
+	}
+
+	int done = 0;
+	while( done < num ){
+		int ret = sendmmsg( fd, &msgs[done], num - done, 0 );
+		if( ret <= 0 ){
+			std::cerr<<"send rtp falied ..."<<std::endl;
+			return false;
+		}
+		done += ret;
+	}
+	return true;
+}
+
+int RtpSender::sendFrame( const unsigned char *frame, int size, int64_t captureUs )
+{
+	if( fd < 0 ){
+		return -1;
+	}
+	if( size != (int)rawFrameSize( PIXEL_FORMAT_I420, width, height ) ){
+		std::cerr<<"invalid rtp frame size: "<<size<<std::endl;
+		return -1;
+	}
+
+	int64_t nowUs = monotonicUs();
+	if( sendStats.frames == 0 || nowUs - lastReportUs >= (int64_t)RTCP_INTERVAL_MS * 1000 ){
+		sendReport( nowUs );
+	}
+
+	uint32_t timestamp = rtpTimestamp( captureUs );
+	int line = 0;
+	int byteOffset = 0;
+	int sent = 0;
+	while( line < height ){
+		int num = 0;
+		while( num < RTP_BATCH_SIZE && line < height ){
+			packetSizes[num] = buildPacket( &packets[num * maxPacketSize], frame, line, byteOffset, timestamp );
+			num ++;
+		}
+		if( !flush( num ) ){
+			return -1;
+		}
+		sent += num;
+	}
+
+	sendStats.frames ++;
+	return sent;
+}
+
+bool RtpSender::start()
+{
+	if( running ){
+		return true;
+	}
+
+	running = true;
+	queue.open();
+	if( pthread_create( &threadId, NULL, sendThread, this ) != 0 ){
+		std::cerr<<"pthread_create rtp sendThread error ..."<<std::endl;
+		running = false;
+		return false;
+	}
+	return true;
+}
+
+void RtpSender::stop()
+{
+	pthread_mutex_lock( &mutex );
+	if( !running ){
+		pthread_mutex_unlock( &mutex );
+		return;
+	}
+	running = false;
+	pthread_mutex_unlock( &mutex );
+
+	queue.close();
+	pthread_join( threadId, NULL );
+}
+
+void RtpSender::submit( const unsigned char *frame, int size, int64_t captureUs )
+{
+	// 只有一个通道, 队列满时挤掉最旧的帧
+	FrameItem *item = queue.acquire( 0 );
+	if( item == NULL ){
+		return;
+	}
+	item->data.assign( frame, frame + size );
+	item->captureUs = captureUs;
+	queue.push( item, 0 );
+}
+
+void* RtpSender::sendThread( void *pArg )
+{
+	RtpSender *sender = (RtpSender *)pArg;
+	while( true ){
+		FrameItem *item = sender->queue.pop();
+		if( item == NULL ){
+			break;
+		}
+
+		sender->sendFrame( &item->data[0], item->data.size(), item->captureUs );
+		sender->queue.release( item );
+
+		pthread_mutex_lock( &sender->mutex );
+		sender->stats.frames = sender->sendStats.frames;
+		sender->stats.packets = sender->sendStats.packets;
+		sender->stats.octets = sender->sendStats.octets;
+		sender->stats.reports = sender->sendStats.reports;
+		pthread_mutex_unlock( &sender->mutex );
+	}
+	return NULL;
+}
+
+RtpStats RtpSender::getStats()
+{
+	FrameQueueStats queueStats = queue.getStats();
+	pthread_mutex_lock( &mutex );
+	RtpStats ret = stats;
+	pthread_mutex_unlock( &mutex );
+	ret.enqueued = queueStats.enqueued;
+	ret.dropped = queueStats.dropped;
+	return ret;
+}
+
+/*
+ * RTCP 复合包: 发送端报告 (RFC 3550 6.4.1) 后接只含 CNAME 的 SDES.
+ * 报告中的 NTP 时间与 RTP 时间戳取同一时刻, 接收端据此把各帧的 RTP 时间戳对齐到设备的墙上时钟.
+ */
+void RtpSender::sendReport( int64_t nowUs )
+{
+	unsigned char buf[128];
+	memset( buf, 0, sizeof( buf ) );
+
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	uint64_t ntpSec = (uint64_t)tv.tv_sec + NTP_UNIX_OFFSET;
+	uint64_t ntpFrac = ( (uint64_t)tv.tv_usec << 32 ) / 1000000;
+
+	// SR: V=2, PT=200, 长度为 32 位字数减一
+	buf[0] = 0x80;
+	buf[1] = 200;
+	putU16( &buf[2], 6 );
+	putU32( &buf[4], ssrc );
+	putU32( &buf[8], (uint32_t)ntpSec );
+	putU32( &buf[12], (uint32_t)ntpFrac );
+	putU32( &buf[16], rtpTimestamp( nowUs ) );
+	putU32( &buf[20], sendStats.packets );
+	putU32( &buf[24], (uint32_t)sendStats.octets );
+	int len = 28;
+
+	// SDES: V=2, SC=1, PT=202, 一个 CNAME 项, 以 0 结束并补齐到 32 位
+	char cname[64];
+	int cnameLen = snprintf( cname, sizeof( cname ), "adas-%u@device", ssrc );
+	unsigned char *sdes = &buf[len];
+	sdes[0] = 0x81;
+	sdes[1] = 202;
+	putU32( &sdes[4], ssrc );
+	sdes[8] = 1;
+	sdes[9] = cnameLen;
+	memcpy( &sdes[10], cname, cnameLen );
+	int sdesLen = ( 10 + cnameLen + 1 + 3 ) / 4 * 4;
+	putU16( &sdes[2], sdesLen / 4 - 1 );
+	len += sdesLen;
+
+	if( sendto( fd, buf, len, 0, (struct sockaddr *)&rtcpAddr, sizeof( rtcpAddr ) ) < 0 ){
+		std::cerr<<"send rtcp falied ..."<<std::endl;
+		return;
+	}
+	lastReportUs = nowUs;
+	sendStats.reports ++;
+}
+
+}
@@ -0,0 +1,130 @@
+#ifndef __RTP_SENDER_H_
+#define __RTP_SENDER_H_
+
+#include <iostream>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <vector>
+
+#include "frame_protocol.h"
+#include "frame_queue.h"
+#include "pacer.h"
+
+#define RTP_HEADER_SIZE		12
+#define RTP_PAYLOAD_TYPE	96	// 动态负载类型, 与 SDP 中的 rtpmap 一致
+#define RTP_CLOCK_RATE		90000	// 视频的 RTP 时钟
+#define RTP_BATCH_SIZE		64	// 每次 sendmmsg 最多发送的 RTP 包数
+#define RTP_MAX_SEGMENTS	8	// 一个 RTP 包中最多的行段数
+#define RTCP_INTERVAL_MS	1000	// 发送端报告的周期
+#define RTP_SEND_QUEUE_DEPTH	2	// 最多排队的帧数, 超出时丢弃最旧的帧
+
+namespace pcs{
+
+struct RtpStats
+{
+	uint32_t frames;	// 发出的帧数
+	uint32_t packets;	// 发出的 RTP 包数
+	uint64_t octets;	// RTP 负载字节数, 与发送端报告中的 octet count 一致
+	uint32_t reports;	// 发出的发送端报告数
+	uint32_t enqueued;	// 提交的帧数
+	uint32_t dropped;	// 排队期间被更新的帧挤掉, 或帧槽都被占用而未入队的帧数
+};
+
+/*
+ * RTP 视频输出, 供 FFmpeg, GStreamer 等标准工具直接接收和录制.
+ * 设备只有 I420 原始图像, 按 RFC 4175 (sampling=YCbCr-4:2:0, 8 bit) 打包: 每 2x2 个像素为一个 6 字节的 pgroup,
+ * 一行段覆盖相邻的两行, 一个包可以装多个行段; 每帧最后一个包置 marker 位.
+ * RTP 发往 port, RTCP 发送端报告 (SR + SDES CNAME) 发往 port + 1, 接收端据此把 RTP 时间戳换算成设备的 NTP 时间.
+ * 时间戳由采集时刻 (单调时钟) 换算, 与自有协议的 MSG_FRAME_TIMING 同源.
+ * 与 AsyncSender 一样由自己的发送线程打包发送: submit 只把帧拷贝进 FrameQueue 就返回, 队列满时丢弃最旧的帧,
+ * 网络变慢只会丢帧, 不会拖慢检测. 各通道共用传入的节拍器, 多路 RTP 合计不超过同一个码率.
+ */
+class RtpSender
+{
+public:
+	RtpSender();
+	~RtpSender();
+
+	// destIp 可以是组播组, 此时 ttl 和出口网卡地址 ifaceIp (NULL 时由路由决定) 生效; port 须为偶数
+	bool init( const char *destIp, int port, int ttl, const char *ifaceIp = NULL );
+
+	void setFormat( int width, int height, int fps );
+
+	// 发送前从 pacer 申请令牌, 可以与其他通道或传输方式共用; NULL 时不限速, 须在 start 之前设置
+	void setPacer( Pacer *pacer );
+
+	// 写出描述该路 RTP 流的 SDP 文件, ffplay/ffmpeg -i 或 GStreamer sdpdemux 打开它即可接收
+	bool writeSdp( const char *path, const char *sessionName );
+
+	bool start();
+	void stop();
+
+	// 拷贝一帧 I420 图像进入发送队列, 大小须与 setFormat 一致; captureUs 为采集时刻 (单调时钟, 微秒)
+	void submit( const unsigned char *frame, int size, int64_t captureUs );
+
+	RtpStats getStats();
+
+private:
+	struct FrameItem
+	{
+		std::vector<unsigned char> data;
+		int64_t captureUs;
+	};
+
+	struct Segment
+	{
+		int line;
+		int pixelOffset;
+		int length;
+	};
+
+	int buildPacket( unsigned char *out, const unsigned char *frame, int &line, int &byteOffset, uint32_t timestamp );
+	void sendReport( int64_t nowUs );
+	uint32_t rtpTimestamp( int64_t monotonicUs ) const;
+	bool flush( int num );
+	int sendFrame( const unsigned char *frame, int size, int64_t captureUs );
+
+	static void* sendThread( void *pArg );
+	static int64_t monotonicUs();
+
+	int fd;
+	struct sockaddr_in rtpAddr;
+	struct sockaddr_in rtcpAddr;
+	bool multicast;
+	int multicastTtl;
+
+	int width;
+	int height;
+	int fps;
+	int maxPacketSize;
+
+	uint32_t ssrc;
+	uint32_t seq;		// 扩展序号, 低 16 位在 RTP 头中, 高 16 位在 RFC 4175 负载头中
+	uint32_t timestampBase;
+	int64_t lastReportUs;
+
+	Pacer *pacer;
+
+	// 以下只由发送线程访问
+	std::vector<unsigned char> packets;
+	std::vector<int> packetSizes;
+	RtpStats sendStats;
+
+	FrameQueue<FrameItem> queue;
+
+	RtpStats stats;		// 每发完一帧从 sendStats 更新
+
+	pthread_mutex_t mutex;	// 保护 stats 和 running
+	pthread_t threadId;
+	bool running;
+};
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "transport_shm.h"
+
+#define READ_TIMEOUT_MS 1000  //等待一帧的超时, 超时后检查生产者是否已关闭或重启
+#define REOPEN_INTERVAL_S 1  //共享内存还没有创建时重试的间隔
+#define PRINT_INTERVAL 100  //每收到这么多帧打印一次统计
+
+
+bool g_bEndRead = false;  //是否结束程序
+
+/*
+* 函数名称: ReaderStop
+* 函数功能: SIGINT 处理, 结束读取
+* 输入参数: nSig-信号
+* 输出参数: 无
+* 返回值:   无
+*/
+void ReaderStop(int nSig)
+{
+	g_bEndRead = true;
+}
+
+/*
+* 函数名称: OpenRing
+* 函数功能: 打开生产者创建的共享内存帧环, 还没有创建时一直重试
+* 输入参数: pShm-共享内存传输
+* 输出参数: 无
+* 返回值:   true-成功, false-程序结束
+*/
+bool OpenRing(pcs::TransportShm *pShm)
+{
+	while (!g_bEndRead)
+	{
+		if (pShm->initSocketServer(0))
+		{
+			printf("shared memory ring %s opened\n", SHM_RING_NAME);
+			return true;
+		}
+		sleep(REOPEN_INTERVAL_S);
+	}
+	return false;
+}
+
+/*
+* 函数名称: PrintStats
+* 函数功能: 打印消费者的统计
+* 输入参数: pShm-共享内存传输, nFrames-读完的帧数, nOverwritten-读取期间被覆盖的帧数, nReopen-重新打开的次数
+* 输出参数: 无
+* 返回值:   无
+*/
+void PrintStats(const pcs::TransportShm *pShm, unsigned int nFrames, unsigned int nOverwritten, unsigned int nReopen)
+{
+	printf("frames=%u lapSkipped=%u overwritten=%u reopen=%u\n", nFrames, pShm->getDroppedCount(), nOverwritten, nReopen);
+}
+
+/*
+* 共享内存帧环的最小消费者, 与 ./testcase shm 运行在同一主机上: ./shm_reader [每帧处理耗时(ms)]
+* 直接读取槽中的数据, 不做拷贝. 处理耗时大于生产者的帧间隔时可以看到:
+* lapSkipped - 落后超过一圈, 跳到最旧的可用帧而丢掉的帧 (acquireFrame);
+* overwritten - 处理期间槽被生产者重写, 顺序锁版本号不一致, 读到的数据不可信 (releaseFrame).
+*/
+int main(int argc, char *argv[])
+{
+	int nProcessMs = (argc > 1) ? atoi(argv[1]) : 0;
+	unsigned int nFrames = 0;
+	unsigned int nOverwritten = 0;
+	unsigned int nReopen = 0;
+	unsigned int nChecksum = 0;
+
+	signal(SIGINT, ReaderStop);
+	printf("process %d ms per frame\n", nProcessMs);
+
+	pcs::TransportShm *pShm = new pcs::TransportShm();
+	if (!OpenRing(pShm))
+	{
+		delete pShm;
+		return 0;
+	}
+
+	while (!g_bEndRead)
+	{
+		pcs::ShmFrameView tView;
+		if (!pShm->acquireFrame(tView, READ_TIMEOUT_MS))
+		{
+			//生产者已关闭或已重启, 重新打开新建的共享内存
+			if (!pShm->isProducerAlive())
+			{
+				printf("producer closed or restarted, reopen\n");
+				PrintStats(pShm, nFrames, nOverwritten, nReopen);
+				delete pShm;
+				pShm = new pcs::TransportShm();
+				if (!OpenRing(pShm))
+				{
+					break;
+				}
+				nReopen++;
+			}
+			continue;
+		}
+
+		//模拟处理: 读遍整帧, 再按给定耗时占用这个槽
+		for (int i = 0; i < tView.size; i++)
+		{
+			nChecksum += tView.data[i];
+		}
+		if (nProcessMs > 0)
+		{
+			usleep(nProcessMs * 1000);
+		}
+
+		if (!pShm->releaseFrame(tView))
+		{
+			nOverwritten++;
+		}
+		nFrames++;
+		if (nFrames % PRINT_INTERVAL == 0)
+		{
+			PrintStats(pShm, nFrames, nOverwritten, nReopen);
+		}
+	}
+
+	PrintStats(pShm, nFrames, nOverwritten, nReopen);
+	printf("checksum=%u\n", nChecksum);
+	delete pShm;
+	return 0;
+}
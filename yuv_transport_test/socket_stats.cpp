@@ -0,0 +1,51 @@
+#include "socket_stats.h"
+
+#include <iostream>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <linux/sock_diag.h>
+
+namespace pcs{
+
+bool enableDropCounter( int fd )
+{
+	int on = 1;
+	if( setsockopt( fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof( on ) ) < 0 ){
+		std::cerr<<"set SO_RXQ_OVFL failed ..."<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool parseDropCounter( struct msghdr *msg, uint32_t &dropped )
+{
+	for( struct cmsghdr *cmsg = CMSG_FIRSTHDR( msg ); cmsg != NULL; cmsg = CMSG_NXTHDR( msg, cmsg ) ){
+		if( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL ){
+			memcpy( &dropped, CMSG_DATA( cmsg ), sizeof( uint32_t ) );
+			return true;
+		}
+	}
+	return false;
+}
+
+void querySocketQueues( int fd, SocketStats &stats )
+{
+	stats.rxQueued = 0;
+	stats.txQueued = 0;
+	if( fd < 0 ){
+		return;
+	}
+	// UDP 的 SIOCINQ 只返回下一个数据报的长度, 优先用 SO_MEMINFO 取整个接收队列占用的内存
+	uint32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t len = sizeof( meminfo );
+	if( getsockopt( fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len ) == 0 && len > SK_MEMINFO_RMEM_ALLOC * sizeof( uint32_t ) ){
+		stats.rxQueued = meminfo[SK_MEMINFO_RMEM_ALLOC];
+	}
+	else {
+		ioctl( fd, SIOCINQ, &stats.rxQueued );
+	}
+	ioctl( fd, SIOCOUTQ, &stats.txQueued );
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef __SOCKET_STATS_H_
+#define __SOCKET_STATS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40  // 旧的内核头文件中没有定义
+#endif
+#ifndef SO_MEMINFO
+#define SO_MEMINFO 55
+#endif
+
+// 每个数据报为 SO_RXQ_OVFL 预留的控制消息长度
+#define DROP_COUNTER_CMSG_SPACE CMSG_SPACE( sizeof( uint32_t ) )
+
+namespace pcs{
+
+/*
+ * socket 级别的收发统计, 用来区分帧是丢在网络上, 内核接收队列中还是重组时.
+ * 计数按批累加, 开销可以忽略; 多线程收发时由持有者加锁.
+ */
+struct SocketStats
+{
+	uint64_t txBytes;	// 已交给内核的字节数
+	uint32_t txDatagrams;	// 已交给内核的数据报数 (GSO 超级包按分片计)
+	uint32_t sendErrors;	// 发送失败次数
+	int lastSendErrno;	// 最近一次发送失败的 errno
+
+	uint64_t rxBytes;
+	uint32_t rxDatagrams;
+	uint32_t rxDropped;	// 接收队列满被内核丢弃的数据报数 (SO_RXQ_OVFL)
+
+	int rxQueued;		// 接收队列占用的字节数 (SO_MEMINFO, 不支持时为 SIOCINQ 返回的下一个数据报长度)
+	int txQueued;		// 发送队列中尚未发出的字节数 (SIOCOUTQ)
+};
+
+// 开启 SO_RXQ_OVFL, 此后入队的数据报都带有当时内核丢包的累计值, 丢包之后收到的下一个数据报才能反映出来
+bool enableDropCounter( int fd );
+
+// 从 recvmsg 的控制消息中取出丢包累计值, 没有时返回 false
+bool parseDropCounter( struct msghdr *msg, uint32_t &dropped );
+
+// 查询收发队列中积压的字节数, 只做一次 getsockopt 和一次 ioctl
+void querySocketQueues( int fd, SocketStats &stats );
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+#include "stream_demux.h"
+
+namespace pcs{
+
+StreamDemux::StreamDemux()
+{
+	memset( consumers, 0, sizeof( consumers ) );
+	memset( frameConsumers, 0, sizeof( frameConsumers ) );
+	memset( &stats, 0, sizeof( stats ) );
+}
+
+static int channelIndex( uint16_t channel )
+{
+	if( channel == DEMUX_ANY_CHANNEL ){
+		return MAX_STREAM_CHANNELS;
+	}
+	return ( channel < MAX_STREAM_CHANNELS ) ? channel : -1;
+}
+
+bool StreamDemux::setConsumer( uint16_t channel, uint8_t type, StreamMessageFunc pFunc, void *pPrivData )
+{
+	int index = channelIndex( channel );
+	if( index < 0 || type > MAX_MESSAGE_TYPE ){
+		std::cerr<<"invalid demux consumer, channel "<<channel<<" type "<<(int)type<<std::endl;
+		return false;
+	}
+
+	consumers[index][type].func = pFunc;
+	consumers[index][type].priv = pPrivData;
+	return true;
+}
+
+bool StreamDemux::setFrameConsumer( uint16_t channel, FrameReceivedFunc pFunc, void *pPrivData )
+{
+	int index = channelIndex( channel );
+	if( index < 0 ){
+		std::cerr<<"invalid demux frame consumer, channel "<<channel<<std::endl;
+		return false;
+	}
+
+	frameConsumers[index].func = pFunc;
+	frameConsumers[index].priv = pPrivData;
+	return true;
+}
+
+bool StreamDemux::dispatch( const unsigned char *msg, int len )
+{
+	int type = peekMessageType( msg, len );
+	int channel = peekStreamId( msg, len );
+	if( type < 0 || type > MAX_MESSAGE_TYPE || channel < 0 || channel >= MAX_STREAM_CHANNELS ){
+		stats.unhandledMessages ++;
+		return false;
+	}
+
+	const MessageConsumer *consumer = &consumers[channel][type];
+	if( consumer->func == NULL ){
+		consumer = &consumers[MAX_STREAM_CHANNELS][type];
+	}
+	if( consumer->func == NULL ){
+		stats.unhandledMessages ++;
+		return false;
+	}
+
+	stats.messages[channel] ++;
+	consumer->func( msg, len, consumer->priv );
+	return true;
+}
+
+bool StreamDemux::dispatchFrame( const ReceivedFrame *pFrame )
+{
+	if( pFrame->streamId >= MAX_STREAM_CHANNELS ){
+		stats.unhandledFrames ++;
+		return false;
+	}
+
+	const FrameConsumer *consumer = &frameConsumers[pFrame->streamId];
+	if( consumer->func == NULL ){
+		consumer = &frameConsumers[MAX_STREAM_CHANNELS];
+	}
+	if( consumer->func == NULL ){
+		stats.unhandledFrames ++;
+		return false;
+	}
+
+	stats.frames[pFrame->streamId] ++;
+	consumer->func( pFrame, consumer->priv );
+	return true;
+}
+
+}
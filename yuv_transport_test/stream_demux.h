@@ -0,0 +1,73 @@
+#ifndef __STREAM_DEMUX_H_
+#define __STREAM_DEMUX_H_
+
+#include <iostream>
+
+#include "frame_protocol.h"
+#include "frame_reassembler.h"
+
+#define DEMUX_ANY_CHANNEL	0xffff	// 注册到所有通道
+
+namespace pcs{
+
+// 收到一条消息, msg 包含公共前缀, 只在回调期间有效
+typedef void (*StreamMessageFunc)( const unsigned char *msg, int len, void *pPrivData );
+
+struct DemuxStats
+{
+	uint32_t frames[MAX_STREAM_CHANNELS];	// 各通道分发的图像帧数
+	uint32_t messages[MAX_STREAM_CHANNELS];	// 各通道分发的其它消息数
+	uint32_t unhandledFrames;		// 通道号越界或没有消费者的帧
+	uint32_t unhandledMessages;		// 通道号, 类型越界或没有消费者的消息
+};
+
+/*
+ * 接收端的多路分发: 所有通道的图像和检测结果都从同一个 socket 收上来,
+ * 按消息前缀中的通道号和类型交给注册的消费者, 每个通道的显示, 录像等互不干扰.
+ * 消费者须在开始接收前注册好, 分发在调用者的线程中进行; 帧和消息可以分别在不同的线程中分发.
+ * 与平台无关, 不依赖具体的接收方式 (recvmmsg, io_uring, Qt socket).
+ */
+class StreamDemux
+{
+public:
+	StreamDemux();
+
+	// channel 为 DEMUX_ANY_CHANNEL 时对所有通道生效, 具体通道的消费者优先; pFunc 为 NULL 时注销
+	bool setConsumer( uint16_t channel, uint8_t type, StreamMessageFunc pFunc, void *pPrivData );
+
+	// 重组好的图像帧的消费者
+	bool setFrameConsumer( uint16_t channel, FrameReceivedFunc pFunc, void *pPrivData );
+
+	// 按通道号和类型分发一条消息, 没有消费者时返回 false
+	bool dispatch( const unsigned char *msg, int len );
+
+	bool dispatchFrame( const ReceivedFrame *pFrame );
+
+	const DemuxStats& getStats() const
+	{
+		return stats;
+	}
+
+private:
+	struct MessageConsumer
+	{
+		StreamMessageFunc func;
+		void *priv;
+	};
+
+	struct FrameConsumer
+	{
+		FrameReceivedFunc func;
+		void *priv;
+	};
+
+	// 最后一行为 DEMUX_ANY_CHANNEL
+	MessageConsumer consumers[MAX_STREAM_CHANNELS + 1][MAX_MESSAGE_TYPE + 1];
+	FrameConsumer frameConsumers[MAX_STREAM_CHANNELS + 1];
+
+	DemuxStats stats;
+};
+
+}
+
+#endif
@@ -41,7 +41,38 @@ extern "C" {
 #include <iostream>
 
 #include "transport_udp.h"
+#include "transport_shm.h"
+#include "transport_tcp.h"
+#include "transport_unix.h"
+#include "frame_protocol.h"
+#include "retransmit_ring.h"
+#include "async_sender.h"
+#include "result_codec.h"
+#include "rate_controller.h"
+#include "flow_control.h"
+#include "rtp_sender.h"
 #include <vector>
+#include <poll.h>
+
+#define FEC_DATA_NUM 10  //每组数据分片数
+#define FEC_PARITY_NUM 2  //每组前向纠错校验分片数, 0-不发送校验分片
+#define PACING_RATE_BPS (500 * 1000 * 1000LL)  //分片匀速发送的码率, 0-不限速
+#define PACING_BURST_BYTES (64 * 1024)  //每次最多连续发送的字节数
+#define FRAME_DEST_IP "192.168.22.69"  //显示端地址(单播及 TCP 传输)
+#define FRAME_DEST_PORT 2333  //图像, 检测结果等所有通道的数据共用的端口
+#define LANE_POINT_TOLERANCE 1.0f  //车道线抽稀容差(像素), 0 表示不抽稀
+#define USE_MULTICAST 1  //1-UDP 传输时图像发往组播组, 每帧只发送一次, 任意多个显示端/录像端加入该组即可接收
+#define FRAME_MULTICAST_GROUP "239.255.22.69"  //图像组播组
+#define MULTICAST_TTL 1  //组播跳数, 1-只在本网段
+#define DEFAULT_TRANSPORT "udp"  //默认传输方式: udp/tcp/unix/shm/rtp, 可由第一个命令行参数指定
+#define USE_UDP_GSO 1  //1-由内核切分分片(UDP GSO), 不支持时自动退回逐个分片发送
+#define SOURCE_WIDTH 1280  //解码后源图像的宽度
+#define SOURCE_HEIGHT 720  //解码后源图像的高度
+#define SOURCE_FPS 25  //源图像序列的标称帧率, 协商帧率时按它隔帧发送
+#define USE_RATE_TRACE 1  //1-记录码率自适应的跟踪日志: 估计的链路容量, 目标码率与实际发送码率, 用于调参
+#define RATE_TRACE_FILE "./rate_trace.csv"  //码率自适应跟踪日志的路径
+#define RTP_DEST_PORT 5004  //rtp 方式下第 0 通道图像的 RTP 端口, 第 n 通道为 RTP_DEST_PORT + 2n, RTCP 为其后一个端口
+#define RTP_SDP_FILE "./stream_ch%d.sdp"  //rtp 方式下各通道的 SDP 描述, 拷到接收端用 ffplay/ffmpeg/GStreamer 打开
 
 
 using namespace std;
@@ -54,7 +85,33 @@ ObjectEventDetectConfig tDetectTrackEventConfig;
 
 
 // ------------------------------------------------- //
-pcs::Transport *udp = new pcs::TransportUDP();
+pcs::Transport *udp = NULL;  //启动时由 CreateTransport 按传输方式创建
+bool g_bDatagramTransport = true;  //是否为会丢包的 UDP 传输, 只有它需要处理重传请求
+const char *g_szFrameDestIp = FRAME_DEST_IP;  //图像数据目的地址, 开启组播后为组播组
+pcs::RetransmitRing g_tRetransmitRing;  //最近发送帧的副本, 用于按重传请求补发分片
+pcs::AsyncSender *g_pSender = NULL;  //图像发送线程, 检测线程只负责把帧放入发送队列
+bool g_bMulticast = false;  //图像是否发往组播组
+bool g_bRtpOutput = false;  //图像按 RTP(RFC 4175) 发送给标准工具, 检测结果仍走 UDP 传输
+
+//每个通道与显示端协商好的发送格式, 未协商时按源图像发往 g_szFrameDestIp
+typedef struct
+{
+	int nWidth;  //发送的图像宽度
+	int nHeight;  //发送的图像高度
+	int nScale;  //相对源图像的缩小倍数: 1, 2, 4
+	int nFragSize;  //分片长度上限, 0-按路径 MTU
+	int nFrameStep;  //每 nFrameStep 帧发送一帧
+	struct sockaddr_in tDestAddr;  //图像及检测结果的目的地址
+} StreamConfig;
+StreamConfig g_tStreamConfig[pcs::MAX_STREAM_CHANNELS];
+pthread_mutex_t g_tStreamConfigMutex = PTHREAD_MUTEX_INITIALIZER;
+int g_nDiscoveryFd = -1;  //接收显示端发现/协商请求的 socket
+int g_nFecData = FEC_DATA_NUM;  //当前的前向纠错参数, 对整个 socket 生效
+int g_nFecParity = FEC_PARITY_NUM;
+pcs::RateController g_tRateController[pcs::MAX_STREAM_CHANNELS];  //各通道按接收报告调整发送格式, 只在 RecvControlThread 中使用
+FILE *g_pRateTrace = NULL;  //码率自适应的跟踪日志
+pcs::FlowControl g_tFlowControl[pcs::MAX_STREAM_CHANNELS];  //按显示端的处理进度跳过它来不及显示的帧
+pthread_mutex_t g_tFlowMutex = PTHREAD_MUTEX_INITIALIZER;
 
 // ------------------------------------------------ //
 
@@ -263,6 +320,68 @@ long long GetSystemTimeus(void)
 	return lFrameTimestamp;
 }
 
+/*
+* 函数名称: GetMonotonicTimems 
+* 函数功能: 获取单调时钟时间 单位ms, 不受系统校时影响
+* 输入参数: 无
+* 输出参数: 无 
+* 返回值: 单调时钟时间 
+*/ 
+long long GetMonotonicTimems(void)
+{
+	struct timespec tsTime;
+
+	clock_gettime(CLOCK_MONOTONIC, &tsTime);
+	return (long long)tsTime.tv_sec * 1000 + tsTime.tv_nsec / 1000000;
+}
+
+/*
+* 函数名称: GetMonotonicTimeus 
+* 函数功能: 获取单调时钟时间 单位us, 用于每帧各阶段的时间戳和对时
+* 输入参数: 无
+* 输出参数: 无 
+* 返回值: 单调时钟时间 
+*/ 
+long long GetMonotonicTimeus(void)
+{
+	struct timespec tsTime;
+
+	clock_gettime(CLOCK_MONOTONIC, &tsTime);
+	return (long long)tsTime.tv_sec * 1000000 + tsTime.tv_nsec / 1000;
+}
+
+/*
+* 函数名称: CreateTransport 
+* 函数功能: 按名字创建传输方式
+* 输入参数: szName-udp/tcp/unix/shm/rtp, rtp 时图像按 RTP 发送, 其余消息走 udp
+* 输出参数: 无 
+* 返回值: 传输对象, 名字无效时返回 NULL
+*/ 
+pcs::Transport* CreateTransport(const char *szName)
+{
+	g_bDatagramTransport = false;
+	g_bRtpOutput = false;
+	if (strcmp(szName, "udp") == 0 || strcmp(szName, "rtp") == 0)
+	{
+		g_bDatagramTransport = true;
+		g_bRtpOutput = (strcmp(szName, "rtp") == 0);
+		return new pcs::TransportUDP();
+	}
+	else if (strcmp(szName, "tcp") == 0)
+	{
+		return new pcs::TransportTCP();
+	}
+	else if (strcmp(szName, "unix") == 0)
+	{
+		return new pcs::TransportUnix();
+	}
+	else if (strcmp(szName, "shm") == 0)
+	{
+		return new pcs::TransportShm();
+	}
+	return NULL;
+}
+
 /*
 * 函数名称: MvVideoDecodeInit 
 * 函数功能: 视频解码模块初始化
@@ -550,100 +669,36 @@ int MvReleaseOutBuf(HD_PATH_ID path_id, HD_VIDEO_FRAME* pImageDataInfo)
 	return 0;
 }
 
-std::string base64Encode(const unsigned char* Data, int DataByte)
-{
-	const char EncodeTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-	//返回值
-	std::string strEncode;
-	unsigned char Tmp[4] = { 0 };
-	int LineLength = 0;
-	for (int i = 0; i < (int)(DataByte / 3); i++){
-		Tmp[1] = *Data++;
-		Tmp[2] = *Data++;
-		Tmp[3] = *Data++;
-		strEncode += EncodeTable[Tmp[1] >> 2];
-		strEncode += EncodeTable[((Tmp[1] << 4) | (Tmp[2] >> 4)) & 0x3F];
-		strEncode += EncodeTable[((Tmp[2] << 2) | (Tmp[3] >> 6)) & 0x3F];
-		strEncode += EncodeTable[Tmp[3] & 0x3F];
-		if (LineLength += 4, LineLength == 76) { strEncode += "\r\n"; LineLength = 0; }
-	}
-	//对剩余数据进行编码
-	int Mod = DataByte % 3;
-	if (Mod == 1){
-		Tmp[1] = *Data++;
-		strEncode += EncodeTable[(Tmp[1] & 0xFC) >> 2];
-		strEncode += EncodeTable[((Tmp[1] & 0x03) << 4)];
-		strEncode += "==";
-	}
-	else if (Mod == 2){
-		Tmp[1] = *Data++;
-		Tmp[2] = *Data++;
-		strEncode += EncodeTable[(Tmp[1] & 0xFC) >> 2];
-		strEncode += EncodeTable[((Tmp[1] & 0x03) << 4) | ((Tmp[2] & 0xF0) >> 4)];
-		strEncode += EncodeTable[((Tmp[2] & 0x0F) << 2)];
-		strEncode += "=";
-	}
-	cout << "编码成功" << endl;
-	return strEncode;
-}
-
-
-/*数据包分片*/
-bool udp_piece_cut(std::string ALL_data, std::vector<std::string>& pieces)
+/*
+* 函数名称: SendResultMessage
+* 函数功能: 把检测结果消息发往该通道图像数据的目的地址, 与图像共用同一个 socket 或连接, 显示端按通道号和类型分发
+* 输入参数: nDataChannel-数据通道号, pMsg-编码好的消息, nLen-消息长度
+* 输出参数: 无
+* 返回值:   无
+*/
+static void SendResultMessage(int nDataChannel, const unsigned char *pMsg, int nLen)
 {
-	int times = ALL_data.size() / 60000;
-	std::cout << "times = " << times << std::endl;
-
-	int i = 0;
-	for (; i < times; i++) {
-		pieces.push_back( ALL_data.substr( i * 60000, 60000 ) );
-	}
-	pieces.push_back(ALL_data.substr(i * 60000));
-
-	std::cout << "pieces.size() = " << pieces.size() << std::endl;
-
-	return true;
+	struct sockaddr_in result_dest_addr;
+	pthread_mutex_lock( &g_tStreamConfigMutex );
+	result_dest_addr = g_tStreamConfig[nDataChannel].tDestAddr;
+	pthread_mutex_unlock( &g_tStreamConfigMutex );
+	udp->write( udp->getClientFd(), (unsigned char *)pMsg, nLen, result_dest_addr );
 }
 
-void sendPieces( int sock_fd, struct sockaddr_in &addr_client, int len2, std::string &basedStr)
+/*
+* 函数名称: SendObjectResult
+* 函数功能: 紧凑编码一个通道的检测结果并发送, 只编码有效目标, 约几百字节, 不再整体拷贝 ObjectTrackEventResult
+* 输入参数: nDataChannel-数据通道号, pObjectTrackEventResult-检测结果
+* 输出参数: 无
+* 返回值:   无
+*/
+static void SendObjectResult(int nDataChannel, const ObjectTrackEventResult *pObjectTrackEventResult)
 {
-	unsigned char head[8];
-	int length = basedStr.size();
-	cout << "data size = " << length << endl;
-	head[0] = 'L';
-	head[1] = 'E';
-	head[2] = 'N';
-	head[3] = 'G';
-	memcpy(&head[4], &length, 4);
-	if (sendto(sock_fd, (char *)head, 8, 0, (sockaddr*)&addr_client, len2) != -1) {
-		std::cout << "发送头消息" << ::endl;
-	}
-
-	bool result = false;
-	std::vector<string> pieces;
-	// 发送base64字节流,如果大于50000字节则分片发送
-	if (basedStr.size() > 50000) {
-		result = udp_piece_cut(basedStr, pieces);
-	}
-	if (result) {//分片
-		for (size_t i = 0; i < pieces.size(); i++) {
-			const char* sendbuf = pieces[i].c_str();
-
-			if (sendto(sock_fd, sendbuf, strlen(sendbuf), 0, (sockaddr*)&addr_client, len2) != -1) {
-				cout << "分片发送成功" << endl;
-			}
-		}
-	}
-	else {//不分片
-		const char* sendbuf = basedStr.c_str();
-		if (sendto(sock_fd, sendbuf, strlen(sendbuf), 0, (sockaddr*)&addr_client, len2) != -1){
-			cout << "不分片发发送成功" << endl;
-		}
-	}
+	unsigned char szResult[pcs::MAX_OBJECT_RESULT_SIZE];
+	int nLen = pcs::encodeObjectResult( *pObjectTrackEventResult, (uint16_t)nDataChannel, szResult );
+	SendResultMessage( nDataChannel, szResult, nLen );
 }
 
-
-
 //adas算法结果处理函数	
 void ProcessAdasAlgResult(int nDataChannel, ObjectTrackEventResult* pObjectTrackEventResult, void *pPrivData)
 {
@@ -690,22 +745,7 @@ void ProcessAdasAlgResult(int nDataChannel, ObjectTrackEventResult* pObjectTrack
 		}
 	}*/
 	
-	/*unsigned char *sendBuff = new unsigned char[ sizeof( ObjectTrackEventResult ) + 4 ];
-	sendBuff[0] = 'a';
-	sendBuff[1] = 'a';
-	sendBuff[2] = 'a';
-	sendBuff[3] = 'a';
-	memcpy( &sendBuff[4], pObjectTrackEventResult, sizeof( ObjectTrackEventResult ) );
-
-	struct sockaddr_in      client_dest_addr;
-
-        client_dest_addr.sin_family = AF_INET;
-        client_dest_addr.sin_addr.s_addr = inet_addr("192.168.22.69");
-        client_dest_addr.sin_port = htons( 2334 );
-	udp->write( udp->getClientFd(), sendBuff, sizeof( ObjectTrackEventResult ) + 4, client_dest_addr );
-
-	delete[] sendBuff;
-	*/
+	SendObjectResult( nDataChannel, pObjectTrackEventResult );
 	return;
 }
 
@@ -721,22 +761,10 @@ void ProcessAdasAlgLaneLineResult(int nDataChannel, DrawPointInfo* pPointInfo, v
 		}
 	}*/
 
-	/*unsigned char *sendBuff = new unsigned char[ sizeof( DrawPointInfo ) + 4 ];
-        sendBuff[0] = 'b';
-        sendBuff[1] = 'b';
-        sendBuff[2] = 'b';
-        sendBuff[3] = 'b';
-        memcpy( &sendBuff[4], pPointInfo, sizeof( DrawPointInfo ) );
-
-        struct sockaddr_in      client_dest_addr;
-
-        client_dest_addr.sin_family = AF_INET;
-        client_dest_addr.sin_addr.s_addr = inet_addr("192.168.22.69");
-        client_dest_addr.sin_port = htons( 2334 );
-        udp->write( udp->getClientFd(), sendBuff, sizeof( DrawPointInfo ) + 4, client_dest_addr );
-
-        delete[] sendBuff;
-	*/
+	//车道线只发有效点, 锚点加差值编码, 约几百字节
+	unsigned char szLanes[pcs::MAX_LANE_POINTS_SIZE];
+	int nLen = pcs::encodeLanePoints( *pPointInfo, (uint16_t)nDataChannel, LANE_POINT_TOLERANCE, szLanes );
+	SendResultMessage( nDataChannel, szLanes, nLen );
 	return;
 }
 
@@ -757,6 +785,272 @@ void ProcessAdasSelfLearnResult(int nDataChannel, int * a, void *pPrivData)
 	return;
 }
 
+/*
+* 函数名称: InitStreamConfig
+* 函数功能: 各通道的发送格式恢复为默认值: 源图像分辨率, 每帧都发, 发往 g_szFrameDestIp
+* 输入参数: 无
+* 输出参数: 无
+* 返回值:   无
+*/
+static void InitStreamConfig(void)
+{
+	pthread_mutex_lock( &g_tStreamConfigMutex );
+	for (int i = 0; i < pcs::MAX_STREAM_CHANNELS; i++)
+	{
+		StreamConfig *pConfig = &g_tStreamConfig[i];
+		pConfig->nWidth = SOURCE_WIDTH;
+		pConfig->nHeight = SOURCE_HEIGHT;
+		pConfig->nScale = 1;
+		pConfig->nFragSize = 0;
+		pConfig->nFrameStep = 1;
+		memset( &pConfig->tDestAddr, 0, sizeof( pConfig->tDestAddr ) );
+		pConfig->tDestAddr.sin_family = AF_INET;
+		pConfig->tDestAddr.sin_addr.s_addr = inet_addr( g_szFrameDestIp );
+		pConfig->tDestAddr.sin_port = htons( FRAME_DEST_PORT );
+	}
+	pthread_mutex_unlock( &g_tStreamConfigMutex );
+}
+
+/*
+* 函数名称: DownscaleI420
+* 函数功能: I420 图像按 nScale x nScale 的块取平均缩小, 宽高须能被 2 * nScale 整除
+* 输入参数: pSrc-源图像, nWidth/nHeight-源图像宽高, nScale-缩小倍数
+* 输出参数: pDst-缩小后的图像, 大小为 (nWidth/nScale) * (nHeight/nScale) * 3/2
+* 返回值:   无
+*/
+static void DownscaleI420(const unsigned char *pSrc, int nWidth, int nHeight, int nScale, unsigned char *pDst)
+{
+	int nArea = nScale * nScale;
+	//依次处理 Y, U, V 三个平面
+	for (int nPlane = 0; nPlane < 3; nPlane++)
+	{
+		int nSrcW = (nPlane == 0) ? nWidth : nWidth / 2;
+		int nSrcH = (nPlane == 0) ? nHeight : nHeight / 2;
+		int nDstW = nSrcW / nScale;
+		int nDstH = nSrcH / nScale;
+		for (int y = 0; y < nDstH; y++)
+		{
+			for (int x = 0; x < nDstW; x++)
+			{
+				const unsigned char *pBlock = pSrc + y * nScale * nSrcW + x * nScale;
+				int nSum = 0;
+				for (int j = 0; j < nScale; j++)
+				{
+					for (int i = 0; i < nScale; i++)
+					{
+						nSum += pBlock[j * nSrcW + i];
+					}
+				}
+				pDst[y * nDstW + x] = (unsigned char)((nSum + nArea / 2) / nArea);
+			}
+		}
+		pSrc += nSrcW * nSrcH;
+		pDst += nDstW * nDstH;
+	}
+}
+
+/*
+* 函数名称: ApplyRateLevel
+* 函数功能: 按码率自适应当前的档位设置发送格式的分辨率和隔帧数
+* 输入参数: pRate-该通道的码率控制
+* 输出参数: pConfig-发送格式
+* 返回值:   无
+*/
+static void ApplyRateLevel(const pcs::RateController *pRate, StreamConfig *pConfig)
+{
+	pConfig->nScale = pRate->getScale();
+	pConfig->nWidth = SOURCE_WIDTH / pConfig->nScale;
+	pConfig->nHeight = SOURCE_HEIGHT / pConfig->nScale;
+	pConfig->nFrameStep = pRate->getFrameStep();
+}
+
+/*
+* 函数名称: FillStreamDescriptor
+* 函数功能: 按一个通道的发送格式填写发给显示端的流描述
+* 输入参数: nDataChannel-数据通道号, pConfig-发送格式
+* 输出参数: pDesc-流描述
+* 返回值:   无
+*/
+static void FillStreamDescriptor(int nDataChannel, const StreamConfig *pConfig, pcs::StreamDescriptor *pDesc)
+{
+	struct sockaddr_in tDestAddr = pConfig->tDestAddr;
+	int nFragSize = udp->getFragmentSize( tDestAddr );
+	if (pConfig->nFragSize > 0 && pConfig->nFragSize < nFragSize)
+	{
+		nFragSize = pConfig->nFragSize;
+	}
+
+	memset( pDesc, 0, sizeof( *pDesc ) );
+	pDesc->streamId = nDataChannel;
+	pDesc->format.codec = pcs::CODEC_RAW;
+	pDesc->format.pixelFormat = pcs::PIXEL_FORMAT_I420;
+	pDesc->format.width = pConfig->nWidth;
+	pDesc->format.height = pConfig->nHeight;
+	pDesc->format.fragSize = nFragSize;
+	pDesc->format.fecData = g_nFecData;
+	pDesc->format.fecParity = g_nFecParity;
+	pDesc->format.fps = SOURCE_FPS / pConfig->nFrameStep;
+	pDesc->frameSize = pcs::rawFrameSize( pcs::PIXEL_FORMAT_I420, pConfig->nWidth, pConfig->nHeight );
+	pDesc->groupAddr = g_bMulticast ? ntohl( tDestAddr.sin_addr.s_addr ) : 0;
+	pDesc->dataPort = ntohs( tDestAddr.sin_port );
+}
+
+/*
+* 函数名称: NegotiateStream
+* 函数功能: 按显示端的请求选择一个通道的发送格式并立即生效, 请求中为 0 的字段由设备选择.
+*           设备只有解码后的 I420 原始图像: 编码格式总是回应 CODEC_RAW, 分辨率取源图像缩小 1/2/4 倍中
+*           不超过请求的最大一档, 帧率按 SOURCE_FPS 隔帧发送, 前向纠错参数对整个 socket 生效.
+*           组播时所有显示端共用同一路图像, 后一个请求的格式覆盖前一个.
+* 输入参数: pReq-协商请求, pFromAddr-请求来源地址
+* 输出参数: pDesc-实际采用的格式
+* 返回值:   true-成功, false-通道号无效
+*/
+static bool NegotiateStream(const pcs::StreamRequest *pReq, const struct sockaddr_in *pFromAddr, pcs::StreamDescriptor *pDesc)
+{
+	if (pReq->streamId >= pcs::MAX_STREAM_CHANNELS)
+	{
+		printf("stream request for invalid channel %d\n", pReq->streamId);
+		return false;
+	}
+	if ((pReq->format.codec != pcs::CODEC_ANY && pReq->format.codec != pcs::CODEC_RAW)
+		|| (pReq->format.pixelFormat != pcs::PIXEL_FORMAT_ANY && pReq->format.pixelFormat != pcs::PIXEL_FORMAT_I420))
+	{
+		printf("stream request codec %d pixel format %d unsupported, answer raw I420\n", pReq->format.codec, pReq->format.pixelFormat);
+	}
+
+	StreamConfig tConfig;
+	memset( &tConfig, 0, sizeof( tConfig ) );
+	tConfig.nScale = 4;
+	for (int nScale = 1; nScale <= 4; nScale *= 2)
+	{
+		if ((pReq->format.width == 0 || SOURCE_WIDTH / nScale <= pReq->format.width)
+			&& (pReq->format.height == 0 || SOURCE_HEIGHT / nScale <= pReq->format.height))
+		{
+			tConfig.nScale = nScale;
+			break;
+		}
+	}
+	tConfig.nFrameStep = 1;
+	if (pReq->format.fps > 0)
+	{
+		tConfig.nFrameStep = (SOURCE_FPS + pReq->format.fps - 1) / pReq->format.fps;
+	}
+
+	//组播时图像仍发往组播组, 显示端加入该组接收; 单播时发往请求来源的 data port
+	tConfig.tDestAddr.sin_family = AF_INET;
+	if (g_bMulticast)
+	{
+		tConfig.tDestAddr.sin_addr.s_addr = inet_addr( g_szFrameDestIp );
+		tConfig.tDestAddr.sin_port = htons( FRAME_DEST_PORT );
+	}
+	else
+	{
+		tConfig.tDestAddr.sin_addr = pFromAddr->sin_addr;
+		tConfig.tDestAddr.sin_port = htons( pReq->dataPort );
+	}
+
+	if (pReq->format.fragSize > 0)
+	{
+		tConfig.nFragSize = pReq->format.fragSize;
+	}
+
+	if (pReq->format.fecData > 0)
+	{
+		if (udp->setFec( pReq->format.fecData, pReq->format.fecParity ))
+		{
+			g_nFecData = pReq->format.fecData;
+			g_nFecParity = pReq->format.fecParity;
+		}
+		else
+		{
+			udp->setFec( g_nFecData, g_nFecParity );
+		}
+	}
+
+	//协商的格式是上限, 码率自适应只会在它之下降低分辨率和帧率
+	pcs::RateController *pRate = &g_tRateController[pReq->streamId];
+	pRate->setCeiling( tConfig.nScale, tConfig.nFrameStep );
+	ApplyRateLevel( pRate, &tConfig );
+
+	pthread_mutex_lock( &g_tStreamConfigMutex );
+	g_tStreamConfig[pReq->streamId] = tConfig;
+	pthread_mutex_unlock( &g_tStreamConfigMutex );
+
+	FillStreamDescriptor( pReq->streamId, &tConfig, pDesc );
+	printf("stream %d negotiated with %s: %dx%d fps=%d frag=%d fec=%d+%d\n", pReq->streamId, inet_ntoa(pFromAddr->sin_addr),
+		tConfig.nWidth, tConfig.nHeight, pDesc->format.fps, pDesc->format.fragSize, g_nFecData, g_nFecParity);
+	return true;
+}
+
+/*
+* 函数名称: HandleReceiverReport
+* 函数功能: 按显示端的接收报告调整该通道的码率, 发送格式变化时立即生效, 并向该通道的目的地址发出新的流描述
+* 输入参数: pReport-接收报告
+* 输出参数: 无
+* 返回值:   无
+*/
+static void HandleReceiverReport(const pcs::ReceiverReport *pReport)
+{
+	if (pReport->streamId >= pcs::MAX_STREAM_CHANNELS)
+	{
+		return;
+	}
+
+	pcs::RateController *pRate = &g_tRateController[pReport->streamId];
+	pcs::AsyncSenderStats tSenderStats = g_pSender->getStats();
+	if (!pRate->onReport(*pReport, GetMonotonicTimems(), tSenderStats.sentBytes[pReport->streamId]))
+	{
+		return;
+	}
+
+	StreamConfig tConfig;
+	pthread_mutex_lock( &g_tStreamConfigMutex );
+	ApplyRateLevel( pRate, &g_tStreamConfig[pReport->streamId] );
+	tConfig = g_tStreamConfig[pReport->streamId];
+	pthread_mutex_unlock( &g_tStreamConfigMutex );
+
+	pcs::StreamDescriptor tDesc;
+	unsigned char szDesc[pcs::STREAM_DESC_SIZE];
+	FillStreamDescriptor( pReport->streamId, &tConfig, &tDesc );
+	int nLen = pcs::encodeStreamDescriptor( tDesc, szDesc );
+	udp->write( udp->getClientFd(), szDesc, nLen, tConfig.tDestAddr );
+	printf("stream %d rate adapted: target=%ukbps capacity=%ukbps loss=%.3f -> %dx%d fps=%d\n", pReport->streamId,
+		pRate->getTargetKbps(), pReport->capacityKbps, pReport->lossFraction / 65535.0, tConfig.nWidth, tConfig.nHeight, tDesc.format.fps);
+}
+
+/*
+* 函数名称: OpenDiscoverySocket
+* 函数功能: 打开接收显示端发现/协商请求的 socket, 显示端不知道设备地址时广播到该端口
+* 输入参数: 无
+* 输出参数: 无
+* 返回值:   socket 描述符, -1-失败
+*/
+static int OpenDiscoverySocket(void)
+{
+	int nFd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (nFd < 0)
+	{
+		printf("discovery socket error: %s\n", strerror(errno));
+		return -1;
+	}
+
+	int nReuse = 1;
+	setsockopt(nFd, SOL_SOCKET, SO_REUSEADDR, &nReuse, sizeof(nReuse));
+	struct sockaddr_in tAddr;
+	memset( &tAddr, 0, sizeof( tAddr ) );
+	tAddr.sin_family = AF_INET;
+	tAddr.sin_addr.s_addr = htonl( INADDR_ANY );
+	tAddr.sin_port = htons( pcs::STREAM_DISCOVERY_PORT );
+	if (bind(nFd, (struct sockaddr *)&tAddr, sizeof(tAddr)) < 0)
+	{
+		printf("discovery socket bind %d error: %s\n", pcs::STREAM_DISCOVERY_PORT, strerror(errno));
+		close(nFd);
+		return -1;
+	}
+	return nFd;
+}
+
+
 /*
 * 函数名称: StreamSendProcess
 * 函数功能: 视频发送
@@ -782,6 +1076,10 @@ int StreamSendProcess(int nDataChannel)
 	long long lETime = 0;	
 	int nDeltTimese = 0;
 	int nFrameId = 0;
+	pcs::FrameTiming tTiming;  //本帧各阶段的时间戳, 发给显示端统计端到端延时
+	StreamConfig tConfig;  //本帧采用的发送格式
+	std::vector<unsigned char> vecScaled;  //缩小后的图像
+	pcs::RtpSender tRtpSender;  //rtp 方式下本通道的 RTP 输出
 	//long long lFrameTimestamp = 0;
 	int nCount = 0;
 	int nMinIndex = 1000000;
@@ -856,6 +1154,24 @@ int StreamSendProcess(int nDataChannel)
 	
 	map<string, int>::iterator it = mapPicNames.begin();
 	
+	//rtp 方式: 标准工具不发接收报告, 按源图像格式发送, 不做协商和码率自适应
+	if (g_bRtpOutput)
+	{
+		char szSdpFile[256];
+		sprintf(szSdpFile, RTP_SDP_FILE, nDataChannel);
+		tRtpSender.setFormat(SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_FPS);
+		tRtpSender.setPacer(udp->getPacer());  //各通道与 udp 共用一个节拍器, 合计不超过 PACING_RATE_BPS
+		if (!tRtpSender.init(g_szFrameDestIp, RTP_DEST_PORT + 2 * nDataChannel, MULTICAST_TTL, NULL) ||
+			!tRtpSender.writeSdp(szSdpFile, "adas") || !tRtpSender.start())
+		{
+			printf("rtp output init error, nDataChannel=%d\n", nDataChannel);
+		}
+		else
+		{
+			printf("rtp dest %s:%d sdp %s\n", g_szFrameDestIp, RTP_DEST_PORT + 2 * nDataChannel, szSdpFile);
+		}
+	}
+	
 	CarInfoInput tCarInfo;
 	tCarInfo.fVelocity = 60;
 	//tCarInfo.fVelocity = 0;
@@ -864,6 +1180,7 @@ int StreamSendProcess(int nDataChannel)
 		if (it != mapPicNames.end())
 		{
 			lStartTime = GetSystemTimeus();
+			tTiming.captureUs = GetMonotonicTimeus();
 			sprintf(cStreamFile, "%s/%s", szInPutPicPath, it->first.c_str());
 			fp = fopen(cStreamFile, "rb");
 			if (fp != NULL)
@@ -882,25 +1199,59 @@ int StreamSendProcess(int nDataChannel)
 					{
 						dec_frame.pw[0] = vir_addr_main;
 						MvConvertImage(vproc_path_id, &dec_frame, &frame_buffer);  //HD_VIDEO_PXLFMT_YUV420_W8->HD_VIDEO_PXLFMT_YUV420
+						tTiming.decodedUs = GetMonotonicTimeus();
 							
 						frame_buffer.count = nFrameId;
 						frame_buffer.timestamp = lStartTime/1000;
 						lSTime = GetSystemTimeus();
 						MvObjectEventDetect(nDataChannel, &frame_buffer, &tCarInfo);
 						lETime = GetSystemTimeus();
+						tTiming.detectedUs = GetMonotonicTimeus();
 						nDeltTime = (lETime - lSTime)/1000;
 					
-						// transport the image 
-						std::string basedStr = base64Encode( frame_buffer.pw[0], 1280*720*3/2);
-						std::cout << "basedStr Size: " << std::endl << basedStr.length() << std::endl;
-						struct sockaddr_in	client_dest_addr;
-				
-						client_dest_addr.sin_family = AF_INET;
-        					client_dest_addr.sin_addr.s_addr = inet_addr("192.168.22.69");
-        					client_dest_addr.sin_port = htons( 2333 );
-						int len2 = sizeof( client_dest_addr );						
+						//rtp 方式下源图像交给 RTP 发送线程打包发送, 不再走自有协议
+						if (g_bRtpOutput)
+						{
+							tRtpSender.submit((const unsigned char *)frame_buffer.pw[0],
+								pcs::rawFrameSize(pcs::PIXEL_FORMAT_I420, SOURCE_WIDTH, SOURCE_HEIGHT), tTiming.captureUs);
+						}
+					
+						// transport the image in the negotiated format
+						pthread_mutex_lock( &g_tStreamConfigMutex );
+						tConfig = g_tStreamConfig[nDataChannel];
+						pthread_mutex_unlock( &g_tStreamConfigMutex );
+
+						//显示端跟不上时直接跳过, 不再缩小和发送它来不及显示的帧
+						bool bSendFrame = !g_bRtpOutput && (nFrameId % tConfig.nFrameStep == 0);
+						if (bSendFrame)
+						{
+							pthread_mutex_lock( &g_tFlowMutex );
+							bSendFrame = g_tFlowControl[nDataChannel].admit( nFrameId, GetMonotonicTimems() );
+							pthread_mutex_unlock( &g_tFlowMutex );
+						}
+
+						const unsigned char *pSendFrame = (const unsigned char *)frame_buffer.pw[0];
+						int nSendSize = pcs::rawFrameSize( pcs::PIXEL_FORMAT_I420, tConfig.nWidth, tConfig.nHeight );
+						if (tConfig.nScale > 1 && bSendFrame)
+						{
+							vecScaled.resize( nSendSize );
+							DownscaleI420( pSendFrame, SOURCE_WIDTH, SOURCE_HEIGHT, tConfig.nScale, &vecScaled[0] );
+							pSendFrame = &vecScaled[0];
+						}
 
-						sendPieces( udp->getClientFd(), client_dest_addr, len2, basedStr );
+						pcs::FragmentHeader tFragHeader;
+						memset( &tFragHeader, 0, sizeof( tFragHeader ) );
+						tFragHeader.type = pcs::MSG_FRAGMENT;
+						tFragHeader.streamId = nDataChannel;
+						tFragHeader.frameId = nFrameId;
+						tTiming.streamId = nDataChannel;
+						tTiming.frameId = nFrameId;
+						// 网络变慢时发送队列丢弃旧帧, 不阻塞检测; 只有 UDP 传输有对时, 才发时间戳
+						if (bSendFrame)
+						{
+							g_pSender->submit( tFragHeader, pSendFrame, nSendSize, tConfig.tDestAddr,
+								g_bDatagramTransport ? &tTiming : NULL, tConfig.nFragSize );
+						}
 						
 						//printf("MvobjectEventDetect nDataChannel=%d=====nDeltTime=%d\n",nDataChannel, nDeltTime);
 						nFrameId++;
@@ -992,6 +1343,14 @@ int StreamSendProcess(int nDataChannel)
 	
 	MvVideoDecodeUnInit(vdec_path_id);
 	
+	if (g_bRtpOutput)
+	{
+		tRtpSender.stop();
+		pcs::RtpStats tRtpStats = tRtpSender.getStats();
+		printf("rtp frames=%u packets=%u octets=%llu reports=%u dropped=%u\n", tRtpStats.frames, tRtpStats.packets,
+			(unsigned long long)tRtpStats.octets, tRtpStats.reports, tRtpStats.dropped);
+	}
+	
 	printf("end  StreamSendProcess \n");
 	return 0;
 }
@@ -1048,6 +1407,138 @@ static void* SendFrontBsdStreamThread(void *pArg)
 	return NULL;
 }
 
+/*
+* 函数名称: RecvControlMessage 
+* 函数功能: 从一个 socket 读出一条控制消息并处理, 对时应答从原 socket 发回
+* 输入参数: nFd-可读的 socket
+* 输出参数: 无 
+* 返回值:   无
+*/ 
+static void RecvControlMessage(int nFd)
+{
+	unsigned char szMsg[pcs::NACK_HEADER_SIZE + 2 * pcs::MAX_NACK_INDICES];
+	unsigned char szResp[pcs::STREAM_DESC_SIZE];
+	pcs::TimeSyncMessage tSync;
+	pcs::StreamRequest tStreamReq;
+	pcs::StreamDescriptor tStreamDesc;
+	pcs::ReceiverReport tReport;
+	pcs::BackpressureMessage tBackpressure;
+	struct sockaddr_in tFromAddr;
+	socklen_t nFromLen = sizeof(tFromAddr);
+	
+	int nLen = recvfrom(nFd, szMsg, sizeof(szMsg), 0, (struct sockaddr *)&tFromAddr, &nFromLen);
+	if (nLen <= 0)
+	{
+		return;
+	}
+	long long lRecvTime = GetMonotonicTimeus();
+	
+	int nType = pcs::peekMessageType(szMsg, nLen);
+	if (nType == pcs::MSG_NACK)
+	{
+		g_tRetransmitRing.handleNack(szMsg, nLen, GetMonotonicTimems(), udp, udp->getClientFd(), tFromAddr);
+	}
+	else if (nType == pcs::MSG_TIME_REQ && pcs::decodeTimeSync(szMsg, nLen, tSync))
+	{
+		//显示端对时, 带回请求中的 t1, 填入收到请求和发出应答的设备时刻
+		tSync.t2 = lRecvTime;
+		tSync.t3 = GetMonotonicTimeus();
+		int nRespLen = pcs::encodeTimeSync(pcs::MSG_TIME_RESP, tSync, szResp);
+		sendto(nFd, szResp, nRespLen, 0, (struct sockaddr *)&tFromAddr, nFromLen);
+	}
+	else if (nType == pcs::MSG_STREAM_REQ && pcs::decodeStreamRequest(szMsg, nLen, tStreamReq))
+	{
+		//回应发往请求中的 data port, 显示端在接收图像的 socket 上收到流描述
+		if (NegotiateStream(&tStreamReq, &tFromAddr, &tStreamDesc))
+		{
+			struct sockaddr_in tReplyAddr = tFromAddr;
+			tReplyAddr.sin_port = htons(tStreamReq.dataPort);
+			int nRespLen = pcs::encodeStreamDescriptor(tStreamDesc, szResp);
+			udp->write(udp->getClientFd(), szResp, nRespLen, tReplyAddr);
+		}
+	}
+	else if (nType == pcs::MSG_RECV_REPORT && pcs::decodeReceiverReport(szMsg, nLen, tReport))
+	{
+		HandleReceiverReport(&tReport);
+	}
+	else if (nType == pcs::MSG_BACKPRESSURE && pcs::decodeBackpressure(szMsg, nLen, tBackpressure)
+		&& tBackpressure.streamId < pcs::MAX_STREAM_CHANNELS)
+	{
+		pthread_mutex_lock(&g_tFlowMutex);
+		//组播时可能有多个显示端, 按来源地址分别记录, 跟随最慢的一个
+		uint64_t lViewerId = ((uint64_t)ntohl(tFromAddr.sin_addr.s_addr) << 16) | ntohs(tFromAddr.sin_port);
+		g_tFlowControl[tBackpressure.streamId].onFeedback(tBackpressure, lViewerId, GetMonotonicTimems());
+		pthread_mutex_unlock(&g_tFlowMutex);
+	}
+}
+
+/*
+* 函数名称: RecvControlThread 
+* 函数功能: 接收显示端发回的控制消息(重传请求, 对时请求, 接收报告, 反压)和发现/协商请求并处理
+* 输入参数: pArg-线程参数
+* 输出参数: 无 
+* 返回值:   NULL
+*/ 
+static void* RecvControlThread(void *pArg)
+{
+	struct pollfd tPollFd[2];
+	int nPollNum = 1;
+	
+	tPollFd[0].fd = udp->getClientFd();
+	tPollFd[0].events = POLLIN;
+	tPollFd[0].revents = 0;
+	tPollFd[1].fd = -1;
+	tPollFd[1].events = POLLIN;
+	tPollFd[1].revents = 0;
+	if (g_nDiscoveryFd >= 0)
+	{
+		tPollFd[1].fd = g_nDiscoveryFd;
+		nPollNum = 2;
+	}
+	while(!GetCancelState())
+	{
+		if (poll(tPollFd, nPollNum, 100) <= 0)
+		{
+			continue;
+		}
+		
+		for (int i = 0; i < nPollNum; i++)
+		{
+			if (tPollFd[i].revents & POLLIN)
+			{
+				RecvControlMessage(tPollFd[i].fd);
+			}
+			else if (tPollFd[i].revents & POLLNVAL)
+			{
+				//socket 已关闭(退出时), 不再等待它, 避免 poll 立即返回而空转
+				tPollFd[i].fd = -1;
+			}
+			else if (tPollFd[i].revents & POLLERR)
+			{
+				//显示端端口不可达等 ICMP 错误, 取走挂起的错误后继续使用
+				int nError = 0;
+				socklen_t nErrorLen = sizeof(nError);
+				getsockopt(tPollFd[i].fd, SOL_SOCKET, SO_ERROR, &nError, &nErrorLen);
+			}
+		}
+	}
+	
+	pcs::RetransmitStats tStats = g_tRetransmitRing.getStats();
+	printf("RecvControlThread exit, nack=%u resent=%u stale=%u\n", tStats.nacks, tStats.resent, tStats.stale);
+	for (int nChannel = 0; nChannel < pcs::MAX_STREAM_CHANNELS; nChannel++)
+	{
+		pthread_mutex_lock(&g_tFlowMutex);
+		pcs::FlowStats tFlowStats = g_tFlowControl[nChannel].getStats();
+		pthread_mutex_unlock(&g_tFlowMutex);
+		if (tFlowStats.admitted > 0)
+		{
+			printf("channel %d flow control: admitted=%u in_flight=%u backlog=%u too_fast=%u\n", nChannel,
+				tFlowStats.admitted, tFlowStats.inFlight, tFlowStats.backlog, tFlowStats.tooFast);
+		}
+	}
+	return NULL;
+}
+
 
 
 //bsd算法结果处理函数	
@@ -1059,6 +1550,7 @@ void ProcessBsdAlgResult(int nDataChannel, ObjectTrackEventResult* pObjectTrackE
 		//printf("pObjectTrackEventResult->objInfo[i].nDetectType=%d\n",pObjectTrackEventResult->objInfo[i].nDetectType);
 		//printf("nLeft=%d,nTop=%d,nRight=%d,nBottom=%d\n",pObjectTrackEventResult->objInfo[i].nLeft,pObjectTrackEventResult->objInfo[i].nTop,pObjectTrackEventResult->objInfo[i].nRight,pObjectTrackEventResult->objInfo[i].nBottom);
 	}
+	SendObjectResult( nDataChannel, pObjectTrackEventResult );
 	return;
 }
 
@@ -1066,7 +1558,7 @@ void ProcessBsdAlgResult(int nDataChannel, ObjectTrackEventResult* pObjectTrackE
 void ProcessDsmAlgResult(int nDataChannel, ObjectTrackEventResult* pObjectTrackEventResult, void *pPrivData)
 {
 	printf("ProcessDsmAlgResult nDataChannel=%d,nFrameId=%d,nObjectNumber=%d,nEventType=%x\n",nDataChannel,pObjectTrackEventResult->nFrameId,pObjectTrackEventResult->nObjectNumber,pObjectTrackEventResult->nEventType);
-	
+	SendObjectResult( nDataChannel, pObjectTrackEventResult );
 	return;
 }
 
@@ -1080,7 +1572,7 @@ void VitualCamStop(int sigin)
 
 
 //测试程序主函数
-int main(int argc, char *argv[])  // ./testcase 1 picPath 1
+int main(int argc, char *argv[])  // ./testcase [udp|tcp|unix|shm|rtp]
 {
 	std::cout<<"------------------- Detect Program Begins ------------------"<<std::endl;	
 
@@ -1110,11 +1602,21 @@ int main(int argc, char *argv[])  // ./testcase 1 picPath 1
 	//int nCalibration = atoi(argv[2]);
 	int nCalibration = 0;
 	printf("nCalibration=%d\n",nCalibration);
+	
+	//传输方式
+	const char *szTransportName = (argc > 1) ? argv[1] : DEFAULT_TRANSPORT;
+	udp = CreateTransport(szTransportName);
+	if (udp == NULL){
+		printf("unknown transport %s, use udp/tcp/unix/shm/rtp\n", szTransportName);
+		return -1;
+	}
+	printf("transport=%s\n",szTransportName);
 	std::cout<<"-------------------------------------------------------------------------"<<std::endl;	
 
 	int nErr = 0;
 	pthread_t nSendAdasStreamThreadID;
 	pthread_attr_t tThreadAttrSendAdasStream;
+	pthread_t nRecvControlThreadID;
 	//pthread_t nCaptureAdasStreamThreadID;
 	//pthread_attr_t tThreadAttrCaptureAdasStream;
 	
@@ -1178,6 +1680,54 @@ int main(int argc, char *argv[])  // ./testcase 1 picPath 1
 	//-------------- Init a Socket Client-------------//    
         //pcs::Transport *udp = new pcs::TransportUDP();
         udp->initSocketClient();
+	udp->setFec( FEC_DATA_NUM, FEC_PARITY_NUM );
+	udp->setPacing( PACING_RATE_BPS, PACING_BURST_BYTES );
+	udp->setGso( USE_UDP_GSO );
+	if (USE_MULTICAST && g_bDatagramTransport){
+		if (udp->setMulticast(FRAME_MULTICAST_GROUP, MULTICAST_TTL, NULL, true)){
+			g_szFrameDestIp = FRAME_MULTICAST_GROUP;
+			g_bMulticast = true;
+		}
+		printf("frame dest %s:%d\n", g_szFrameDestIp, FRAME_DEST_PORT);
+	}
+	InitStreamConfig();
+	
+	//码率自适应: 按显示端的接收报告在源图像格式之下降低分辨率和帧率
+	if (USE_RATE_TRACE && g_bDatagramTransport){
+		g_pRateTrace = fopen(RATE_TRACE_FILE, "w");
+		if (g_pRateTrace != NULL){
+			pcs::RateController::writeTraceHeader(g_pRateTrace);
+		}
+	}
+	for (int nChannel = 0; nChannel < pcs::MAX_STREAM_CHANNELS; nChannel++){
+		g_tRateController[nChannel].setSource(SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_FPS);
+		g_tRateController[nChannel].setTrace(g_pRateTrace);
+	}
+	
+	//显示端可以广播发现/协商请求, 按自己能显示的格式接收
+	if (g_bDatagramTransport){
+		g_nDiscoveryFd = OpenDiscoverySocket();
+		printf("discovery port %d %s\n", pcs::STREAM_DISCOVERY_PORT, (g_nDiscoveryFd >= 0) ? "ok" : "error");
+	}
+	
+	//启动图像发送线程, 可靠传输不会丢帧, 不需要保存重传副本
+	g_pSender = new pcs::AsyncSender(udp, g_bDatagramTransport ? &g_tRetransmitRing : NULL);
+	if (!g_pSender->start()){
+		printf("AsyncSender start error\n");
+		return -1;
+	}
+	printf("AsyncSender start ok\n");
+
+	//启动控制消息接收线程, 处理显示端的重传请求(可靠传输不会丢帧, 不需要)
+	if (g_bDatagramTransport){
+		nErr = pthread_create(&nRecvControlThreadID, NULL, RecvControlThread, NULL);
+		if (nErr != 0){
+			printf("pthread_create RecvControlThread error\n");
+			return -1;
+		}
+		pthread_detach(nRecvControlThreadID);
+		printf("pthread_create RecvControlThread ok\n");
+	}
 
 
 	//启动adas通道线程
@@ -1225,6 +1775,28 @@ int main(int argc, char *argv[])  // ./testcase 1 picPath 1
 	#endif
 	while(!GetCancelState()) {
 		sleep(10);
+		
+		pcs::PacerStats tPacerStats;
+		if (udp->getPacerStats(tPacerStats))
+		{
+			printf("pacer rate=%lldbps achieved=%lldbps avgDelay=%lldus maxDelay=%lldus waits=%u\n",
+				(long long)tPacerStats.rateBps, (long long)tPacerStats.achievedBps,
+				(long long)tPacerStats.avgDelayUs, (long long)tPacerStats.maxDelayUs, tPacerStats.waits);
+		}
+
+		pcs::SocketStats tSockStats;
+		if (udp->getSocketStats(tSockStats))
+		{
+			printf("socket tx=%u pkts/%llu bytes rx=%u pkts/%llu bytes sendErr=%u(errno %d) rxDrop=%u inq=%d outq=%d\n",
+				tSockStats.txDatagrams, (unsigned long long)tSockStats.txBytes,
+				tSockStats.rxDatagrams, (unsigned long long)tSockStats.rxBytes,
+				tSockStats.sendErrors, tSockStats.lastSendErrno, tSockStats.rxDropped,
+				tSockStats.rxQueued, tSockStats.txQueued);
+		}
+
+		pcs::AsyncSenderStats tSenderStats = g_pSender->getStats();
+		printf("sender enqueued=%u sent=%u dropped=%u queued=%u\n",
+			tSenderStats.enqueued, tSenderStats.sent, tSenderStats.dropped, tSenderStats.queued);
 		#if 0
 		printf("selflearn state is %d \n",MvGetSelfLearnState());
 		if(MvGetSelfLearnState()==0)
@@ -1267,6 +1839,9 @@ int main(int argc, char *argv[])  // ./testcase 1 picPath 1
 	//nt sdk退出
 	NtSdkSysExit();
 
+	//停止图像发送并关闭传输, 共享内存传输时同时删除共享内存, 通知消费者
+	g_pSender->stop();
+	udp->closeSocket(udp->getClientFd());
 	
 	return 0;
 }
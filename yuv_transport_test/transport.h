@@ -12,6 +12,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "frame_protocol.h"
+#include "pacer.h"
+#include "socket_stats.h"
+
 #define ETH_NAME  "eth0"  
 
 namespace pcs
@@ -28,6 +32,61 @@ public:
 	virtual int write( int fd, unsigned char *buffer, int size, int port ) = 0;
 	virtual int write( int fd, unsigned char *buffer, int size, struct sockaddr_in &clientAddr ) = 0;	
 
+	// 按 fragSize 切分整帧并发送, header 为分片头模板(类型/通道号/帧号), 返回发送成功的分片数
+	virtual int writeFrame( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header, struct sockaddr_in &clientAddr ) = 0;
+
+	// 只发送整帧中序号为 indices 的数据分片(用于重传), 返回发送成功的分片数
+	virtual int writeFragments( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header,
+				const uint16_t *indices, int count, struct sockaddr_in &clientAddr ) = 0;
+
+	// 发往 destAddr 的分片不被 IP 层再切分时能携带的最大图像数据长度
+	virtual int getFragmentSize( struct sockaddr_in &destAddr )
+	{
+		return fragmentSizeForMtu( DEFAULT_PATH_MTU );
+	}
+
+	// 每 dataNum 个分片附加 parityNum 个前向纠错校验分片, parityNum 为 0 时关闭; 不支持的传输方式返回 false
+	virtual bool setFec( int dataNum, int parityNum )
+	{
+		return false;
+	}
+
+	// 按 bitsPerSec 码率匀速发送分片, 每次最多突发 burstBytes 字节, bitsPerSec 为 0 时关闭; 不支持的传输方式返回 false
+	virtual bool setPacing( int64_t bitsPerSec, int burstBytes )
+	{
+		return false;
+	}
+
+	// 之后发往组播地址 group 的数据报只发送一次, 由网络复制给所有加入该组的接收端;
+	// ttl 为组播跳数, ifaceIp 为出口网卡地址(NULL 时由路由决定), loop 控制本机的接收端是否也能收到
+	virtual bool setMulticast( const char *group, int ttl, const char *ifaceIp, bool loop )
+	{
+		return false;
+	}
+
+	// 由内核(或网卡)把多个分片一次切分发送以减少系统调用, 内核不支持时返回 false
+	virtual bool setGso( bool enable )
+	{
+		return false;
+	}
+
+	virtual bool getPacerStats( PacerStats &stats )
+	{
+		return false;
+	}
+
+	// 本传输方式的节拍器, 同一设备的其他输出 (如 RTP) 共用它, 合计不超过 setPacing 设定的码率; 不支持的传输方式返回 NULL
+	virtual Pacer* getPacer()
+	{
+		return NULL;
+	}
+
+	// 收发字节数, 数据报数, 发送错误, 内核丢包和队列积压, 不支持的传输方式返回 false
+	virtual bool getSocketStats( SocketStats &stats )
+	{
+		return false;
+	}
+
 	virtual void closeSocket( int fd ) = 0;
 
 	virtual bool initSocketServer( const int port ) = 0;
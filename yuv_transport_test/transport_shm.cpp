@@ -0,0 +1,348 @@
+#include "transport_shm.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define SHM_RING_MAGIC	0x50435352	// "PCSR"
+#define SHM_ALIGN	64
+
+namespace pcs{
+
+static int futexWait( volatile uint32_t *addr, uint32_t value, int timeoutMs )
+{
+	struct timespec ts;
+	struct timespec *pts = NULL;
+	if( timeoutMs >= 0 ){
+		ts.tv_sec = timeoutMs / 1000;
+		ts.tv_nsec = ( timeoutMs % 1000 ) * 1000000;
+		pts = &ts;
+	}
+	// 共享内存跨进程等待, 不能用 FUTEX_PRIVATE_FLAG
+	return syscall( SYS_futex, addr, FUTEX_WAIT, value, pts, NULL, 0 );
+}
+
+static void futexWakeAll( volatile uint32_t *addr )
+{
+	syscall( SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+}
+
+TransportShm::TransportShm( const char *name, int slotNum, int slotSize ) : shmName(name),
+									slotNum(slotNum),
+									slotSize(slotSize),
+									shmFd(-1),
+									producer(false),
+									base(NULL),
+									mapSize(0),
+									ring(NULL),
+									readSeq(0),
+									dropped(0)
+{
+	pthread_mutex_init( &publishMutex, NULL );
+}
+
+TransportShm::~TransportShm()
+{
+	closeSocket( shmFd );
+	pthread_mutex_destroy( &publishMutex );
+}
+
+bool TransportShm::mapRing( int prot )
+{
+	void *addr = mmap( NULL, mapSize, prot, MAP_SHARED, shmFd, 0 );
+	if( addr == MAP_FAILED ){
+		std::cerr<<"mmap shared memory failed ..."<<std::endl;
+		return false;
+	}
+	base = (unsigned char *)addr;
+	ring = (RingHeader *)base;
+	return true;
+}
+
+TransportShm::SlotHeader* TransportShm::slotAt( uint32_t index ) const
+{
+	return (SlotHeader *)( base + SHM_ALIGN + (size_t)( index % ring->slotNum ) * ring->slotStride );
+}
+
+bool TransportShm::initSocketClient()
+{
+	// 上一次运行没有正常退出时共享内存还在, 删掉重建; 仍映射着旧环的消费者由 isProducerAlive 发现
+	shm_unlink( shmName.c_str() );
+	shmFd = shm_open( shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644 );
+	if( shmFd < 0 ){
+		std::cerr<<"shm_open "<<shmName<<" failed ..."<<std::endl;
+		return false;
+	}
+
+	uint32_t stride = ( sizeof( SlotHeader ) + slotSize + SHM_ALIGN - 1 ) / SHM_ALIGN * SHM_ALIGN;
+	mapSize = SHM_ALIGN + (size_t)slotNum * stride;
+	if( ftruncate( shmFd, mapSize ) < 0 || !mapRing( PROT_READ | PROT_WRITE ) ){
+		std::cerr<<"create shared memory ring failed ..."<<std::endl;
+		close( shmFd );
+		shmFd = -1;
+		shm_unlink( shmName.c_str() );
+		return false;
+	}
+
+	memset( base, 0, SHM_ALIGN );
+	ring->slotNum = slotNum;
+	ring->slotSize = slotSize;
+	ring->slotStride = stride;
+	ring->writeSeq = 0;
+	for( int i = 0; i < slotNum; i ++ ){
+		memset( slotAt( i ), 0, sizeof( SlotHeader ) );
+	}
+	__sync_synchronize();
+	ring->magic = SHM_RING_MAGIC;
+
+	producer = true;
+	std::cerr<<"initialize the shared memory ring successfull: "<<shmName<<std::endl;
+	return true;
+}
+
+bool TransportShm::initSocketServer( const int port )
+{
+	shmFd = shm_open( shmName.c_str(), O_RDONLY, 0 );
+	if( shmFd < 0 ){
+		std::cerr<<"shm_open "<<shmName<<" failed ..."<<std::endl;
+		return false;
+	}
+
+	struct stat st;
+	if( fstat( shmFd, &st ) < 0 || st.st_size < SHM_ALIGN ){
+		std::cerr<<"shared memory ring is not ready ..."<<std::endl;
+		close( shmFd );
+		shmFd = -1;
+		return false;
+	}
+
+	mapSize = st.st_size;
+	if( !mapRing( PROT_READ ) ){
+		close( shmFd );
+		shmFd = -1;
+		return false;
+	}
+	if( ring->magic != SHM_RING_MAGIC || SHM_ALIGN + (size_t)ring->slotNum * ring->slotStride > mapSize ){
+		std::cerr<<"invalid shared memory ring ..."<<std::endl;
+		closeSocket( shmFd );
+		return false;
+	}
+
+	slotNum = ring->slotNum;
+	slotSize = ring->slotSize;
+	readSeq = ring->writeSeq;
+	producer = false;
+	return true;
+}
+
+int TransportShm::publish( uint8_t type, uint16_t streamId, uint32_t frameId, const unsigned char *data, int size )
+{
+	if( !producer ){
+		return -1;
+	}
+	if( size > slotSize ){
+		std::cerr<<"frame is larger than the shared memory slot: "<<size<<std::endl;
+		return -1;
+	}
+
+	pthread_mutex_lock( &publishMutex );
+	uint32_t index = ring->writeSeq;
+	SlotHeader *slot = slotAt( index );
+
+	// 顺序锁: 写之前版本号变为奇数, 写完再变回偶数
+	slot->seq ++;
+	__sync_synchronize();
+	slot->index = index;
+	slot->type = type;
+	slot->streamId = streamId;
+	slot->frameId = frameId;
+	slot->size = size;
+	memcpy( (unsigned char *)( slot + 1 ), data, size );
+	__sync_synchronize();
+	slot->seq ++;
+
+	__sync_synchronize();
+	ring->writeSeq = index + 1;
+	futexWakeAll( &ring->writeSeq );
+	pthread_mutex_unlock( &publishMutex );
+
+	return size;
+}
+
+bool TransportShm::acquireFrame( ShmFrameView &view, int timeoutMs )
+{
+	if( ring == NULL ){
+		return false;
+	}
+
+	while( true ){
+		if( ring->magic != SHM_RING_MAGIC ){
+			return false;
+		}
+		uint32_t writeSeq = ring->writeSeq;
+		if( writeSeq == readSeq ){
+			if( futexWait( &ring->writeSeq, readSeq, timeoutMs ) < 0 && errno == ETIMEDOUT ){
+				return false;
+			}
+			continue;
+		}
+
+		// 落后超过一圈, 跳到生产者下一次写之前不会覆盖的最旧一帧
+		if( writeSeq - readSeq > (uint32_t)slotNum - 1 ){
+			dropped += writeSeq - readSeq - ( slotNum - 1 );
+			readSeq = writeSeq - ( slotNum - 1 );
+		}
+
+		SlotHeader *slot = slotAt( readSeq );
+		uint32_t seq = slot->seq;
+		__sync_synchronize();
+		if( ( seq & 1 ) || slot->index != readSeq ){
+			// 正在被覆盖, 这一帧已经丢了
+			readSeq ++;
+			dropped ++;
+			continue;
+		}
+
+		view.type = slot->type;
+		view.streamId = slot->streamId;
+		view.frameId = slot->frameId;
+		view.size = slot->size;
+		view.data = (const unsigned char *)( slot + 1 );
+		view.index = readSeq;
+		view.seq = seq;
+
+		readSeq ++;
+		return true;
+	}
+}
+
+bool TransportShm::isProducerAlive() const
+{
+	if( ring == NULL || ring->magic != SHM_RING_MAGIC ){
+		return false;
+	}
+	// 生产者崩溃后重启会新建同名的共享内存, 与当前映射的不是同一个对象
+	int fd = shm_open( shmName.c_str(), O_RDONLY, 0 );
+	if( fd < 0 ){
+		return false;
+	}
+	struct stat current;
+	struct stat mapped;
+	bool same = fstat( fd, &current ) == 0 && fstat( shmFd, &mapped ) == 0
+		&& current.st_dev == mapped.st_dev && current.st_ino == mapped.st_ino;
+	close( fd );
+	return same;
+}
+
+bool TransportShm::releaseFrame( const ShmFrameView &view )
+{
+	__sync_synchronize();
+	return slotAt( view.index )->seq == view.seq;
+}
+
+int TransportShm::read( int fd, unsigned char *buffer, int size )
+{
+	ShmFrameView view;
+	if( !acquireFrame( view, -1 ) ){
+		return -1;
+	}
+
+	int len = ( view.size < size ) ? view.size : size;
+	memcpy( buffer, view.data, len );
+	if( !releaseFrame( view ) ){
+		std::cerr<<"shared memory slot overwritten while reading ..."<<std::endl;
+		return -1;
+	}
+	return len;
+}
+
+int TransportShm::write( int fd, unsigned char *buffer, int size )
+{
+	return publish( 0, 0, 0, buffer, size );
+}
+
+int TransportShm::write( int fd, unsigned char *buffer, int size, int port )
+{
+	return publish( 0, 0, 0, buffer, size );
+}
+
+int TransportShm::write( int fd, unsigned char *buffer, int size, struct sockaddr_in &clientAddr )
+{
+	return publish( 0, 0, 0, buffer, size );
+}
+
+int TransportShm::writeFrame( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header, struct sockaddr_in &clientAddr )
+{
+	// 整帧一次写入, 为与 UDP 一致返回等价的分片数
+	if( publish( header.type, header.streamId, header.frameId, frame, size ) < 0 ){
+		return 0;
+	}
+	return fragmentCount( size, fragSize );
+}
+
+int TransportShm::writeFragments( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header,
+				const uint16_t *indices, int count, struct sockaddr_in &clientAddr )
+{
+	// 共享内存中的帧总是完整的, 不会有重传请求
+	return 0;
+}
+
+int TransportShm::getFragmentSize( struct sockaddr_in &destAddr )
+{
+	return slotSize;
+}
+
+void TransportShm::closeSocket( int fd )
+{
+	// 生产者: 标记环已关闭并唤醒所有等待的消费者, 然后删除共享内存, 不留给下一次运行
+	if( producer && ring != NULL ){
+		ring->magic = 0;
+		__sync_synchronize();
+		futexWakeAll( &ring->writeSeq );
+		shm_unlink( shmName.c_str() );
+		producer = false;
+	}
+	if( base != NULL ){
+		munmap( base, mapSize );
+		base = NULL;
+		ring = NULL;
+	}
+	if( shmFd >= 0 ){
+		close( shmFd );
+		shmFd = -1;
+	}
+}
+
+const int TransportShm::getClientFd() const
+{
+	return shmFd;
+}
+
+int TransportShm::getClientFd()
+{
+	return shmFd;
+}
+
+const int TransportShm::getServerFd() const
+{
+	return shmFd;
+}
+
+int TransportShm::getServerFd()
+{
+	return shmFd;
+}
+
+struct sockaddr_in TransportShm::getRecvAddr()
+{
+	struct sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	return addr;
+}
+
+}
@@ -0,0 +1,127 @@
+#ifndef __TRANSPORT_SHM_H_
+#define __TRANSPORT_SHM_H_
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "transport.h"
+
+#define SHM_RING_NAME		"/pcs_frames"		// shm_open 的名字
+#define SHM_RING_SLOT_NUM	4			// 帧槽数
+#define SHM_RING_SLOT_SIZE	( 1920 * 1080 * 3 / 2 )	// 每个帧槽能容纳的最大帧长
+
+namespace pcs{
+
+// 共享内存中的一帧, data 直接指向只读映射, 不做拷贝
+struct ShmFrameView
+{
+	uint8_t type;		// MSG_FRAGMENT 为图像帧, 0 为 write() 写入的普通消息
+	uint16_t streamId;
+	uint32_t frameId;
+	const unsigned char *data;
+	int size;
+
+	uint32_t index;		// 帧在环中的序号
+	uint32_t seq;		// 取帧时槽的版本号, 用于检查是否被覆盖
+};
+
+/*
+ * 同一主机上的进程间传输: POSIX 共享内存中的帧槽环, 一个生产者多个消费者.
+ * 生产者 (initSocketClient) 把整帧写入下一个槽后用 futex 唤醒所有消费者;
+ * 消费者 (initSocketServer) 只读映射共享内存, 用 acquireFrame/releaseFrame 直接访问槽中的数据.
+ * 每个槽带一个顺序锁版本号, 消费者太慢被生产者追上时能发现数据已被覆盖.
+ * 生产者进程内检测结果和图像帧由不同线程写入, publish 持锁, 同一时刻只有一个写者.
+ * 生产者关闭时删除共享内存并标记环已关闭, 消费者的 acquireFrame 随即返回 false, 应重新 initSocketServer;
+ * 生产者重启时总是新建共享内存, 不会接着用上一次留下的状态. shm_reader.cpp 是一个最小的消费者.
+ */
+class TransportShm: public Transport
+{
+public:
+	TransportShm( const char *name = SHM_RING_NAME, int slotNum = SHM_RING_SLOT_NUM, int slotSize = SHM_RING_SLOT_SIZE );
+	virtual ~TransportShm();
+
+	virtual int read( int fd, unsigned char *buffer, int size );
+	virtual int write( int fd, unsigned char *buffer, int size );
+	virtual int write( int fd, unsigned char *buffer, int size, int port );
+	virtual int write( int fd, unsigned char *buffer, int size, struct sockaddr_in &clientAddr );
+
+	virtual int writeFrame( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header, struct sockaddr_in &clientAddr );
+	virtual int writeFragments( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header,
+				const uint16_t *indices, int count, struct sockaddr_in &clientAddr );
+	virtual int getFragmentSize( struct sockaddr_in &destAddr );
+
+	virtual void closeSocket( int fd );
+
+	// 消费者: 打开已存在的共享内存, port 不使用
+	virtual bool initSocketServer( const int port );
+	// 生产者: 创建共享内存
+	virtual bool initSocketClient();
+
+	virtual const int getClientFd() const;
+	virtual int getClientFd();
+
+	virtual const int getServerFd() const;
+	virtual int getServerFd();
+
+	virtual struct sockaddr_in getRecvAddr();
+
+	// 等待下一帧, timeoutMs 为 -1 时一直等待; 消费者落后超过一圈时跳到最旧的可用帧; 超时或生产者已关闭时返回 false
+	bool acquireFrame( ShmFrameView &view, int timeoutMs );
+
+	// 消费者: 生产者是否还在使用当前映射的环, 关闭或重启后返回 false
+	bool isProducerAlive() const;
+
+	// 用完一帧后调用, 返回 false 表示使用期间该槽已被生产者覆盖, 读到的数据不可信
+	bool releaseFrame( const ShmFrameView &view );
+
+	// 消费者因落后而跳过的帧数
+	uint32_t getDroppedCount() const
+	{
+		return dropped;
+	}
+
+private:
+	struct RingHeader
+	{
+		uint32_t magic;
+		uint32_t slotNum;
+		uint32_t slotSize;
+		uint32_t slotStride;
+		volatile uint32_t writeSeq;	// 已发布的帧数, 同时作为 futex 等待的字
+	};
+
+	struct SlotHeader
+	{
+		volatile uint32_t seq;		// 奇数表示正在写
+		volatile uint32_t index;	// 槽中帧在环中的序号
+		uint8_t type;
+		uint16_t streamId;
+		uint32_t frameId;
+		uint32_t size;
+	};
+
+	bool mapRing( int prot );
+	SlotHeader* slotAt( uint32_t index ) const;
+	int publish( uint8_t type, uint16_t streamId, uint32_t frameId, const unsigned char *data, int size );
+
+	std::string shmName;
+	int slotNum;
+	int slotSize;
+
+	int shmFd;
+	bool producer;
+	unsigned char *base;
+	size_t mapSize;
+	RingHeader *ring;
+
+	uint32_t readSeq;
+	uint32_t dropped;
+
+	pthread_mutex_t publishMutex;
+};
+
+}
+
+#endif
@@ -0,0 +1,310 @@
+#include "transport_stream.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+namespace pcs{
+
+TransportStream::TransportStream() : clientFd(-1),
+				listenFd(-1),
+				serverFd(-1),
+				lastConnectMs(0)
+{
+	memset( &recvAddr, 0, sizeof( recvAddr ) );
+	memset( &peerAddr, 0, sizeof( peerAddr ) );
+	pthread_mutex_init( &writeMutex, NULL );
+}
+
+TransportStream::~TransportStream()
+{
+	disconnect();
+	pthread_mutex_destroy( &writeMutex );
+	if( serverFd >= 0 ){
+		close( serverFd );
+	}
+	if( listenFd >= 0 ){
+		close( listenFd );
+	}
+}
+
+int64_t TransportStream::nowMs()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void TransportStream::setBuffers( int fd )
+{
+	int size = STREAM_SOCKET_BUFFER;
+	if( setsockopt( fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof( size ) ) < 0
+		|| setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof( size ) ) < 0 ){
+		std::cerr<<"set stream socket buffer failed ..."<<std::endl;
+	}
+}
+
+bool TransportStream::initSocketClient()
+{
+	// 连接在第一次写时建立, 目的地址随写接口传入
+	return true;
+}
+
+bool TransportStream::initSocketServer( const int port )
+{
+	listenFd = listenLocal( port );
+	if( listenFd < 0 ){
+		return false;
+	}
+
+	std::cerr<<"Initialize the stream server successfull ..."<<listenFd<<std::endl;
+	return true;
+}
+
+bool TransportStream::ensureConnected( struct sockaddr_in &destAddr )
+{
+	if( clientFd >= 0 ){
+		return true;
+	}
+
+	int64_t now = nowMs();
+	if( lastConnectMs != 0 && now - lastConnectMs < STREAM_RECONNECT_MS ){
+		return false;
+	}
+	lastConnectMs = now;
+	peerAddr = destAddr;
+
+	clientFd = connectPeer( peerAddr );
+	return clientFd >= 0;
+}
+
+void TransportStream::disconnect()
+{
+	if( clientFd >= 0 ){
+		close( clientFd );
+		clientFd = -1;
+	}
+}
+
+bool TransportStream::sendAll( struct iovec *iov, int iovcnt )
+{
+	while( iovcnt > 0 ){
+		struct msghdr msg;
+		memset( &msg, 0, sizeof( msg ) );
+		msg.msg_iov = iov;
+		msg.msg_iovlen = ( iovcnt < IOV_MAX ) ? iovcnt : IOV_MAX;
+
+		ssize_t ret = sendmsg( clientFd, &msg, MSG_NOSIGNAL );
+		if( ret < 0 ){
+			if( errno == EINTR ){
+				continue;
+			}
+			std::cerr<<"send data falied, connection closed ..."<<std::endl;
+			disconnect();
+			return false;
+		}
+
+		// 跳过已经写完的部分, 继续写剩下的
+		while( iovcnt > 0 && (size_t)ret >= iov->iov_len ){
+			ret -= iov->iov_len;
+			iov ++;
+			iovcnt --;
+		}
+		if( iovcnt > 0 ){
+			iov->iov_base = (unsigned char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+	return true;
+}
+
+int TransportStream::write( int fd, unsigned char *buffer, int size )
+{
+	return write( fd, buffer, size, peerAddr );
+}
+
+int TransportStream::write( int fd, unsigned char *buffer, int size, int port )
+{
+	return write( fd, buffer, size, peerAddr );
+}
+
+int TransportStream::write( int fd, unsigned char *buffer, int size, struct sockaddr_in &clientAddr )
+{
+	pthread_mutex_lock( &writeMutex );
+	if( !ensureConnected( clientAddr ) ){
+		pthread_mutex_unlock( &writeMutex );
+		return false;
+	}
+
+	unsigned char length[STREAM_LENGTH_SIZE];
+	putU32( length, size );
+
+	struct iovec iov[2];
+	iov[0].iov_base = length;
+	iov[0].iov_len = STREAM_LENGTH_SIZE;
+	iov[1].iov_base = buffer;
+	iov[1].iov_len = size;
+	bool ok = sendAll( iov, 2 );
+	pthread_mutex_unlock( &writeMutex );
+	return ok ? size : false;
+}
+
+int TransportStream::writeFrame( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header, struct sockaddr_in &clientAddr )
+{
+	pthread_mutex_lock( &writeMutex );
+	if( !ensureConnected( clientAddr ) ){
+		pthread_mutex_unlock( &writeMutex );
+		return 0;
+	}
+
+	FragmentHeader fragHeader = header;
+	fragHeader.fragCount = fragmentCount( size, fragSize );
+	fragHeader.frameSize = size;
+	fragHeader.fecParams = 0;
+
+	// 每个分片为 [长度 | 分片头 | 帧数据] 三段, 帧数据直接指向帧缓存
+	const int prefixSize = STREAM_LENGTH_SIZE + FRAGMENT_HEADER_SIZE;
+	heads.resize( fragHeader.fragCount * prefixSize );
+	iovs.resize( fragHeader.fragCount * 2 );
+	for( int i = 0; i < fragHeader.fragCount; i ++ ){
+		fragHeader.fragIndex = i;
+		fragHeader.offset = i * fragSize;
+		fragHeader.payloadLen = ( size - (int)fragHeader.offset < fragSize ) ? ( size - fragHeader.offset ) : fragSize;
+
+		unsigned char *head = &heads[i * prefixSize];
+		putU32( head, FRAGMENT_HEADER_SIZE + fragHeader.payloadLen );
+		encodeFragmentHeader( fragHeader, head + STREAM_LENGTH_SIZE );
+
+		iovs[i * 2].iov_base = head;
+		iovs[i * 2].iov_len = prefixSize;
+		iovs[i * 2 + 1].iov_base = (void *)( frame + fragHeader.offset );
+		iovs[i * 2 + 1].iov_len = fragHeader.payloadLen;
+	}
+
+	setCork( clientFd, true );
+	bool ok = iovs.empty() || sendAll( &iovs[0], iovs.size() );
+	if( clientFd >= 0 ){
+		setCork( clientFd, false );
+	}
+	pthread_mutex_unlock( &writeMutex );
+	return ok ? fragHeader.fragCount : 0;
+}
+
+int TransportStream::writeFragments( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header,
+				const uint16_t *indices, int count, struct sockaddr_in &clientAddr )
+{
+	// 可靠有序的字节流不会丢分片, 不需要重传
+	return 0;
+}
+
+int TransportStream::getFragmentSize( struct sockaddr_in &destAddr )
+{
+	// 字节流没有 MTU 限制, 用最大的分片减少分片头数目
+	return MAX_FRAGMENT_PAYLOAD;
+}
+
+bool TransportStream::readFull( int fd, unsigned char *buffer, int size )
+{
+	int done = 0;
+	while( done < size ){
+		ssize_t ret = recv( fd, buffer + done, size - done, 0 );
+		if( ret < 0 && errno == EINTR ){
+			continue;
+		}
+		if( ret <= 0 ){
+			return false;
+		}
+		done += ret;
+	}
+	return true;
+}
+
+int TransportStream::read( int fd, unsigned char *buffer, int size )
+{
+	if( serverFd < 0 ){
+		socklen_t len = sizeof( recvAddr );
+		serverFd = accept( listenFd, ( struct sockaddr* )&recvAddr, &len );
+		if( serverFd < 0 ){
+			std::cerr<<"accept failed ..."<<std::endl;
+			return -1;
+		}
+		setBuffers( serverFd );
+	}
+
+	unsigned char length[STREAM_LENGTH_SIZE];
+	if( !readFull( serverFd, length, STREAM_LENGTH_SIZE ) ){
+		std::cerr<<"connection closed by peer ..."<<std::endl;
+		close( serverFd );
+		serverFd = -1;
+		return -1;
+	}
+
+	// 超出缓存的部分读出丢弃, 保持消息边界
+	int msgLen = getU32( length );
+	int len = ( msgLen < size ) ? msgLen : size;
+	bool ok = readFull( serverFd, buffer, len );
+	unsigned char discard[1024];
+	for( int left = msgLen - len; ok && left > 0; ){
+		int n = ( left < (int)sizeof( discard ) ) ? left : sizeof( discard );
+		ok = readFull( serverFd, discard, n );
+		left -= n;
+	}
+	if( !ok ){
+		close( serverFd );
+		serverFd = -1;
+		return -1;
+	}
+	return len;
+}
+
+void TransportStream::closeSocket( int fd )
+{
+	if( fd < 0 ){
+		return;
+	}
+	pthread_mutex_lock( &writeMutex );
+	if( fd == clientFd ){
+		disconnect();
+		pthread_mutex_unlock( &writeMutex );
+		return;
+	}
+	pthread_mutex_unlock( &writeMutex );
+	if( fd == serverFd ){
+		serverFd = -1;
+	}
+	else if( fd == listenFd ){
+		listenFd = -1;
+	}
+	close( fd );
+}
+
+const int TransportStream::getClientFd() const
+{
+	return clientFd;
+}
+
+int TransportStream::getClientFd()
+{
+	return clientFd;
+}
+
+const int TransportStream::getServerFd() const
+{
+	return ( serverFd >= 0 ) ? serverFd : listenFd;
+}
+
+int TransportStream::getServerFd()
+{
+	return ( serverFd >= 0 ) ? serverFd : listenFd;
+}
+
+struct sockaddr_in TransportStream::getRecvAddr()
+{
+	return recvAddr;
+}
+
+}
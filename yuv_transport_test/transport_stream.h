@@ -0,0 +1,96 @@
+#ifndef __TRANSPORT_STREAM_H_
+#define __TRANSPORT_STREAM_H_
+
+#include <iostream>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <vector>
+
+#include "transport.h"
+
+#define STREAM_SOCKET_BUFFER	( 4 * 1024 * 1024 )	// 收发缓存大小
+#define STREAM_RECONNECT_MS	1000			// 连接断开后重连的最小间隔
+#define STREAM_LENGTH_SIZE	4			// 每条消息前的长度字段
+
+namespace pcs{
+
+/*
+ * 面向连接的字节流传输的公共部分 (TCP / Unix 域 socket).
+ * 每条消息前加 4 字节大端长度; 图像帧仍按分片头切成若干消息, 接收端可以直接交给 FrameReassembler.
+ * 发送端 (initSocketClient) 在第一次写时连接对端, 断开后按 STREAM_RECONNECT_MS 间隔重连;
+ * 接收端 (initSocketServer) 在第一次读时接受一个连接.
+ * 写接口的 fd 参数不使用, 总是写到当前连接上; 检测结果 (检测线程) 和图像帧 (发送线程) 共用一个连接,
+ * 写接口持锁写完整条消息或一帧的全部分片, 长度前缀的消息不会交错.
+ */
+class TransportStream: public Transport
+{
+public:
+	TransportStream();
+	virtual ~TransportStream();
+
+	virtual int read( int fd, unsigned char *buffer, int size );
+	virtual int write( int fd, unsigned char *buffer, int size );
+	virtual int write( int fd, unsigned char *buffer, int size, int port );
+	virtual int write( int fd, unsigned char *buffer, int size, struct sockaddr_in &clientAddr );
+
+	virtual int writeFrame( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header, struct sockaddr_in &clientAddr );
+	virtual int writeFragments( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header,
+				const uint16_t *indices, int count, struct sockaddr_in &clientAddr );
+	virtual int getFragmentSize( struct sockaddr_in &destAddr );
+
+	virtual void closeSocket( int fd );
+
+	virtual bool initSocketServer( const int port );
+	virtual bool initSocketClient();
+
+	virtual const int getClientFd() const;
+	virtual int getClientFd();
+
+	virtual const int getServerFd() const;
+	virtual int getServerFd();
+
+	virtual struct sockaddr_in getRecvAddr();
+
+protected:
+	// 由子类创建并连接/监听 socket, 失败返回 -1
+	virtual int connectPeer( struct sockaddr_in &peerAddr ) = 0;
+	virtual int listenLocal( const int port ) = 0;
+
+	// 一帧的分片写完之前不发出不满的报文 (TCP_CORK), 不支持时为空
+	virtual void setCork( int fd, bool on )
+	{
+
+	}
+
+	static void setBuffers( int fd );
+
+	struct sockaddr_in recvAddr;
+
+private:
+	bool ensureConnected( struct sockaddr_in &destAddr );
+	bool sendAll( struct iovec *iov, int iovcnt );
+	bool readFull( int fd, unsigned char *buffer, int size );
+	void disconnect();
+	static int64_t nowMs();
+
+	int clientFd;
+	int listenFd;
+	int serverFd;
+	int64_t lastConnectMs;
+	struct sockaddr_in peerAddr;	// 最近一次连接的对端, 不带地址的写接口写到这里
+
+	std::vector<unsigned char> heads;
+	std::vector<struct iovec> iovs;
+
+	pthread_mutex_t writeMutex;	// 保护 clientFd, peerAddr 及以上写缓存
+};
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "transport_tcp.h"
+
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+namespace pcs{
+
+TransportTCP::TransportTCP() : noDelay(true),
+				corkEnabled(true)
+{
+
+}
+
+int TransportTCP::connectPeer( struct sockaddr_in &peerAddr )
+{
+	int fd = socket( AF_INET, SOCK_STREAM, 0 );
+	if( fd < 0 ){
+		std::cerr<<"socket TCP client falied ..."<<std::endl;
+		return -1;
+	}
+
+	// 缓存要在连接之前设置才会影响窗口大小
+	setBuffers( fd );
+	int on = noDelay ? 1 : 0;
+	setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+
+	// 非阻塞连接, 最多等待 TCP_CONNECT_TIMEOUT_MS, 连上后恢复为阻塞 socket
+	int flags = fcntl( fd, F_GETFL, 0 );
+	fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+	int err = 0;
+	if( connect( fd, ( struct sockaddr* )&peerAddr, sizeof( peerAddr ) ) < 0 ){
+		err = errno;
+		if( err == EINPROGRESS ){
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			int ret = poll( &pfd, 1, TCP_CONNECT_TIMEOUT_MS );
+			if( ret > 0 ){
+				socklen_t len = sizeof( err );
+				getsockopt( fd, SOL_SOCKET, SO_ERROR, &err, &len );
+			}
+			else {
+				err = ( ret == 0 ) ? ETIMEDOUT : errno;
+			}
+		}
+	}
+	if( err != 0 ){
+		std::cerr<<"connect to "<<inet_ntoa( peerAddr.sin_addr )<<":"<<ntohs( peerAddr.sin_port )<<" failed: "<<strerror( err )<<std::endl;
+		close( fd );
+		return -1;
+	}
+	fcntl( fd, F_SETFL, flags );
+
+	std::cerr<<"connect to the tcp server successfull: "<<fd<<std::endl;
+	return fd;
+}
+
+int TransportTCP::listenLocal( const int port )
+{
+	int fd = socket( AF_INET, SOCK_STREAM, 0 );
+	if( fd < 0 ){
+		std::cerr<<"socket TCP server failed ..."<<std::endl;
+		return -1;
+	}
+
+	int on = 1;
+	setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+	setBuffers( fd );
+
+	struct sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_ANY );
+	addr.sin_port = htons( port );
+	if( bind( fd, ( struct sockaddr* )&addr, sizeof( addr ) ) < 0 || listen( fd, 1 ) < 0 ){
+		std::cerr<<"Bind the addr failed ..."<<std::endl;
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+void TransportTCP::setCork( int fd, bool on )
+{
+	if( !corkEnabled ){
+		return;
+	}
+	int value = on ? 1 : 0;
+	setsockopt( fd, IPPROTO_TCP, TCP_CORK, &value, sizeof( value ) );
+}
+
+}
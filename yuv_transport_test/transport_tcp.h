@@ -0,0 +1,45 @@
+#ifndef __TRANSPORT_TCP_H_
+#define __TRANSPORT_TCP_H_
+
+#include "transport_stream.h"
+
+#define TCP_CONNECT_TIMEOUT_MS	500	// 连接超时, 小于重连间隔; 对端不可达时不会把发送线程阻塞到内核的 SYN 超时
+
+namespace pcs{
+
+/*
+ * TCP 传输: 默认开启 TCP_NODELAY, 检测结果等小消息立即发出;
+ * 写一帧的分片期间开启 TCP_CORK, 分片头和帧数据合并成满长度的报文.
+ */
+class TransportTCP: public TransportStream
+{
+public:
+	TransportTCP();
+	virtual ~TransportTCP()
+	{
+		std::cout<<"deconstructure of class TransportTCP..."<<std::endl;
+	}
+
+	void setNoDelay( bool on )
+	{
+		noDelay = on;
+	}
+
+	void setCorkEnabled( bool on )
+	{
+		corkEnabled = on;
+	}
+
+protected:
+	virtual int connectPeer( struct sockaddr_in &peerAddr );
+	virtual int listenLocal( const int port );
+	virtual void setCork( int fd, bool on );
+
+private:
+	bool noDelay;
+	bool corkEnabled;
+};
+
+}
+
+#endif
@@ -1,12 +1,23 @@
 #include "transport_udp.h"
-#include "transport_udp.h"
+
+#include <errno.h>
+#include <time.h>
 
 namespace pcs{
 
 TransportUDP::TransportUDP() : clientFd(-1),
-				serverFd(-1)
+				serverFd(-1),
+				fecEnabled(false),
+				multicastEnabled(false),
+				gsoEnabled(false)
 {
-
+	pthread_mutex_init( &fecMutex, NULL );
+	pthread_mutex_init( &statsMutex, NULL );
+	pthread_mutex_init( &mtuMutex, NULL );
+	memset( &sockStats, 0, sizeof( sockStats ) );
+	for( int i = 0; i < MTU_PROBE_NUM; i ++ ){
+		mtuProbes[i].fd = -1;
+	}
 }
 
 bool TransportUDP::initSocketServer( const int port )
@@ -24,6 +35,7 @@ bool TransportUDP::initSocketServer( const int port )
 		std::cerr<<"Bind the addr failed ..."<<std::endl;
 		return false;
 	}
+	enableDropCounter( serverFd );
 	
 	std::cerr<<"Initialize the udp server successfull ..."<<serverFd<<std::endl;
 	return true;
@@ -38,6 +50,7 @@ bool TransportUDP::initSocketClient()
                 return false;
         }
         //setsockopt( clientFd, SOL_SOCKET, SO_BROADCAST, &on, sizeof( on ) );
+	enableDropCounter( clientFd );
 	
 	std::cerr<<"initialize the udp client successfull: "<< clientFd <<std::endl;
 	/*struct timeval timeout;
@@ -52,39 +65,48 @@ bool TransportUDP::initSocketClient()
 
 int TransportUDP::read( int fd, unsigned char *buffer, int size )
 {
-	memset( &server_recv_addr, 0, sizeof( server_recv_addr ) );
-	int ret = recvfrom( fd, buffer, size, 0, ( struct sockaddr* )&server_recv_addr, &server_recv_len );
-        if( ret <= 0 ){
-                std::cerr<<"received error ..."<<std::endl;
-                return false;
-        }
-	
-        buffer[ret] = '\n';
-        std::cout <<"recvfrom "<< inet_ntoa(server_recv_addr.sin_addr) <<": "<< ntohs( server_recv_addr.sin_port )<< buffer << std::endl;
-        return ret;
-	/*struct sockaddr_in addr;
-	socklen_t addr_len;
-	int ret = recvfrom( fd, buffer, size, 0, ( struct sockaddr* )&addr, &addr_len );
-        if( ret <= 0 ){
-                std::cerr<<"received error ..."<<std::endl;
-                return false;
-        }
-        
-        buffer[ret] = '\n';
-        std::cout <<"recvfrom "<< inet_ntoa(addr.sin_addr) <<": "<< ntohs( addr.sin_port )<< buffer << std::endl;
-        return ret;*/
+	struct iovec iov;
+	iov.iov_base = buffer;
+	iov.iov_len = size;
+
+	struct msghdr msg;
+	memset( &msg, 0, sizeof( msg ) );
+	msg.msg_name = &server_recv_addr;
+	msg.msg_namelen = sizeof( server_recv_addr );
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = recvControl;
+	msg.msg_controllen = sizeof( recvControl );
+
+	int ret = recvmsg( fd, &msg, 0 );
+	if( ret < 0 ){
+		if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ){
+			std::cerr<<"received error ..."<<std::endl;
+		}
+		return -1;
+	}
+	server_recv_len = msg.msg_namelen;
+
+	pthread_mutex_lock( &statsMutex );
+	sockStats.rxBytes += ret;
+	sockStats.rxDatagrams ++;
+	parseDropCounter( &msg, sockStats.rxDropped );
+	pthread_mutex_unlock( &statsMutex );
+	return ret;
 }
 
 int TransportUDP::write( int fd, unsigned char *buffer, int size )
 {
 	client_dest_addr.sin_family = AF_INET;
-        client_dest_addr.sin_addr.s_addr = INADDR_BROADCAST;
+        client_dest_addr.sin_addr.s_addr = multicastEnabled ? multicastGroup.s_addr : INADDR_BROADCAST;
         client_dest_addr.sin_port = htons( 8888 );
         int ret = sendto( fd, buffer, size, 0, ( struct sockaddr*)&client_dest_addr, sizeof( client_dest_addr ) );
         if( ret <= 0 ){
+                countSendError();
                 std::cerr<<"send data falied ..."<<std::endl;
                 return false;
         }
+        countSent( ret, 1 );
     //    std::cerr<<"send data succussfully ..."<<std::endl;
         return ret;
 }
@@ -92,13 +114,15 @@ int TransportUDP::write( int fd, unsigned char *buffer, int size )
 int TransportUDP::write( int fd, unsigned char *buffer, int size, int port )
 {
 	client_dest_addr.sin_family = AF_INET;
-        client_dest_addr.sin_addr.s_addr = INADDR_BROADCAST;
+        client_dest_addr.sin_addr.s_addr = multicastEnabled ? multicastGroup.s_addr : INADDR_BROADCAST;
         client_dest_addr.sin_port = htons( port );
         int ret = sendto( fd, buffer, size, 0, ( struct sockaddr*)&client_dest_addr, sizeof( client_dest_addr ) );
         if( ret <= 0 ){
+                countSendError();
                 std::cerr<<"send data falied ..."<<std::endl;
                 return false;
         }
+        countSent( ret, 1 );
       //  std::cerr<<"send data succussfully ..."<<std::endl;
         return ret;
 }
@@ -107,13 +131,473 @@ int TransportUDP::write( int fd, unsigned char *buffer, int size, struct sockadd
 {
 	int ret = sendto( fd, buffer, size, 0, ( struct sockaddr*)&clientAddr, sizeof( clientAddr ) );
         if( ret <= 0 ){
+                countSendError();
                 std::cerr<<"send data falied ..."<<std::endl;
                 return false;
         }
-        std::cerr<<"send data succussfully ..."<<std::endl;
+        countSent( ret, 1 );
+    //    std::cerr<<"send data succussfully ..."<<std::endl;
         return ret;
 }
 
+void TransportUDP::countSent( int bytes, int datagrams )
+{
+	pthread_mutex_lock( &statsMutex );
+	sockStats.txBytes += bytes;
+	sockStats.txDatagrams += datagrams;
+	pthread_mutex_unlock( &statsMutex );
+}
+
+void TransportUDP::countSendError()
+{
+	int err = errno;
+	pthread_mutex_lock( &statsMutex );
+	sockStats.lastSendErrno = err;
+	sockStats.sendErrors ++;
+	pthread_mutex_unlock( &statsMutex );
+
+	// 分片超过了路径 MTU, 下一帧按新的 MTU 切分
+	if( err == EMSGSIZE ){
+		pthread_mutex_lock( &mtuMutex );
+		for( int i = 0; i < MTU_PROBE_NUM; i ++ ){
+			mtuProbes[i].stale = true;
+		}
+		pthread_mutex_unlock( &mtuMutex );
+	}
+	errno = err;
+}
+
+static int messageLength( const struct msghdr &msg )
+{
+	int len = 0;
+	for( size_t i = 0; i < msg.msg_iovlen; i ++ ){
+		len += msg.msg_iov[i].iov_len;
+	}
+	return len;
+}
+
+int TransportUDP::sendBatchGso( int fd, struct mmsghdr *msgs, int count )
+{
+	struct iovec iovs[GSO_MAX_SEGMENTS * 2];
+	char control[CMSG_SPACE( sizeof( uint16_t ) )];
+
+	int done = 0;
+	while( done < count ){
+		// 长度相同的连续分片拼成一个超级包, 内核按 segSize 切分, 只有最后一个分片可以更短
+		int segSize = messageLength( msgs[done].msg_hdr );
+		int num = 0;
+		int bytes = 0;
+		int iovNum = 0;
+		while( done + num < count && num < GSO_MAX_SEGMENTS ){
+			const struct msghdr &hdr = msgs[done + num].msg_hdr;
+			int len = messageLength( hdr );
+			if( len > segSize || bytes + len > MAX_DATAGRAM_SIZE || iovNum + (int)hdr.msg_iovlen > GSO_MAX_SEGMENTS * 2 ){
+				break;
+			}
+			memcpy( &iovs[iovNum], hdr.msg_iov, sizeof( struct iovec ) * hdr.msg_iovlen );
+			iovNum += hdr.msg_iovlen;
+			bytes += len;
+			num ++;
+			if( len < segSize ){
+				break;
+			}
+		}
+
+		pacer.acquire( bytes );
+
+		struct msghdr msg;
+		memset( &msg, 0, sizeof( msg ) );
+		msg.msg_name = msgs[done].msg_hdr.msg_name;
+		msg.msg_namelen = msgs[done].msg_hdr.msg_namelen;
+		msg.msg_iov = iovs;
+		msg.msg_iovlen = iovNum;
+		if( num > 1 ){
+			memset( control, 0, sizeof( control ) );
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof( control );
+			struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+			cmsg->cmsg_level = SOL_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+			*(uint16_t *)CMSG_DATA( cmsg ) = segSize;
+		}
+
+		if( sendmsg( fd, &msg, 0 ) < 0 ){
+			if( num > 1 && ( errno == EIO || errno == EINVAL || errno == ENOPROTOOPT ) ){
+				// 出口网卡或内核不能做 GSO, 关闭后剩下的分片逐个发送
+				std::cerr<<"udp gso send failed, fall back to sendmmsg ..."<<std::endl;
+				gsoEnabled = false;
+				return done + sendBatch( fd, &msgs[done], count - done );
+			}
+			countSendError();
+			std::cerr<<"send data falied ..."<<std::endl;
+			break;
+		}
+		countSent( bytes, num );
+		done += num;
+	}
+	return done;
+}
+
+int TransportUDP::sendBatch( int fd, struct mmsghdr *msgs, int count )
+{
+	if( gsoEnabled ){
+		return sendBatchGso( fd, msgs, count );
+	}
+
+	int burst = pacer.getBurst();
+	int done = 0;
+	while( done < count ){
+		int num = count - done;
+		if( burst > 0 ){
+			// 每次只发送令牌桶容量以内的分片, 令牌不足时等待
+			int bytes = 0;
+			num = 0;
+			while( done + num < count ){
+				int len = messageLength( msgs[done + num].msg_hdr );
+				if( num > 0 && bytes + len > burst ){
+					break;
+				}
+				bytes += len;
+				num ++;
+			}
+			pacer.acquire( bytes );
+		}
+
+		int ret = sendmmsg( fd, &msgs[done], num, 0 );
+		if( ret < 0 && errno == ENOSYS ){
+			// 内核不支持 sendmmsg, 逐个分片 sendmsg
+			ret = ( sendmsg( fd, &msgs[done].msg_hdr, 0 ) < 0 ) ? -1 : 1;
+		}
+		if( ret <= 0 ){
+			countSendError();
+			std::cerr<<"send data falied ..."<<std::endl;
+			break;
+		}
+		int bytes = 0;
+		for( int i = 0; i < ret; i ++ ){
+			bytes += messageLength( msgs[done + i].msg_hdr );
+		}
+		countSent( bytes, ret );
+		done += ret;
+	}
+	return done;
+}
+
+static int64_t monotonicMs()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+TransportUDP::MtuProbe* TransportUDP::findMtuProbe( const struct sockaddr_in &destAddr, int64_t nowMs )
+{
+	MtuProbe *probe = NULL;
+	for( int i = 0; i < MTU_PROBE_NUM; i ++ ){
+		MtuProbe &entry = mtuProbes[i];
+		if( entry.fd >= 0 && entry.addr.sin_addr.s_addr == destAddr.sin_addr.s_addr && entry.addr.sin_port == destAddr.sin_port ){
+			entry.useMs = nowMs;
+			return &entry;
+		}
+		if( probe == NULL || entry.fd < 0 || ( probe->fd >= 0 && entry.useMs < probe->useMs ) ){
+			probe = &entry;
+		}
+	}
+
+	if( probe->fd >= 0 ){
+		close( probe->fd );
+		probe->fd = -1;
+	}
+	int fd = socket( AF_INET, SOCK_DGRAM, 0 );
+	if( fd < 0 ){
+		return NULL;
+	}
+	int pmtu = IP_PMTUDISC_DO;
+	setsockopt( fd, IPPROTO_IP, IP_MTU_DISCOVER, &pmtu, sizeof( pmtu ) );
+	if( connect( fd, ( struct sockaddr* )&destAddr, sizeof( destAddr ) ) < 0 ){
+		close( fd );
+		return NULL;
+	}
+
+	probe->fd = fd;
+	probe->addr = destAddr;
+	probe->mtu = DEFAULT_PATH_MTU;
+	probe->stale = true;
+	probe->useMs = nowMs;
+	return probe;
+}
+
+int TransportUDP::getFragmentSize( struct sockaddr_in &destAddr )
+{
+	int64_t nowMs = monotonicMs();
+	int mtu = DEFAULT_PATH_MTU;
+
+	pthread_mutex_lock( &mtuMutex );
+	MtuProbe *probe = findMtuProbe( destAddr, nowMs );
+	if( probe != NULL ){
+		// 已连接的 UDP socket 上 IP_MTU 返回内核当前记录的路径 MTU (收到 ICMP 需要分片报文后会变小)
+		if( probe->stale || nowMs - probe->queryMs >= MTU_REFRESH_MS ){
+			int value = 0;
+			socklen_t len = sizeof( value );
+			if( getsockopt( probe->fd, IPPROTO_IP, IP_MTU, &value, &len ) == 0 && value > 0 ){
+				probe->mtu = value;
+			}
+			probe->stale = false;
+			probe->queryMs = nowMs;
+		}
+		mtu = probe->mtu;
+	}
+	pthread_mutex_unlock( &mtuMutex );
+
+	return fragmentSizeForMtu( mtu );
+}
+
+bool TransportUDP::setFec( int dataNum, int parityNum )
+{
+	pthread_mutex_lock( &fecMutex );
+	bool ret = true;
+	if( parityNum <= 0 ){
+		fecEnabled = false;
+	}
+	else if( fec.init( dataNum, parityNum ) ){
+		fecEnabled = true;
+	}
+	else {
+		std::cerr<<"invalid fec params: "<<dataNum<<" + "<<parityNum<<std::endl;
+		ret = false;
+	}
+	pthread_mutex_unlock( &fecMutex );
+	return ret;
+}
+
+/*
+ * 计算一帧所有组的校验块, 结果按 组号 * m + 组内序号 依次存放在 parityBuf 中.
+ * 最后一个数据块不满 fragSize 时补零, 最后一组不满 k 块时缺的块视为全零.
+ */
+void TransportUDP::encodeParity( const unsigned char *frame, int size, int fragSize )
+{
+	int k = fec.getDataNum();
+	int m = fec.getParityNum();
+	int dataCount = fragmentCount( size, fragSize );
+	int groups = ( dataCount + k - 1 ) / k;
+
+	parityBuf.resize( ( groups * m + 2 ) * fragSize );
+	unsigned char *zeroBlock = &parityBuf[groups * m * fragSize];
+	unsigned char *lastBlock = zeroBlock + fragSize;
+	memset( zeroBlock, 0, 2 * fragSize );
+	memcpy( lastBlock, frame + ( dataCount - 1 ) * fragSize, size - ( dataCount - 1 ) * fragSize );
+
+	std::vector<const unsigned char *> data( k );
+	std::vector<unsigned char *> parity( m );
+	for( int g = 0; g < groups; g ++ ){
+		for( int i = 0; i < k; i ++ ){
+			int index = g * k + i;
+			if( index < dataCount - 1 ){
+				data[i] = frame + index * fragSize;
+			}
+			else {
+				data[i] = ( index == dataCount - 1 ) ? lastBlock : zeroBlock;
+			}
+		}
+		for( int j = 0; j < m; j ++ ){
+			parity[j] = &parityBuf[( g * m + j ) * fragSize];
+		}
+		fec.encode( &data[0], &parity[0], fragSize );
+	}
+}
+
+void TransportUDP::setupDataFragment( FragmentHeader &fragHeader, int index, const unsigned char *frame, int size, int fragSize, struct iovec *iov )
+{
+	fragHeader.fragIndex = index;
+	fragHeader.offset = index * fragSize;
+	fragHeader.payloadLen = ( size - (int)fragHeader.offset < fragSize ) ? ( size - fragHeader.offset ) : fragSize;
+	iov[1].iov_base = (void *)( frame + fragHeader.offset );
+	iov[1].iov_len = fragHeader.payloadLen;
+}
+
+void TransportUDP::setupMessage( const FragmentHeader &fragHeader, unsigned char *head, struct iovec *iov, struct mmsghdr &msg, struct sockaddr_in &clientAddr )
+{
+	encodeFragmentHeader( fragHeader, head );
+	iov[0].iov_base = head;
+	iov[0].iov_len = FRAGMENT_HEADER_SIZE;
+
+	msg.msg_hdr.msg_name = &clientAddr;
+	msg.msg_hdr.msg_namelen = sizeof( clientAddr );
+	msg.msg_hdr.msg_iov = iov;
+	msg.msg_hdr.msg_iovlen = 2;
+}
+
+int TransportUDP::writeFrame( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header, struct sockaddr_in &clientAddr )
+{
+	unsigned char heads[SEND_BATCH_SIZE][FRAGMENT_HEADER_SIZE];
+	struct iovec iovs[SEND_BATCH_SIZE][2];
+	struct mmsghdr msgs[SEND_BATCH_SIZE];
+
+	FragmentHeader fragHeader = header;
+	fragHeader.fragCount = fragmentCount( size, fragSize );
+	fragHeader.frameSize = size;
+	fragHeader.fecParams = 0;
+
+	pthread_mutex_lock( &fecMutex );
+
+	int total = fragHeader.fragCount;
+	if( fecEnabled && total > 0 ){
+		encodeParity( frame, size, fragSize );
+		fragHeader.fecParams = ( fec.getDataNum() << 8 ) | fec.getParityNum();
+		total += ( fragHeader.fragCount + fec.getDataNum() - 1 ) / fec.getDataNum() * fec.getParityNum();
+	}
+
+	int sent = 0;
+	for( int first = 0; first < total; first += SEND_BATCH_SIZE ){
+		int batch = total - first;
+		if( batch > SEND_BATCH_SIZE ){
+			batch = SEND_BATCH_SIZE;
+		}
+
+		// 分片头写入头数组, 分片数据直接指向帧缓存(校验分片指向校验缓存), 不做拷贝
+		memset( msgs, 0, sizeof( struct mmsghdr ) * batch );
+		for( int i = 0; i < batch; i ++ ){
+			int index = first + i;
+			if( index < fragHeader.fragCount ){
+				fragHeader.flags = header.flags;
+				setupDataFragment( fragHeader, index, frame, size, fragSize, iovs[i] );
+			}
+			else {
+				fragHeader.flags = header.flags | FRAG_FLAG_PARITY;
+				fragHeader.fragIndex = index - fragHeader.fragCount;
+				fragHeader.offset = 0;
+				fragHeader.payloadLen = fragSize;
+				iovs[i][1].iov_base = &parityBuf[fragHeader.fragIndex * fragSize];
+				iovs[i][1].iov_len = fragSize;
+			}
+			setupMessage( fragHeader, heads[i], iovs[i], msgs[i], clientAddr );
+		}
+
+		int done = sendBatch( fd, msgs, batch );
+		sent += done;
+		if( done < batch ){
+			break;
+		}
+	}
+
+	pthread_mutex_unlock( &fecMutex );
+	return sent;
+}
+
+bool TransportUDP::setPacing( int64_t bitsPerSec, int burstBytes )
+{
+	pacer.setRate( bitsPerSec, burstBytes );
+	return true;
+}
+
+bool TransportUDP::setGso( bool enable )
+{
+	if( !enable ){
+		gsoEnabled = false;
+		return true;
+	}
+
+	// 在 socket 上设置一次 UDP_SEGMENT 检查内核是否支持, 实际的切分长度随每个超级包指定
+	int segSize = 0;
+	if( clientFd < 0 || setsockopt( clientFd, SOL_UDP, UDP_SEGMENT, &segSize, sizeof( segSize ) ) < 0 ){
+		std::cerr<<"udp gso is not supported ..."<<std::endl;
+		gsoEnabled = false;
+		return false;
+	}
+
+	gsoEnabled = true;
+	return true;
+}
+
+bool TransportUDP::setMulticast( const char *group, int ttl, const char *ifaceIp, bool loop )
+{
+	struct in_addr groupAddr;
+	if( clientFd < 0 || inet_aton( group, &groupAddr ) == 0 || !IN_MULTICAST( ntohl( groupAddr.s_addr ) ) ){
+		std::cerr<<"invalid multicast group: "<<group<<std::endl;
+		return false;
+	}
+
+	unsigned char value = ttl;
+	if( setsockopt( clientFd, IPPROTO_IP, IP_MULTICAST_TTL, &value, sizeof( value ) ) < 0 ){
+		std::cerr<<"set IP_MULTICAST_TTL failed ..."<<std::endl;
+		return false;
+	}
+
+	value = loop ? 1 : 0;
+	if( setsockopt( clientFd, IPPROTO_IP, IP_MULTICAST_LOOP, &value, sizeof( value ) ) < 0 ){
+		std::cerr<<"set IP_MULTICAST_LOOP failed ..."<<std::endl;
+		return false;
+	}
+
+	if( ifaceIp != NULL ){
+		struct in_addr iface;
+		iface.s_addr = inet_addr( ifaceIp );
+		if( setsockopt( clientFd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof( iface ) ) < 0 ){
+			std::cerr<<"set IP_MULTICAST_IF failed ..."<<std::endl;
+			return false;
+		}
+	}
+
+	multicastGroup = groupAddr;
+	multicastEnabled = true;
+	return true;
+}
+
+bool TransportUDP::getPacerStats( PacerStats &stats )
+{
+	stats = pacer.getStats();
+	return true;
+}
+
+Pacer* TransportUDP::getPacer()
+{
+	return &pacer;
+}
+
+bool TransportUDP::getSocketStats( SocketStats &stats )
+{
+	pthread_mutex_lock( &statsMutex );
+	stats = sockStats;
+	pthread_mutex_unlock( &statsMutex );
+	querySocketQueues( ( clientFd >= 0 ) ? clientFd : serverFd, stats );
+	return true;
+}
+
+int TransportUDP::writeFragments( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header,
+				const uint16_t *indices, int count, struct sockaddr_in &clientAddr )
+{
+	unsigned char heads[SEND_BATCH_SIZE][FRAGMENT_HEADER_SIZE];
+	struct iovec iovs[SEND_BATCH_SIZE][2];
+	struct mmsghdr msgs[SEND_BATCH_SIZE];
+
+	FragmentHeader fragHeader = header;
+	fragHeader.fragCount = fragmentCount( size, fragSize );
+	fragHeader.frameSize = size;
+
+	int sent = 0;
+	int batch = 0;
+	for( int n = 0; n < count; n ++ ){
+		if( indices[n] < fragHeader.fragCount ){
+			memset( &msgs[batch], 0, sizeof( struct mmsghdr ) );
+			setupDataFragment( fragHeader, indices[n], frame, size, fragSize, iovs[batch] );
+			setupMessage( fragHeader, heads[batch], iovs[batch], msgs[batch], clientAddr );
+			batch ++;
+		}
+
+		if( batch == SEND_BATCH_SIZE || ( n == count - 1 && batch > 0 ) ){
+			int done = sendBatch( fd, msgs, batch );
+			sent += done;
+			if( done < batch ){
+				break;
+			}
+			batch = 0;
+		}
+	}
+
+	return sent;
+}
+
 void TransportUDP::closeSocket( int fd )
 {
 	close( fd );
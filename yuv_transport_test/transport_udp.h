@@ -8,8 +8,25 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <netinet/udp.h>
+#include <pthread.h>
+#include <vector>
 
 #include "transport.h"
+#include "fec.h"
+
+#define SEND_BATCH_SIZE 64  // 每次 sendmmsg 最多发送的分片数
+#define GSO_MAX_SEGMENTS 64  // 一个 GSO 超级包最多包含的分片数
+#define MTU_PROBE_NUM 8  // 缓存路径 MTU 的目的地址数
+#define MTU_REFRESH_MS 1000  // 每隔这么久重新读取一次路径 MTU, 发送返回 EMSGSIZE 时立即重读
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103  // 旧的内核头文件中没有定义
+#endif
 
 namespace pcs{
 
@@ -19,6 +36,14 @@ public:
 	TransportUDP();
 	virtual ~TransportUDP()
 	{
+		for( int i = 0; i < MTU_PROBE_NUM; i ++ ){
+			if( mtuProbes[i].fd >= 0 ){
+				close( mtuProbes[i].fd );
+			}
+		}
+		pthread_mutex_destroy( &fecMutex );
+		pthread_mutex_destroy( &statsMutex );
+		pthread_mutex_destroy( &mtuMutex );
 		std::cout<<"deconstructure of class TransportUDP..."<<std::endl;
 	}
 
@@ -27,6 +52,18 @@ public:
         virtual int write( int fd, unsigned char *buffer, int size, int port );
         virtual int write( int fd, unsigned char *buffer, int size, struct sockaddr_in &clientAddr );
 
+	virtual int writeFrame( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header, struct sockaddr_in &clientAddr );
+	virtual int writeFragments( int fd, const unsigned char *frame, int size, int fragSize, const FragmentHeader &header,
+				const uint16_t *indices, int count, struct sockaddr_in &clientAddr );
+	virtual int getFragmentSize( struct sockaddr_in &destAddr );
+	virtual bool setFec( int dataNum, int parityNum );
+	virtual bool setPacing( int64_t bitsPerSec, int burstBytes );
+	virtual bool setGso( bool enable );
+	virtual bool setMulticast( const char *group, int ttl, const char *ifaceIp, bool loop );
+	virtual bool getPacerStats( PacerStats &stats );
+	virtual Pacer* getPacer();
+	virtual bool getSocketStats( SocketStats &stats );
+
         virtual void closeSocket( int fd );
 
 	virtual bool initSocketServer( const int port );
@@ -52,6 +89,50 @@ private:
 
         struct sockaddr_in client_dest_addr;
         //socklen_t client_dest_len;
+
+	int sendBatch( int fd, struct mmsghdr *msgs, int count );
+	int sendBatchGso( int fd, struct mmsghdr *msgs, int count );
+	void setupDataFragment( FragmentHeader &fragHeader, int index, const unsigned char *frame, int size, int fragSize, struct iovec *iov );
+	void setupMessage( const FragmentHeader &fragHeader, unsigned char *head, struct iovec *iov, struct mmsghdr &msg, struct sockaddr_in &clientAddr );
+	void encodeParity( const unsigned char *frame, int size, int fragSize );
+	void countSent( int bytes, int datagrams );
+	void countSendError();
+
+	// 前向纠错, 校验块缓存在多个发送线程间共用, 由 fecMutex 保护
+	FecCodec fec;
+	bool fecEnabled;
+	std::vector<unsigned char> parityBuf;
+	pthread_mutex_t fecMutex;
+
+	// 所有分片(含重传)都经过同一个节拍器
+	Pacer pacer;
+
+	// 设置了组播组后, 不带目的地址的 write 发往该组而不是广播
+	bool multicastEnabled;
+	struct in_addr multicastGroup;
+
+	// UDP GSO: 多个分片拼成一个超级包由内核切分, 发送失败时自动退回逐个分片发送
+	volatile bool gsoEnabled;
+
+	// 收发统计, 接收时顺带取出 SO_RXQ_OVFL 控制消息中的内核丢包数; 图像和重传在不同线程发送, 由 statsMutex 保护
+	SocketStats sockStats;
+	pthread_mutex_t statsMutex;
+	char recvControl[DROP_COUNTER_CMSG_SPACE];
+
+	// 每个目的地址一个已连接的探测 socket, 按周期重读 IP_MTU, 不必每帧都新建 socket; 由 mtuMutex 保护
+	struct MtuProbe
+	{
+		int fd;
+		struct sockaddr_in addr;
+		int mtu;
+		bool stale;		// 需要重新读取
+		int64_t queryMs;	// 上次读取的时间
+		int64_t useMs;		// 上次使用的时间, 缓存满时替换最久未用的
+	};
+	MtuProbe mtuProbes[MTU_PROBE_NUM];
+	pthread_mutex_t mtuMutex;
+
+	MtuProbe* findMtuProbe( const struct sockaddr_in &destAddr, int64_t nowMs );
 };
 
 }
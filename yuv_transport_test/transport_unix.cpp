@@ -0,0 +1,69 @@
+#include "transport_unix.h"
+
+#include <sys/un.h>
+
+namespace pcs{
+
+TransportUnix::TransportUnix( const char *path ) : socketPath(path),
+						listening(false)
+{
+
+}
+
+TransportUnix::~TransportUnix()
+{
+	if( listening ){
+		unlink( socketPath.c_str() );
+	}
+	std::cout<<"deconstructure of class TransportUnix..."<<std::endl;
+}
+
+static void fillAddr( const std::string &path, struct sockaddr_un &addr )
+{
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	strncpy( addr.sun_path, path.c_str(), sizeof( addr.sun_path ) - 1 );
+}
+
+int TransportUnix::connectPeer( struct sockaddr_in &peerAddr )
+{
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( fd < 0 ){
+		std::cerr<<"socket UNIX client falied ..."<<std::endl;
+		return -1;
+	}
+	setBuffers( fd );
+
+	struct sockaddr_un addr;
+	fillAddr( socketPath, addr );
+	if( connect( fd, ( struct sockaddr* )&addr, sizeof( addr ) ) < 0 ){
+		std::cerr<<"connect to "<<socketPath<<" failed ..."<<std::endl;
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+int TransportUnix::listenLocal( const int port )
+{
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( fd < 0 ){
+		std::cerr<<"socket UNIX server failed ..."<<std::endl;
+		return -1;
+	}
+	setBuffers( fd );
+
+	struct sockaddr_un addr;
+	fillAddr( socketPath, addr );
+	unlink( socketPath.c_str() );
+	if( bind( fd, ( struct sockaddr* )&addr, sizeof( addr ) ) < 0 || listen( fd, 1 ) < 0 ){
+		std::cerr<<"Bind "<<socketPath<<" failed ..."<<std::endl;
+		close( fd );
+		return -1;
+	}
+
+	listening = true;
+	return fd;
+}
+
+}
@@ -0,0 +1,33 @@
+#ifndef __TRANSPORT_UNIX_H_
+#define __TRANSPORT_UNIX_H_
+
+#include <string>
+
+#include "transport_stream.h"
+
+#define UNIX_SOCKET_PATH "/tmp/pcs_frames.sock"  // 本机录像等进程的默认连接路径
+
+namespace pcs{
+
+/*
+ * Unix 域字节流传输, 用于同一主机上的进程, 地址为 socket 文件路径,
+ * 写接口和 initSocketServer 中的 IP 地址与端口不使用.
+ */
+class TransportUnix: public TransportStream
+{
+public:
+	TransportUnix( const char *path = UNIX_SOCKET_PATH );
+	virtual ~TransportUnix();
+
+protected:
+	virtual int connectPeer( struct sockaddr_in &peerAddr );
+	virtual int listenLocal( const int port );
+
+private:
+	std::string socketPath;
+	bool listening;
+};
+
+}
+
+#endif